@@ -4,236 +4,108 @@
 // What it does:
 //   • Lets you type math expressions and get results instantly.
 //   • Provides simple commands to help you: help, history, clear, exit.
+//   • Remembers your inputs and answers between sessions (see History).
 //
 // Supported:
 //   - Operators: +   -   *   /   ^
 //   - Parentheses: ( ... )
-//   - Functions: sin(), cos(), tan(), sqrt(), log(), ln(), exp()
+//   - Functions: sin(), cos(), tan(), sqrt(), log(), ln(), exp(), abs()
+//   - Comparisons < <= > >= == != (1 or 0), min(a, b), max(a, b) and
+//     if(cond, a, b), which only evaluates the side it returns
 //   - Constants: pi (≈3.14159), e (≈2.71828)
 //   - Scientific notation: 1e-3, 2E2
 //   - Chaining: start with + - * / ^ to use last answer
-//   - Adjustable decimal precision (6 digits by default)
+//   - Adjustable output: fixed N decimals (6 by default), sci N, eng N, or
+//     shortest round-trip ("format" and "precision" commands)
+//   - integrate(expr, x, a, b [, tol]): adaptive Gauss–Kronrod, multithreaded
+//     ($CALC_THREADS sets the thread count)
+//   - solve(expr, x, a, b) / minimize(expr, x, a, b): Newton (symbolic f')
+//     or Brent; add "p = from : to [: step]" to solve one instance per p
+//   - sum/prod/min/max(k, from, to, expr): parallel, thread-count independent
+//   - rand(), randn() and mc(expr, N [, seed]): Monte Carlo mean with a
+//     counter-based RNG ($CALC_SEED fixes the default seed)
+//   - sample(expr, x, a, b [, tol] [, file]): adaptive plot points, dense only
+//     where the curve bends or jumps, saved as .csv or binary .bin
+//
+//   - Vectors and matrices: [1, 2; 3, 4] with elementwise + - * / ^ and
+//     dot, matmul, transpose, solve, det, zeros, ones, eye, linspace
+//   - fft, ifft, conv on vectors (complex arrays are [re; im] matrices)
+//   - poly(coeffs, X): polynomial at every element; typed polynomials such as
+//     3*x^5 + 2*x^4 - x^2 + 7 are compiled to Horner form automatically
+//   - Integer mode ("mode integer"): arbitrary-size integers with % and n!,
+//     gcd, lcm, powmod, isprime, factor and primes(a, b)
+//   - Whole-number expressions are exact 64-bit integers (2^62 + 1, 17 % 5),
+//     with hex/binary literals and bitwise & | xor << >> ~ on uint64
+//   - Complex mode ("mode complex"): i, and every operator and function
+//     works on complex values, e.g. sqrt(-1) = i, ln(-2) = 0.693147 + 3.141593i
+//
+//   - Tables: "table f(x) = expr, a : b [: step]" samples expr once and
+//     f(x) then interpolates (cubic, or linear) between the samples
 //
 // Not supported:
 //   • Implicit multiplication (write 2*pi, not 2pi)
-//   • Factorials, matrices, user-defined functions
+//   • User-defined functions other than tables
 //
 // Note: trig functions use radians (e.g. sin(pi/2) = 1).
 //
+// How it works:
+//   Input is tokenized, converted to postfix, then compiled into
+//   three-address code for a small register VM (see "dump <expr>").
+//   Each stage lives in its own module under src/.
+//
 // Compile and run:
-//   g++ -std=c++17 -O2 calculator.cpp -o calculator
+//   make                      (or: g++ -std=c++17 -O2 -pthread -Isrc calculator.cpp src/*.cpp -o calculator)
+//   (add -O3 -march=native to CXXFLAGS to let the SIMD kernels use AVX/FMA)
+//   make test                 (builds and runs the checks in tests/)
 //   ./calculator
-
+//   ./calculator --bench      (postfix evaluator vs register VM)
+//   ./calculator --bench --json results.json   (and per-phase hardware
+//   counters as JSON: cycles, instructions, IPC, branch and cache misses)
+//
+// Statistics of a stream of numbers (stdin, or files) in one pass:
+//   seq 1 1000000 | ./calculator --stats
+//
+// Precompiled formulas (see readFormulaFile for the file format):
+//   ./calculator --compile formulas.txt -o formulas.cbc
+//   ./calculator --load formulas.cbc
+//
+// All formulas of a file on every row of a CSV table, one column each,
+// computing what they have in common once per row (--memo caches pow and
+// exp results for columns with repeated values):
+//   ./calculator --columns formulas.txt data.csv > results.csv
+
+#include "arena.h"
+#include "bench.h"
+#include "bigint.h"
+#include "columns.h"
+#include "complex.h"
+#include "drivers.h"
+#include "fixedint.h"
+#include "format.h"
+#include "formulas.h"
+#include "history.h"
+#include "matrix.h"
+#include "parser.h"
+#include "perf.h"
+#include "random.h"
+#include "stats.h"
+#include "tables.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
-#include <stack>
 #include <vector>
-#include <map>
-#include <regex>
-#include <cmath>
-#include <iomanip>
 
 using namespace std;
 
-// Token types for parsing expressions
-enum TokenType { NUMBER, OPERATOR, FUNCTION, LEFT_PAREN, RIGHT_PAREN };
-struct Token {
-    string text;       // literal text of the token
-    TokenType type;    // what kind of token it is
-};
-
-// Operator precedence and associativity maps
-static const map<string,int> opPrec = {
-    {"^", 4}, {"**", 4},
-    {"*", 3}, {"/", 3},
-    {"+", 2}, {"-", 2}
-};
-static const map<string,bool> opRight = {
-    {"^", true}, {"**", true}
-};
-
-// Recognized functions and constants
-static const vector<string> functions = {
-    "sin","cos","tan","sqrt","log","ln","exp"
-};
-static const map<string,double> constants = {
-    {"pi", M_PI},
-    {"e",  M_E}
-};
-
-// Check if a string matches a number (including scientific notation)
-bool isNumber(const string& s) {
-    static const regex numRx(R"(^[+-]?(\d+(\.\d*)?|\.\d+)([eE][+-]?\d+)?$)");
-    return regex_match(s, numRx);
-}
-
-// Break an input expression into tokens
-vector<Token> tokenize(const string& expr) {
-    vector<Token> tokens;
-    size_t i = 0, n = expr.size();
-
-    while (i < n) {
-        if (isspace(expr[i])) {
-            ++i; 
-            continue;        // skip whitespace
-        }
-
-        // Number or scientific notation
-        if (isdigit(expr[i]) || expr[i]=='.') {
-            size_t j = i;
-            while (j<n && (isdigit(expr[j])||expr[j]=='.')) j++;
-            if (j<n && (expr[j]=='e'||expr[j]=='E')) {
-                j++; 
-                if (j<n && (expr[j]=='+'||expr[j]=='-')) j++;
-                while (j<n && isdigit(expr[j])) j++;
-            }
-            tokens.push_back({expr.substr(i,j-i), NUMBER});
-            i = j;
-        }
-        // Left parenthesis
-        else if (expr[i]=='(') {
-            tokens.push_back({"(", LEFT_PAREN});
-            ++i;
-        }
-        // Right parenthesis
-        else if (expr[i]==')') {
-            tokens.push_back({")", RIGHT_PAREN});
-            ++i;
-        }
-        // Two-character exponent operator
-        else if (i+1<n && expr.substr(i,2)=="**") {
-            tokens.push_back({"**", OPERATOR});
-            i += 2;
-        }
-        // Single-character operators + - * / ^
-        else if (string("+-*/^").find(expr[i]) != string::npos) {
-            tokens.push_back({string(1,expr[i]), OPERATOR});
-            ++i;
-        }
-        // Alphabetic names: either function or constant
-        else if (isalpha(expr[i])) {
-            size_t j = i;
-            while (j<n && isalpha(expr[j])) j++;
-            string name = expr.substr(i, j-i);
-
-            if (find(functions.begin(), functions.end(), name) != functions.end()) {
-                tokens.push_back({name, FUNCTION});
-            }
-            else if (constants.count(name)) {
-                // Replace constant with its numeric value
-                tokens.push_back({to_string(constants.at(name)), NUMBER});
-            }
-            else {
-                // Unknown identifier
-                throw runtime_error("Unknown name: " + name);
-            }
-            i = j;
-        }
-        // Anything else is invalid
-        else {
-            throw runtime_error(string("Invalid character: ") + expr[i]);
-        }
-    }
-
-    return tokens;
-}
-
-// Convert infix tokens to postfix (Reverse Polish Notation)
-vector<Token> infixToPostfix(const vector<Token>& in) {
-    vector<Token> out;
-    stack<Token>  ops;
-
-    for (auto &tok : in) {
-        switch (tok.type) {
-            case NUMBER:
-                out.push_back(tok);
-                break;
-
-            case FUNCTION:
-                ops.push(tok);
-                break;
-
-            case OPERATOR:
-                // While top of ops stack has higher precedence, pop it first
-                while (!ops.empty() &&
-                      (ops.top().type == FUNCTION ||
-                       (ops.top().type == OPERATOR &&
-                        (opPrec.at(ops.top().text) > opPrec.at(tok.text) ||
-                        (opPrec.at(ops.top().text) == opPrec.at(tok.text) &&
-                         !opRight.count(tok.text))))))
-                {
-                    out.push_back(ops.top());
-                    ops.pop();
-                }
-                ops.push(tok);
-                break;
-
-            case LEFT_PAREN:
-                ops.push(tok);
-                break;
-
-            case RIGHT_PAREN:
-                // Pop until matching left parenthesis
-                while (!ops.empty() && ops.top().type != LEFT_PAREN) {
-                    out.push_back(ops.top());
-                    ops.pop();
-                }
-                if (!ops.empty()) ops.pop();  // remove "("
-                if (!ops.empty() && ops.top().type == FUNCTION) {
-                    out.push_back(ops.top());
-                    ops.pop();               // pop the function too
-                }
-                break;
-        }
-    }
-
-    // Pop any remaining operators
-    while (!ops.empty()) {
-        out.push_back(ops.top());
-        ops.pop();
-    }
-
-    return out;
-}
-
-// Evaluate a postfix expression stack
-double evalPostfix(const vector<Token>& pf) {
-    stack<double> st;
-
-    for (auto &tok : pf) {
-        if (tok.type == NUMBER) {
-            st.push(stod(tok.text));  // convert text to double
-        }
-        else if (tok.type == FUNCTION) {
-            double v = st.top(); st.pop();
-            if      (tok.text=="sin")  st.push(sin(v));
-            else if (tok.text=="cos")  st.push(cos(v));
-            else if (tok.text=="tan")  st.push(tan(v));
-            else if (tok.text=="sqrt") st.push(sqrt(v));
-            else if (tok.text=="log")  st.push(log10(v));
-            else if (tok.text=="ln")   st.push(log(v));
-            else if (tok.text=="exp")  st.push(exp(v));
-        }
-        else if (tok.type == OPERATOR) {
-            double b = st.top(); st.pop();
-            double a = st.top(); st.pop();
-            if      (tok.text=="+")  st.push(a + b);
-            else if (tok.text=="-")  st.push(a - b);
-            else if (tok.text=="*")  st.push(a * b);
-            else if (tok.text=="/")  {
-                if (b == 0) throw runtime_error("Cannot divide by zero");
-                st.push(a / b);
-            }
-            else if (tok.text=="^"||tok.text=="**") {
-                st.push(pow(a, b));
-            }
-        }
-    }
-
-    if (st.size() != 1) throw runtime_error("Invalid expression");
-    return st.top();
-}
-
 // Print friendly help instructions to the user
 void printHelp() {
     cout << "\n❓ Need help? Here’s how to get started:\n\n"
@@ -244,37 +116,143 @@ void printHelp() {
          << "     sin(pi/2)      (trig in radians)\n\n"
          << "2) Use these symbols and words:\n"
          << "     +  -  *  /  ^    ( )\n"
-         << "     sin(), cos(), tan(), sqrt(), log(), ln(), exp()\n"
-         << "     pi, e           sci‑notation: 1e-3, 2E2\n\n"
+         << "     sin(), cos(), tan(), sqrt(), log(), ln(), exp(), abs()\n"
+         << "     <  <=  >  >=  ==  !=   give 1 or 0;  min(a, b), max(a, b)\n"
+         << "     if(x > 0, sqrt(x), 0)   only the chosen side is worked out\n"
+         << "     pi, e           sci‑notation: 1e-3, 2E2\n"
+         << "     whole numbers are exact 64-bit integers: 2^62 + 1, 17 % 5\n"
+         << "     0xff, 0b1010   &  |  xor  <<  >>  ~   bitwise (wraps like C uint64)\n"
+         << "     integrate(x^2, x, 0, 1 [, tol])   definite integral\n"
+         << "     solve(x^2-2, x, 0, 2)             root in [a, b]\n"
+         << "     minimize((x-1)^2, x, -5, 5)       minimum in [a, b]\n"
+         << "     solve(x^2-p, x, 0, 100, p = 1 : 1000)   one root per p\n"
+         << "     sum(k, 1, 1e6, 1/k^2)             also prod, min, max\n"
+         << "     rand(), randn()                   uniform [0, 1), standard normal\n"
+         << "     mc(exp(randn()), 1e6 [, seed])    Monte Carlo mean of expr\n"
+         << "     sample(sin(1/x), x, 0.01, 1 [, tol] [, out.csv])   points for a plot\n\n"
+         << "   Vectors and matrices:\n"
+         << "     [1, 2, 3]   [1, 2; 3, 4]      + - * / ^ work elementwise\n"
+         << "     dot, matmul, transpose, solve(A, b), det, zeros, ones, eye\n"
+         << "     linspace(0, 1, 5)   fft(x)  ifft(X)  conv(a, b)   ([re; im] rows)\n"
+         << "     poly([3, 0, -1], X)  3x^2 - 1 at every element of X\n\n"
          << "3) Special commands:\n"
          << "     help  or  ?     show this message\n"
-         << "     history         list past inputs\n"
+         << "     history         list recent inputs (kept between sessions)\n"
+         << "     history search <text>   find inputs containing text\n"
+         << "     history prefix <text>   find inputs starting with text\n"
+         << "     !N              recall entry N and its answer\n"
+         << "     dump <expr>     show the compiled register code\n"
+         << "                     (unknown names such as x become parameters)\n"
+         << "     formulas        list formulas loaded with --load\n"
+         << "     table f(x) = exp(-x^2), -5 : 5 [: step] [, linear]\n"
+         << "                     sample once on a grid, then f(x) interpolates\n"
+         << "     tables          list tables with their size and error\n"
+         << "     format fixed 6  result format: fixed N, sci N, eng N or shortest\n"
+         << "     precision N     digits for the current format\n"
+         << "     profile on      time, cycles, IPC and cache/branch misses of each\n"
+         << "                     phase after every result (profile off to stop)\n"
+         << "     limits          longest and deepest expression accepted;\n"
+         << "                     change with limits length N, limits depth N\n"
+         << "     mode complex    complex arithmetic with i (mode real to go back)\n"
+         << "     mode integer    exact integers: 2^100, 50!, 17 % 5, gcd(a, b), lcm(a, b),\n"
+         << "                     powmod(a, e, m), isprime(n), factor(n), primes(a, b)\n"
          << "     clear           erase history & last answer\n"
          << "     exit            quit the calculator\n\n"
          << "Enjoy! 😊\n\n";
 }
 
-int main() {
+void printUsage() {
+    cerr << "usage: calculator                              interactive calculator\n"
+         << "       calculator --load formulas.cbc          ... with compiled formulas\n"
+         << "       calculator --compile formulas.txt -o formulas.cbc\n"
+         << "       calculator --bench [--json out.json]    timings, counters as JSON\n"
+         << "       calculator --stats [file ...]           one-pass statistics of numbers\n"
+         << "       calculator --columns formulas.txt [data.csv] [--memo[=N]]\n"
+         << "                                               every formula on every CSV row\n";
+}
+
+int main(int argc, char** argv) {
+    vector<string> args(argv + 1, argv + argc);
+    unique_ptr<CompiledFile> formulas;   // set by --load
+
+    try {
+        if (!args.empty() && args[0] == "--bench" &&
+            (args.size() == 1 || (args.size() == 3 && args[1] == "--json"))) {
+            runBenchmarks(args.size() == 3 ? args[2] : "");
+            return 0;
+        }
+        if (args.size() == 4 && args[0] == "--compile" && args[2] == "-o") {
+            auto progs = compileFormulaFile(args[1]);
+            writeCompiledFile(args[3], progs);
+            cout << "✓ Compiled " << progs.size() << " formula(s) into " << args[3] << "\n";
+            return 0;
+        }
+        if (!args.empty() && args[0] == "--stats")
+            return runStats(vector<string>(args.begin() + 1, args.end()));
+        if (!args.empty() && args[0] == "--columns") {
+            vector<string> rest(args.begin() + 1, args.end());
+            uint32_t memo = 0;
+            auto flag = find_if(rest.begin(), rest.end(), [](const string& a) { return a.rfind("--memo", 0) == 0; });
+            if (flag != rest.end()) {
+                memo = 4096;
+                if (*flag != "--memo") {
+                    const char* p = flag->c_str() + 7;
+                    auto [end, ec] = from_chars(p, flag->c_str() + flag->size(), memo);
+                    if ((*flag)[6] != '=' || ec != errc() || *end || memo == 0)
+                        throw runtime_error("--memo=N takes a power of two up to " + to_string(maxMemoEntries));
+                }
+                rest.erase(flag);
+            }
+            if (rest.size() == 1 || rest.size() == 2)
+                return runColumns(rest[0], rest.size() == 2 ? rest[1] : "-", memo);
+        }
+        if (args.size() == 2 && args[0] == "--load") {
+            formulas = make_unique<CompiledFile>(args[1]);
+        }
+        else if (!args.empty()) {
+            printUsage();
+            return 1;
+        }
+    }
+    catch (const exception &ex) {
+        cerr << "⚠️  Error: " << ex.what() << "\n";
+        return 1;
+    }
+
     // Friendly welcome instructing what to do first
     cout << "\n🎉 Welcome to Joshua’s Calculator! 🎉\n"
          << "Type a math problem and press Enter,\n"
          << "or type \"help\" for instructions.\n\n";
+    if (formulas) {
+        cout << "📦 Loaded " << formulas->size() << " compiled formula(s); "
+             << "type \"formulas\" to list them.\n\n";
+    }
 
-    vector<string> history;
+    History history(historyPath());
+    if (!history.note.empty()) cout << "⚠️  Note: " << history.note << "\n\n";
+    LineArena lineArena;
     double lastResult = 0.0;
+    double lastImag   = 0.0;     // imaginary part, complex mode only
     bool   hasResult  = false;
-    int    precision  = 6;
+    bool   complexMode = false;
+    bool   integerMode = false;
+    string lastInteger;          // exact last result, integer mode only
+    bool   lastExact  = false;   // ... or from the 64-bit integer path
+    NumberFormat format;         // how results are printed
+    bool   profiling  = false;   // "profile on": counters for each phase
+    PerfPhases phases;           // ... of the current line
     string line;
 
     while (true) {
         // If we have a previous result, show it in the prompt
         if (hasResult) {
-            cout << "[" << fixed << setprecision(precision)
-                 << lastResult << "] ";
+            cout << "[" << (integerMode || lastExact ? abbreviateInteger(lastInteger)
+                                        : formatComplex({lastResult, lastImag}, format)) << "] ";
         }
         cout << "> ";
         if (!getline(cin, line)) break;   // EOF or error
         if (line.empty()) continue;       // skip blank lines
+        LineScope scope(lineArena);       // scratch memory for this line only
 
         // Handle each command
         if (line == "exit") {
@@ -292,32 +270,237 @@ int main() {
             continue;
         }
         if (line == "history") {
-            cout << "\n📜 You typed:\n";
-            for (size_t i = 0; i < history.size(); ++i) {
-                cout << "  " << (i+1) << ": " << history[i] << "\n";
+            const size_t shown = 20, n = history.size();
+            cout << "\n📜 You typed" << (n > shown ? " (latest " + to_string(shown) + " of " + to_string(n) + ")" : "") << ":\n";
+            for (size_t i = n > shown ? n - shown : 0; i < n; ++i) {
+                cout << "  " << (i+1) << ": " << history.input(i) << "\n";
+            }
+            cout << "\n";
+            continue;
+        }
+        if (line.rfind("history search ", 0) == 0 || line.rfind("history prefix ", 0) == 0) {
+            bool prefix = line[8] == 'p';
+            auto hits = history.search(line.substr(15), prefix, 20);
+            cout << "\n🔎 " << (hits.empty() ? "No matches" : "Matches, newest first") << ":\n";
+            for (size_t i : hits) {
+                cout << "  " << (i+1) << ": " << history.input(i) << "\n";
+            }
+            cout << "\n";
+            continue;
+        }
+        if (line[0] == '!' && line.size() > 1 && line.size() < 20 &&
+            all_of(line.begin() + 1, line.end(), [](unsigned char ch) { return isdigit(ch); })) {
+            size_t n = stoul(line.substr(1));
+            if (n == 0 || n > history.size()) {
+                cout << "⚠️  Error: No history entry " << n << "\n";
+                continue;
+            }
+            lastResult = history.result(n - 1);
+            lastImag   = 0;
+            hasResult  = true;
+            lastExact  = false;
+            cout << "  " << history.input(n - 1) << " = "
+                 << formatNumber(lastResult, format) << "\n";
+            continue;
+        }
+        if (line == "mode complex" || line == "mode real" || line == "mode integer") {
+            complexMode = line == "mode complex";
+            if (integerMode != (line == "mode integer")) hasResult = false;
+            integerMode = line == "mode integer";
+            cout << (complexMode ? "✓ Complex mode: use i for the imaginary unit, e.g. sqrt(-4) or (1+2*i)^2.\n\n"
+                     : integerMode ? "✓ Integer mode: exact whole numbers, e.g. 2^200, 30!, powmod(3, 1000, 7).\n\n"
+                                   : "✓ Real mode.\n\n");
+            continue;
+        }
+        if (line == "profile on" || line == "profile off") {
+            profiling = line == "profile on";
+            if (!profiling) cout << "✓ Profiling off.\n\n";
+            else {
+                cout << "✓ Profiling on: real results are followed by the cost of each phase.\n";
+                if (!perfCounters().available())
+                    cout << "⚠️  Note: Hardware counters unavailable (" << perfCounters().why()
+                         << "); showing time only.\n";
+                cout << "\n";
+            }
+            continue;
+        }
+        if (line == "limits" || line.rfind("limits ", 0) == 0) {
+            istringstream in(line.substr(6));
+            string which;
+            long long value = 0;
+            if (in >> which) {
+                if ((which != "length" && which != "depth") || !(in >> value) || value < 1 || !in.eof()) {
+                    cout << "⚠️  Error: Use limits length N or limits depth N (N at least 1)\n";
+                    continue;
+                }
+                (which == "length" ? parseLimits.maxLength : parseLimits.maxDepth) = value;
+            }
+            cout << "📏 Expressions up to " << parseLimits.maxLength << " characters, nested up to "
+                 << parseLimits.maxDepth << " levels.\n\n";
+            continue;
+        }
+        if (line == "format" || line.rfind("format ", 0) == 0 || line.rfind("precision ", 0) == 0) {
+            istringstream in(line);
+            string word, mode;
+            in >> word;
+            NumberFormat f = format;
+            int digits = -1;
+            if (word == "precision") in >> digits;
+            else if (in >> mode) {
+                static const map<string, NumberFormat::Mode> modes = {
+                    {"fixed", NumberFormat::Fixed}, {"shortest", NumberFormat::Shortest},
+                    {"sci", NumberFormat::Scientific}, {"eng", NumberFormat::Engineering}
+                };
+                if (!modes.count(mode)) {
+                    cout << "⚠️  Error: Formats are fixed, shortest, sci and eng\n";
+                    continue;
+                }
+                f.mode = modes.at(mode);
+                if (!(in >> digits)) digits = f.digits;
+            }
+            if (digits != -1 || word == "precision") {
+                if (digits < 0 || digits > maxFormatDigits || !in.eof()) {
+                    cout << "⚠️  Error: Precision must be a whole number from 0 to " << maxFormatDigits << "\n";
+                    continue;
+                }
+                f.digits = digits;
+            }
+            format = f;
+            cout << "✓ Results print as " << describeFormat(format) << ".\n\n";
+            continue;
+        }
+        if (line == "formulas") {
+            cout << "\n📦 Compiled formulas:\n";
+            for (size_t i = 0; formulas && i < formulas->size(); ++i) {
+                cout << "  " << formulas->name(i);
+                if (formulas->paramCount(i)) {
+                    cout << "(";
+                    for (uint32_t k = 0; k < formulas->paramCount(i); ++k)
+                        cout << (k ? ", " : "") << formulas->param(i, k);
+                    cout << ")";
+                }
+                cout << "\n";
             }
             cout << "\n";
             continue;
         }
+        if (line.rfind("table ", 0) == 0) {
+            try {
+                const Table& t = defineTable(parseFormulaLine(trim(line), 0));
+                cout << "✓ Table " << describeTable(t) << "\n\n";
+            }
+            catch (const exception &ex) {
+                cout << "⚠️  Error: " << ex.what() << "\n";
+            }
+            continue;
+        }
+        if (line == "tables") {
+            cout << "\n📋 Tables:\n";
+            for (const Table& t : tabulated()) cout << "  " << describeTable(t) << "\n";
+            cout << "\n";
+            continue;
+        }
+        if (line.rfind("dump ", 0) == 0) {
+            try {
+                vector<string> vars;
+                if (complexMode) vars.push_back("i");
+                // Names the line does not define become parameters, so that
+                // "dump 3*x^5 + 2*x" shows its Horner form
+                const string expr = line.substr(5);
+                Result<TokenList> scanned = tryTokenize(expr, vars);
+                while (scanned.error == CalcError::UnknownName &&
+                       find(vars.begin(), vars.end(), scanned.detail) == vars.end()) {
+                    vars.push_back(scanned.detail);
+                    scanned = tryTokenize(expr, vars);
+                }
+                TokenList tokens = std::move(scanned).get();
+                for (const string& r : randomVariables(tokens)) vars.push_back(r);
+                Program prog = compile(infixToPostfix(tokens), vars);
+                cout << "\n🔧 Compiled program:\n";
+                dumpProgram(prog, cout);
+                cout << "\n";
+            }
+            catch (const exception &ex) {
+                cout << "⚠️  Error: " << ex.what() << "\n";
+            }
+            continue;
+        }
 
         // Chain operations: if input starts with an operator, prepend last result
-        if (hasResult && string("+-*/^").find(line[0]) != string::npos) {
-            line = to_string(lastResult) + line;
+        if (hasResult && string("+-*/^%&|<>").find(line[0]) != string::npos) {
+            if (integerMode || lastExact) line = "(" + lastInteger + ")" + line;
+            else {
+                const NumberFormat exact{NumberFormat::Shortest};
+                string re(formatNumber(lastResult, exact));
+                if (lastImag == 0) line = re + line;
+                else line = "(" + re + (lastImag < 0 ? "-" : "+") +
+                            string(formatNumber(fabs(lastImag), exact)) + "*i)" + line;
+            }
         }
 
         // Try parsing & evaluating the expression
+        phases.clear();
         try {
-            auto tokens  = tokenize(line);
-            auto postfix = infixToPostfix(tokens);
-            double result = evalPostfix(postfix);
+            double result, imag = 0;
+            string note;
+            if (integerMode) {
+                IntegerResult r = evalInteger(line);
+                lastInteger = r.value.toString();
+                cout << (r.text.empty() ? lastInteger : r.text) << "\n";
+                history.append(line, r.value.toDouble());
+                hasResult = true;
+                continue;
+            }
+            if (callDriver(line, result, note, cout) ||
+                (formulas && callFormula(*formulas, line, result))) {
+                // whole-line calls: integrate(...), loaded formulas, ...
+            }
+            else if (complexMode) {
+                Cx z = evalComplex(line);
+                result = z.re;
+                imag   = z.im;
+            }
+            else {
+                PerfPhases* prof = profiling ? &phases : nullptr;
+                auto tokens  = measured(prof, "tokenize", [&] { return tokenize(line); });
+                uint64_t exact;
+                bool     wrap;
+                if (isIntegerExpression(tokens) &&
+                    measured(prof, "eval", [&] { return evalFixedWidth(tokens, exact, wrap); })) {
+                    // whole numbers stay exact: 2^62 + 1, 0xff & 12, 17 % 5
+                    lastInteger = wrap ? to_string(exact) : to_string((int64_t)exact);
+                    cout << formatInteger(exact, wrap) << "\n";
+                    if (prof) printPhases(phases, cout);
+                    lastResult = wrap ? (double)exact : (double)(int64_t)exact;
+                    lastImag   = 0;
+                    lastExact  = hasResult = true;
+                    history.append(line, lastResult);
+                    continue;
+                }
+                requireRealMode(tokens);
+                if (isArrayExpression(tokens)) {
+                    Matrix m = evalArray(arrayPostfix(tokens));
+                    if (!m.isScalar()) {
+                        printMatrix(m, cout, format);
+                        history.append(line, NAN);
+                        continue;
+                    }
+                    result = m.data[0];
+                }
+                else result = evalScalar(tokens, prof);
+            }
 
-            // Show the result with fixed precision
-            cout << fixed << setprecision(precision) << result << "\n";
+            // Show the result in the chosen format
+            cout << formatComplex({result, imag}, format) << "\n";
+            if (!note.empty()) cout << "⚠️  Note: " << note << "\n";
+            if (!phases.empty()) printPhases(phases, cout);
 
             // Save to history and prepare for chaining
-            history.push_back(line);
+            history.append(line, imag == 0 ? result : NAN);
             lastResult = result;
+            lastImag   = imag;
             hasResult  = true;
+            lastExact  = false;
         }
         catch (const exception &ex) {
             // Friendly error message
@@ -0,0 +1,13 @@
+// arena.cpp
+// Per-line memory (see arena.h)
+
+#include "arena.h"
+
+using namespace std;
+
+static thread_local pmr::memory_resource* currentScratch = pmr::new_delete_resource();
+
+pmr::memory_resource* scratch() { return currentScratch; }
+
+LineScope::LineScope(LineArena& a) : arena(a), previous(currentScratch) { currentScratch = &a; }
+LineScope::~LineScope() { currentScratch = previous; arena.reset(); }
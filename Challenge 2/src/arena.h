@@ -0,0 +1,79 @@
+// arena.h
+// Per-line memory
+//
+// Parsing and compiling one input line builds many short-lived containers:
+// token lists, the operator stack, the expression tree, the compiled code.
+// They take their memory from scratch(), which on the REPL thread is a
+// LineArena while a line is being handled: allocation is a pointer bump,
+// freeing does nothing, and reset() rewinds the arena between lines while
+// keeping its buffer, so once the buffer has grown to the largest line seen
+// a line needs no malloc at all.  Everywhere else (worker threads, --compile)
+// scratch() is plain new/delete.
+//
+// Not everything is covered: token texts are std::string, so a token longer
+// than the small-string buffer (15 characters with libstdc++, e.g. a 20-digit
+// literal) still allocates, as do the variable list of a line using rand()
+// and error messages.  tests/test_alloc.cpp checks that other lines stay at
+// zero.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <tuple>
+#include <vector>
+
+class LineArena : public std::pmr::memory_resource {
+public:
+    explicit LineArena(size_t bytes = 64 << 10) : buffer(bytes) {}
+
+    // Forget everything handed out; a line that overflowed the buffer makes
+    // it big enough for next time, up to maxKeptBytes (one huge line should
+    // not keep its memory for the rest of the session)
+    void reset() {
+        if (!overflow.empty()) {
+            for (auto &[p, n, align] : overflow) std::pmr::new_delete_resource()->deallocate(p, n, align);
+            const size_t want = std::min(2 * (used + overflowBytes), maxKeptBytes);
+            if (want > buffer.size()) buffer.assign(want, 0);
+            overflow.clear();
+        }
+        used = overflowBytes = 0;
+    }
+
+    // Bytes handed out since the last reset
+    size_t bytesUsed() const { return used + overflowBytes; }
+
+private:
+    static constexpr size_t maxKeptBytes = 32 << 20;
+    std::vector<char> buffer;
+    size_t            used = 0, overflowBytes = 0;
+    std::vector<std::tuple<void*, size_t, size_t>> overflow;   // blocks that did not fit
+
+    void* do_allocate(size_t n, size_t align) override {
+        size_t at = (used + align - 1) & ~(align - 1);
+        if (at + n <= buffer.size()) {
+            used = at + n;
+            return buffer.data() + at;
+        }
+        void* p = std::pmr::new_delete_resource()->allocate(n, align);
+        overflow.emplace_back(p, n, align);
+        overflowBytes += n + align;
+        return p;
+    }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// Where per-line containers on this thread get their memory
+std::pmr::memory_resource* scratch();
+
+// Route scratch() on this thread to an arena for one line, then rewind it
+struct LineScope {
+    LineArena&                  arena;
+    std::pmr::memory_resource*  previous;
+    explicit LineScope(LineArena& a);
+    ~LineScope();
+    LineScope(const LineScope&) = delete;
+    LineScope& operator=(const LineScope&) = delete;
+};
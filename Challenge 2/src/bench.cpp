@@ -0,0 +1,782 @@
+// bench.cpp
+// Benchmarks (see bench.h)
+
+#include "bench.h"
+#include "arena.h"
+#include "bigint.h"
+#include "columns.h"
+#include "complex.h"
+#include "fft.h"
+#include "fixedint.h"
+#include "format.h"
+#include "formulas.h"
+#include "matrix.h"
+#include "parser.h"
+#include "perf.h"
+#include "random.h"
+#include "sampling.h"
+#include "tables.h"
+#include "threadpool.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+// Time the postfix evaluator against the register VM on a few expressions
+void benchEvaluators() {
+    static const vector<string> cases = {
+        "1 + 2 * 3",
+        "2 * 3 + 4 * 5 - 6 * 7",
+        "sqrt(3^2 + 4^2)",
+        "2 * sin(0.5) + 3 * cos(0.25)",
+        "(1.5 * 1.5 + 2.5 * 2.5) / (3 - 0.5) ^ 2",
+        "exp(0.1) * ln(10) + log(1000) * tan(0.3) - 7 / 3",
+    };
+    using clock = chrono::steady_clock;
+    const int iters = 200000;
+    volatile double sink = 0;
+
+    cout << "\nBenchmark: postfix evaluator vs register VM (" << iters << " evals each)\n\n"
+         << "  " << left << setw(50) << "expression" << right
+         << setw(12) << "postfix ns" << setw(10) << "vm ns" << setw(10) << "speedup\n";
+    for (auto &expr : cases) {
+        auto postfix = infixToPostfix(tokenize(expr));
+        Program prog = compile(postfix);
+        auto regs = makeRegisters(prog.view());
+
+        auto t0 = clock::now();
+        for (int i = 0; i < iters; ++i) sink = sink + evalPostfix(postfix);
+        auto t1 = clock::now();
+        for (int i = 0; i < iters; ++i) sink = sink + execute(prog.view(), regs.data());
+        auto t2 = clock::now();
+
+        double pfNs = chrono::duration<double, nano>(t1 - t0).count() / iters;
+        double vmNs = chrono::duration<double, nano>(t2 - t1).count() / iters;
+        cout << "  " << left << setw(50) << expr << right << fixed << setprecision(1)
+             << setw(12) << pfNs << setw(10) << vmNs << setw(9) << pfNs / vmNs << "x\n";
+    }
+    cout << "\n";
+}
+
+// One row of the benchmark report: a phase of an expression, per run
+struct BenchRecord {
+    string     bench, expression, phase;
+    uint64_t   runs;
+    PerfCounts per;   // counts divided by runs
+};
+
+// Counts of fn() over runs calls, per call
+template<class F>
+PerfCounts perRun(uint64_t runs, F&& fn) {
+    const PerfCounts before = perfCounters().read();
+    for (uint64_t i = 0; i < runs; ++i) fn(i);
+    return (perfCounters().read() - before) / (double)runs;
+}
+
+// Hardware counters of each phase: parsing and compiling once, then the
+// scalar VM and the 64-lane batch kernels on the same random x in [0, 1),
+// so the branch misses of if() show against the branchless batch select
+void benchCounters(vector<BenchRecord>& log) {
+    static const vector<string> cases = {
+        "1 + 2 * x",
+        "sqrt(x^2 + 4^2)",
+        "2 * sin(x) + 3 * cos(0.25 * x)",
+        "exp(x) * ln(10) + log(1000) * tan(x) - 7 / 3",
+        "if(x < 0.5, sqrt(x), x^2 - 1)",
+    };
+    const vector<string> vars = {"x"};
+    const size_t n = 1 << 16;
+    vector<double> xs(n), out(n);
+    fillRandom(xs.data(), n, 0, 0, false, 42);
+    const double* cols[1] = {xs.data()};
+    volatile double sink = 0;
+
+    cout << "Benchmark: hardware counters per phase (per run; batch per row)\n";
+    if (!perfCounters().available())
+        cout << "  counters unavailable, " << perfCounters().why() << "; timing only\n";
+    for (auto &expr : cases) {
+        PerfPhases p;
+        auto tokens  = tokenize(expr, vars);
+        auto postfix = infixToPostfix(tokens);
+        Program prog = compile(postfix, vars);
+        auto regs = makeRegisters(prog.view());
+        BatchMachine m(prog.view());
+        auto note = [&](const char* phase, uint64_t runs, const PerfCounts& c) {
+            p.phases.push_back({phase, c});
+            log.push_back({"counters", expr, phase, runs, c});
+        };
+
+        note("tokenize", 20000, perRun(20000, [&](uint64_t) { sink = sink + tokenize(expr, vars).size(); }));
+        note("postfix", 20000, perRun(20000, [&](uint64_t) { sink = sink + infixToPostfix(tokens).size(); }));
+        note("compile", 5000, perRun(5000, [&](uint64_t) { sink = sink + compile(postfix, vars).code.size(); }));
+        note("vm", 1 << 20, perRun(1 << 20, [&](uint64_t i) {
+            regs[0] = xs[i & (n - 1)];
+            sink = sink + execute(prog.view(), regs.data());
+        }));
+        const uint64_t reps = 16;
+        PerfCounts batch = perRun(reps, [&](uint64_t) { executeBatch(m, cols, n, out.data()); }) / (double)n;
+        note("batch", reps * n, batch);
+
+        cout << "\n  " << expr << "\n";
+        printPhases(p, cout);
+    }
+    cout << "\n";
+}
+
+// The records as JSON, with null for counters that were not read
+void writeBenchJson(const string& path, const vector<BenchRecord>& log) {
+    ofstream os(path);
+    if (!os) throw runtime_error("Cannot write " + path);
+    auto str = [&](const string& s) {
+        os << '"';
+        for (char c : s) os << (c == '"' || c == '\\' ? "\\" : "") << c;
+        os << '"';
+    };
+    auto num = [&](double v) {
+        if (isnan(v)) os << "null";
+        else os << v;
+    };
+    os << setprecision(6) << "{\n  \"counters\": ";
+    str(perfCounters().available() ? "available" : perfCounters().why());
+    os << ",\n  \"results\": [";
+    for (size_t i = 0; i < log.size(); ++i) {
+        const BenchRecord& r = log[i];
+        os << (i ? ",\n" : "\n") << "    {\"bench\": ";
+        str(r.bench);
+        os << ", \"expression\": ";
+        str(r.expression);
+        os << ", \"phase\": ";
+        str(r.phase);
+        os << ", \"runs\": " << r.runs << ", \"ns\": ";
+        num(r.per.ns);
+        for (int k = 0; k < PERF_EVENTS; ++k) {
+            string key = perfEventNames[k];
+            replace(key.begin(), key.end(), '-', '_');
+            os << ", \"" << key << "\": ";
+            num(r.per.v[k]);
+        }
+        os << ", \"ipc\": ";
+        num(r.per.ipc());
+        os << "}";
+    }
+    os << "\n  ]\n}\n";
+    if (!os.flush()) throw runtime_error("Cannot write " + path);
+}
+
+// Generated formulas that repeat subterms: the same batch with every copy
+// evaluated, and with each repeated subexpression computed once
+void benchSharing() {
+    static const vector<string> cases = {
+        "sqrt(x^2+y^2) * sin(sqrt(x^2+y^2)) + cos(sqrt(x^2+y^2)) / sqrt(x^2+y^2)",
+        "exp(-(x-y)^2) * (x-y) + exp(-(x-y)^2) * (x+y) - exp(-(x-y)^2)",
+        "(x*y + 1) / (x*y - 1) + (x*y + 1) * (x*y - 1) + sin(x*y)",
+        "x*y + y*x + sin(x)*sin(x) + cos(y)*cos(y)",
+    };
+    using clock = chrono::steady_clock;
+    const size_t n = 1 << 18;
+    const vector<string> vars = {"x", "y"};
+    vector<double> xs(n), ys(n), out(n);
+    for (size_t k = 0; k < n; ++k) { xs[k] = 0.001 * k; ys[k] = 1.0 - 0.002 * k; }
+    const double* cols[2] = {xs.data(), ys.data()};
+
+    cout << "Benchmark: repeated subexpressions, batch of " << n << " rows\n\n"
+         << "  " << left << setw(74) << "expression" << right
+         << setw(12) << "instr" << setw(18) << "ns/row" << setw(10) << "speedup\n";
+    for (auto &expr : cases) {
+        auto postfix = infixToPostfix(tokenize(expr, vars));
+        Program all = compile(postfix, vars, false), once = compile(postfix, vars);
+        double ns[2];
+        for (int v = 0; v < 2; ++v) {
+            BatchMachine m((v ? once : all).view());
+            auto t0 = clock::now();
+            executeBatch(m, cols, n, out.data());
+            ns[v] = chrono::duration<double, nano>(clock::now() - t0).count() / n;
+        }
+        cout << "  " << left << setw(74) << expr << right << setw(6) << all.code.size() << " -> "
+             << setw(2) << once.code.size() << fixed << setprecision(2)
+             << setw(9) << ns[0] << " -> " << setw(5) << ns[1] << setw(9) << ns[0] / ns[1] << "x\n";
+    }
+    cout << "\n";
+}
+
+// Several formulas over the same rows: one program each, run one after
+// another, against one compileAll program filling every column in a pass
+void benchColumns() {
+    static const vector<string> formulas = {
+        "(ln(s/k) + (r + v^2/2)*t) / (v*sqrt(t))",
+        "(ln(s/k) + (r + v^2/2)*t) / (v*sqrt(t)) - v*sqrt(t)",
+        "exp(-r*t)",
+        "k*exp(-r*t)",
+        "exp(-((ln(s/k) + (r + v^2/2)*t) / (v*sqrt(t)))^2/2) / (s*v*sqrt(t))",
+        "s*sqrt(t)*exp(-((ln(s/k) + (r + v^2/2)*t) / (v*sqrt(t)))^2/2)",
+    };
+    using clock = chrono::steady_clock;
+    const size_t n = 1 << 18, nf = formulas.size();
+    const vector<string> vars = {"s", "k", "r", "t", "v"};
+    vector<vector<double>> in(vars.size(), vector<double>(n)), out(nf, vector<double>(n));
+    for (size_t i = 0; i < n; ++i) {
+        in[0][i] = 50 + 100.0 * i / n;
+        in[1][i] = 100;
+        in[2][i] = 0.01 + 0.05 * (i % 7) / 7;
+        in[3][i] = 0.25 + (i % 13) * 0.2;
+        in[4][i] = 0.1 + (i % 11) * 0.03;
+    }
+    const double* cols[5];
+    for (size_t v = 0; v < vars.size(); ++v) cols[v] = in[v].data();
+    vector<double*> outs;
+    for (auto &o : out) outs.push_back(o.data());
+
+    vector<TokenList> pfs;
+    vector<const TokenList*> ptrs;
+    pfs.reserve(nf);
+    for (auto &f : formulas) {
+        pfs.push_back(infixToPostfix(tokenize(f, vars)));
+        ptrs.push_back(&pfs.back());
+    }
+    vector<Program> separate;
+    size_t separateInstr = 0;
+    for (auto &pf : pfs) {
+        separate.push_back(compile(pf, vars));
+        separateInstr += separate.back().code.size() - 1;
+    }
+    const Program fused = compileAll(ptrs.data(), nf, vars);
+
+    auto t0 = clock::now();
+    for (size_t k = 0; k < nf; ++k) {
+        BatchMachine m(separate[k].view());
+        executeBatch(m, cols, n, outs[k]);
+    }
+    const double nsSeparate = chrono::duration<double, nano>(clock::now() - t0).count() / n;
+    vector<double> check(out[nf - 1]);
+
+    t0 = clock::now();
+    BatchMachine m(fused.view());
+    const BatchColumns more{fused.outputs.data() + 1, outs.data() + 1, nf - 1};
+    executeBatch(m, cols, n, outs[0], nullptr, &more);
+    const double nsFused = chrono::duration<double, nano>(clock::now() - t0).count() / n;
+
+    cout << "Benchmark: " << nf << " pricing formulas over " << n << " rows\n\n"
+         << "  " << left << setw(34) << "" << right << setw(8) << "instr" << setw(10) << "ns/row\n"
+         << "  " << left << setw(34) << "one program per formula" << right
+         << setw(8) << separateInstr << fixed << setprecision(2) << setw(10) << nsSeparate << "\n"
+         << "  " << left << setw(34) << "compileAll, one pass" << right
+         << setw(8) << fused.code.size() - 1 << setw(10) << nsFused << "\n"
+         << "  speedup " << nsSeparate / nsFused << "x, last column "
+         << (check == out[nf - 1] ? "identical" : "DIFFERS") << "\n\n";
+}
+
+// if() on data whose sign is random or sorted: the scalar VM branches per
+// row and pays for mispredictions, the batch VM runs both arms of a mixed
+// block without branching and skips an arm that no lane in the block needs
+void benchBranches() {
+    using clock = chrono::steady_clock;
+    const string expr = "if(x > 0, sqrt(x) * 2 + 1, exp(x) - x*x)";
+    const vector<string> vars = {"x"};
+    const size_t n = 1 << 18;
+    Program prog = compile(infixToPostfix(tokenize(expr, vars)), vars);
+    vector<double> random(n), sorted, out(n);
+    uint64_t s = 88172645463325252ULL;
+    for (auto &v : random) {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        v = (double)(s >> 11) / 9007199254740992.0 * 2 - 1;
+    }
+    sorted = random;
+    sort(sorted.begin(), sorted.end());
+
+    cout << "Benchmark: " << expr << ", " << n << " rows\n\n"
+         << "  " << left << setw(12) << "signs" << right << setw(14) << "scalar ns/row"
+         << setw(14) << "batch ns/row" << "\n";
+    for (int k = 0; k < 2; ++k) {
+        const vector<double>& xs = k ? sorted : random;
+        auto regs = makeRegisters(prog.view());
+        CalcError err = CalcError::None;
+        double sink = 0;
+        auto t0 = clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            regs[0] = xs[i];
+            sink += execute(prog.view(), regs.data(), err);
+        }
+        const double scalar = chrono::duration<double, nano>(clock::now() - t0).count() / n;
+        BatchMachine m(prog.view());
+        const double* cols[1] = {xs.data()};
+        t0 = clock::now();
+        executeBatch(m, cols, n, out.data());
+        const double batch = chrono::duration<double, nano>(clock::now() - t0).count() / n;
+        cout << "  " << left << setw(12) << (k ? "sorted" : "random") << right << fixed << setprecision(2)
+             << setw(14) << scalar << setw(14) << batch << (sink == 42 ? " " : "") << "\n";
+    }
+    cout << "\n";
+}
+
+// A premium over integer ages and four rates: plain batch, memoized pow and
+// exp, and the survival curve as a table instead of exp
+void benchMemo() {
+    using clock = chrono::steady_clock;
+    const vector<string> vars = {"age", "rate"};
+    const size_t n = 1 << 20;
+    vector<double> age(n), rate(n), out(n);
+    uint64_t s = 88172645463325252ULL;
+    for (size_t i = 0; i < n; ++i) {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        age[i]  = 18 + s % 82;
+        rate[i] = 0.01 + 0.005 * (s >> 32 & 3);
+    }
+    FormulaLine decl = parseFormulaLine("table survival(a) = exp(-(a/86)^7), 0 : 130 : 0.25", 0);
+    defineTable(decl);
+    struct Case { const char* label; string expr; uint32_t memo; };
+    const vector<Case> cases = {
+        {"plain",          "1000 * (1 + rate)^(-age) * exp(-(age/86)^7)", 0},
+        {"memo 4096",      "1000 * (1 + rate)^(-age) * exp(-(age/86)^7)", 4096},
+        {"memo + table",   "1000 * (1 + rate)^(-age) * survival(age)", 4096},
+    };
+    cout << "Benchmark: " << cases[0].expr << ", " << n << " rows of 82 ages x 4 rates\n\n"
+         << "  " << left << setw(16) << "" << right << setw(10) << "ns/row" << "   cache\n";
+    const double* cols[2] = {age.data(), rate.data()};
+    for (const Case& c : cases) {
+        Program prog = compile(infixToPostfix(tokenize(c.expr, vars)), vars, true, c.memo);
+        BatchMachine m(prog.view());
+        auto t0 = clock::now();
+        executeBatch(m, cols, n, out.data());
+        const double ns = chrono::duration<double, nano>(clock::now() - t0).count() / n;
+        cout << "  " << left << setw(16) << c.label << right << fixed << setprecision(2) << setw(10) << ns;
+        if (prog.memoOps.empty()) cout << "   -\n";
+        else {
+            MemoStats st;
+            st.add(m.prog, m.memo.data());
+            double hits = 0, calls = 0;
+            for (size_t k = 0; k < st.ops.size(); ++k) { hits += st.hits[k]; calls += st.calls[k]; }
+            cout << "   " << setprecision(1) << 100 * hits / calls << "% hits, "
+                 << memoStateSize(m.prog) * sizeof(double) / 1024 << " KB\n";
+        }
+    }
+    tabulated().erase(tabulated().begin() + findTable("survival"));
+    cout << "\n";
+}
+
+// matmul throughput against a plain triple loop
+void benchMatmul() {
+    using clock = chrono::steady_clock;
+    cout << "Benchmark: matmul (" << threadPool().size() << " thread(s))\n\n"
+         << "  " << setw(6) << "n" << setw(14) << "naive GF/s" << setw(14) << "blocked GF/s" << "\n";
+    for (size_t n : {128, 256, 512, 1024}) {
+        Matrix A(n, n), B(n, n);
+        for (size_t i = 0; i < n * n; ++i) {
+            A.data[i] = sin((double)i);
+            B.data[i] = cos((double)i);
+        }
+        const double flops = 2.0 * n * n * n;
+
+        double naive = NAN;
+        if (n <= 512) {
+            Matrix C(n, n);
+            auto t0 = clock::now();
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = 0; j < n; ++j) {
+                    double s = 0;
+                    for (size_t k = 0; k < n; ++k) s += A.at(i, k) * B.at(k, j);
+                    C.at(i, j) = s;
+                }
+            naive = flops / chrono::duration<double, nano>(clock::now() - t0).count();
+        }
+        auto t0 = clock::now();
+        Matrix C = matmul(A, B);
+        double blocked = flops / chrono::duration<double, nano>(clock::now() - t0).count();
+
+        cout << "  " << setw(6) << n << fixed << setprecision(2);
+        if (isnan(naive)) cout << setw(14) << "-";
+        else              cout << setw(14) << naive;
+        cout << setw(14) << blocked << "\n";
+    }
+    cout << "\n";
+}
+
+// Complex batch (SoA rows) against the same program one element at a time
+void benchComplex() {
+    using clock = chrono::steady_clock;
+    const size_t n = 1 << 18;
+    const string expr = "(x*x + i) * (x - 2*i) / (x + i) + exp(i*x)";
+    Program prog = compile(infixToPostfix(tokenize(expr, {"i", "x"})), {"i", "x"});
+    vector<double> ire(n, 0), iim(n, 1), xre(n), xim(n, 0), ore(n), oim(n);
+    for (size_t k = 0; k < n; ++k) xre[k] = 0.001 * k;
+    const double* re[2] = {ire.data(), xre.data()};
+    const double* im[2] = {iim.data(), xim.data()};
+    ComplexMachine m(prog.view());
+
+    auto t0 = clock::now();
+    for (size_t k = 0; k < n; ++k) {
+        const double* r1[2] = {re[0] + k, re[1] + k};
+        const double* i1[2] = {im[0] + k, im[1] + k};
+        executeComplexBatch(m, r1, i1, 1, &ore[k], &oim[k]);
+    }
+    auto t1 = clock::now();
+    executeComplexBatch(m, re, im, n, ore.data(), oim.data());
+    auto t2 = clock::now();
+
+    cout << "Benchmark: complex mode, " << expr << "\n\n" << fixed << setprecision(1)
+         << "  per element  " << setw(8) << chrono::duration<double, nano>(t1 - t0).count() / n << " ns/value\n"
+         << "  SoA batch    " << setw(8) << chrono::duration<double, nano>(t2 - t1).count() / n << " ns/value\n\n";
+}
+
+// FFT throughput over power-of-two and mixed-radix sizes
+void benchFft() {
+    using clock = chrono::steady_clock;
+    cout << "Benchmark: FFT (" << threadPool().size() << " threads)\n\n"
+         << "       n    ns/transform   GFLOP/s (5 n log2 n)\n" << fixed;
+    vector<size_t> sizes;
+    for (size_t n = 1 << 10; n <= (1 << 24); n <<= 2) sizes.push_back(n);
+    sizes.push_back(3 * 5 * 7 * 1024);
+    sizes.push_back(1009 * 64);   // prime factor: Bluestein
+    for (size_t n : sizes) {
+        vector<double> re(n), im(n, 0.0), scratch;
+        for (size_t k = 0; k < n; ++k) re[k] = sin(0.001 * k);
+        const FftPlan& plan = fftPlan(n);
+        fftForward(plan, re.data(), im.data(), scratch);   // warm up
+        size_t reps = max<size_t>(1, (1 << 24) / n);
+        auto t0 = clock::now();
+        for (size_t r = 0; r < reps; ++r) fftForward(plan, re.data(), im.data(), scratch);
+        double ns = chrono::duration<double, nano>(clock::now() - t0).count() / reps;
+        cout << setw(8) << n << setprecision(0) << setw(16) << ns
+             << setprecision(2) << setw(10) << 5.0 * n * log2((double)n) / ns << "\n";
+    }
+    cout << "\n";
+}
+
+// Monte Carlo throughput (random fill + batch VM), one thread against the pool
+void benchMonteCarlo() {
+    using clock = chrono::steady_clock;
+    const string expr = "sqrt(1 - rand()^2) * 4 + 0 * randn()";
+    auto tokens = tokenize(expr);
+    vector<string> names = randomVariables(tokens);
+    Program body = compile(infixToPostfix(tokens), names);
+    const uint64_t n = 1 << 22;
+
+    auto t0 = clock::now();
+    Moments one;
+    {
+        BatchMachine m(body.view());
+        vector<double> u(4096), z(4096), out(4096);
+        const double* cols[2] = {u.data(), z.data()};
+        for (uint64_t first = 0; first < n; first += 4096) {
+            fillRandom(u.data(), 4096, first, 0, false, 1);
+            fillRandom(z.data(), 4096, first, 1, true, 1);
+            executeBatch(m, cols, 4096, out.data());
+            for (double v : out) one.add(v);
+        }
+    }
+    auto t1 = clock::now();
+    Moments all = monteCarlo(body.view(), names, n, 1);
+    auto t2 = clock::now();
+
+    cout << "Benchmark: mc(" << expr << ", " << n << ")\n\n" << fixed << setprecision(1)
+         << "  1 thread    " << setw(8) << n / chrono::duration<double, micro>(t1 - t0).count() << " M samples/s\n"
+         << "  " << threadPool().size() << " thread(s) " << setw(8)
+         << n / chrono::duration<double, micro>(t2 - t1).count() << " M samples/s"
+         << "   (mean " << setprecision(6) << all.mean << ", same as " << one.mean << ")\n\n";
+}
+
+// A typed polynomial: postfix evaluator, Horner-compiled VM, batch VM, poly()
+void benchPoly() {
+    using clock = chrono::steady_clock;
+    const string expr = "3*x^5 + 2*x^4 - x^2 + 7";
+    const size_t n = 1 << 18;
+    vector<double> xs(n), out(n);
+    for (size_t k = 0; k < n; ++k) xs[k] = 0.000001 * k;
+    auto pf = infixToPostfix(tokenize(expr, {"x"}));
+    Program prog = compile(pf, {"x"});
+    auto perValue = [&](clock::time_point t0, clock::time_point t1, size_t count) {
+        return chrono::duration<double, nano>(t1 - t0).count() / count;
+    };
+
+    auto t0 = clock::now();
+    volatile double sink = 0;
+    for (size_t k = 0; k < n; k += 64) {   // the postfix path re-tokenizes with x substituted
+        string s = expr;
+        for (size_t pos; (pos = s.find('x')) != string::npos; ) s.replace(pos, 1, "(" + to_string(xs[k]) + ")");
+        sink = sink + evalPostfix(infixToPostfix(tokenize(s)));
+    }
+    auto t1 = clock::now();
+    auto regs = makeRegisters(prog.view());
+    for (size_t k = 0; k < n; ++k) {
+        regs[0] = xs[k];
+        out[k] = execute(prog.view(), regs.data());
+    }
+    auto t2 = clock::now();
+    BatchMachine m(prog.view());
+    const double* cols[1] = {xs.data()};
+    executeBatch(m, cols, n, out.data());
+    auto t3 = clock::now();
+    polyBulk({3, 2, 0, -1, 0, 7}, xs.data(), out.data(), n);
+    auto t4 = clock::now();
+
+    cout << "Benchmark: " << expr << " (" << prog.code.size() - 1 << " VM instructions)\n\n"
+         << fixed << setprecision(1)
+         << "  parse + postfix  " << setw(8) << perValue(t0, t1, n / 64) << " ns/value\n"
+         << "  VM (Horner)      " << setw(8) << perValue(t1, t2, n) << " ns/value\n"
+         << "  batch VM         " << setw(8) << perValue(t2, t3, n) << " ns/value\n"
+         << "  poly() bulk      " << setw(8) << perValue(t3, t4, n) << " ns/value\n\n";
+}
+
+void benchIntegers() {
+    using clock = chrono::steady_clock;
+    const size_t n = 1 << 20;
+    vector<uint64_t> xs(n), out(n);
+    vector<double> xd(n), outd(n);
+    for (size_t k = 0; k < n; ++k) xd[k] = (double)(xs[k] = k);
+    const uint64_t* cols[1] = {xs.data()};
+    const double* dcols[1] = {xd.data()};
+    auto perValue = [&](clock::time_point t0, clock::time_point t1) {
+        return chrono::duration<double, nano>(t1 - t0).count() / n;
+    };
+
+    cout << "Benchmark: 64-bit integer batch vs double batch, " << n << " values\n\n" << fixed << setprecision(2);
+    for (string expr : {"x*x + 3*x - 7", "(x * 2654435761) xor (x >> 13) & 0xffff"}) {
+        IntProgram iprog = compileInteger(infixToPostfix(tokenize(expr, {"x"}), true), {"x"});
+        auto t0 = clock::now();
+        bool exact = executeIntegerBatch(iprog, cols, n, out.data());
+        auto t1 = clock::now();
+        cout << "  " << left << setw(42) << expr << right << (iprog.wrap ? " u64 " : " i64 ")
+             << setw(6) << perValue(t0, t1) << " ns/value" << (exact ? "" : " (inexact)");
+        if (!iprog.wrap) {
+            Program prog = compile(infixToPostfix(tokenize(expr, {"x"})), {"x"});
+            BatchMachine m(prog.view());
+            auto t2 = clock::now();
+            executeBatch(m, dcols, n, outd.data());
+            auto t3 = clock::now();
+            cout << "   double " << setw(6) << perValue(t2, t3) << " ns/value";
+        }
+        cout << "\n";
+    }
+    cout << "\n";
+}
+
+// Rows where half the inputs divide by zero: exceptions against error codes
+void benchErrors() {
+    using clock = chrono::steady_clock;
+    const size_t rows = 1 << 16;
+    auto perRow = [&](clock::time_point t0, clock::time_point t1) {
+        return chrono::duration<double, nano>(t1 - t0).count() / rows;
+    };
+    const TokenList good = infixToPostfix(tokenize("1/(2-1)")), bad = infixToPostfix(tokenize("1/(1-1)"));
+    Program prog = compile(infixToPostfix(tokenize("1/(x-1)", {"x"})), {"x"});
+    vector<double> xs(rows), out(rows);
+    auto regs = makeRegisters(prog.view());
+    for (size_t k = 0; k < rows; ++k) xs[k] = k & 1;
+    size_t failed[5] = {0, 0, 0, 0, 0};
+
+    auto t0 = clock::now();
+    for (size_t k = 0; k < rows; ++k) {
+        try { evalPostfix(k & 1 ? good : bad); }
+        catch (const exception&) { ++failed[0]; }
+    }
+    auto t1 = clock::now();
+    for (size_t k = 0; k < rows; ++k) failed[1] += !tryEvalPostfix(k & 1 ? good : bad).ok();
+    auto t2 = clock::now();
+    for (size_t k = 0; k < rows; ++k) {
+        regs[0] = xs[k];
+        CalcError err = CalcError::None;
+        execute(prog.view(), regs.data(), err);
+        failed[2] += err != CalcError::None;
+    }
+    auto t3 = clock::now();
+    BatchMachine m(prog.view());
+    const double* cols[1] = {xs.data()};
+    vector<uint64_t> mask(rows / batchLanes);
+    executeBatch(m, cols, rows, out.data(), mask.data());
+    for (uint64_t w : mask) failed[3] += __builtin_popcountll(w);
+    auto t4 = clock::now();
+    IntProgram iprog = compileInteger(infixToPostfix(tokenize("12/(x-1)", {"x"}), true), {"x"});
+    vector<uint64_t> xi(rows), outi(rows);
+    for (size_t k = 0; k < rows; ++k) xi[k] = k & 1;
+    const uint64_t* icols[1] = {xi.data()};
+    executeIntegerBatch(iprog, icols, rows, outi.data(), mask.data());
+    for (uint64_t w : mask) failed[4] += __builtin_popcountll(w);
+    auto t5 = clock::now();
+
+    cout << "Benchmark: " << rows << " rows, half dividing by zero\n\n" << fixed << setprecision(1)
+         << "  postfix, throw/catch   " << setw(8) << perRow(t0, t1) << " ns/row   (" << failed[0] << " failed)\n"
+         << "  postfix, error codes   " << setw(8) << perRow(t1, t2) << " ns/row   (" << failed[1] << " failed)\n"
+         << "  VM, error codes        " << setw(8) << perRow(t2, t3) << " ns/row   (" << failed[2] << " failed)\n"
+         << "  batch VM, error mask   " << setw(8) << perRow(t3, t4) << " ns/row   (" << failed[3] << " failed)\n"
+         << "  i64 batch, error mask  " << setw(8) << perRow(t4, t5) << " ns/row   (" << failed[4] << " failed)\n\n";
+}
+
+// Scanning a 512 KB machine-generated expression: classification alone
+// (scalar table against the SIMD path this build uses) and the whole tokenizer
+void benchTokenizer() {
+    using clock = chrono::steady_clock;
+    string expr;
+    for (int k = 0; expr.size() < (512 << 10); ++k)
+        expr += (k ? " + " : "") + to_string(k % 997) + ".125e-3 * sin(x) * coefficient - 42.5 / (x + " +
+                to_string(k) + ")";
+    const vector<string> vars = {"x", "coefficient"};
+    auto gbps = [&](clock::time_point t0, clock::time_point t1, int reps) {
+        return expr.size() * (double)reps / chrono::duration<double, nano>(t1 - t0).count();
+    };
+    const size_t blocks = expr.size() / 64;
+    const int reps = 200;
+    uint64_t sink = 0;
+
+    cout << "Benchmark: tokenizing a " << expr.size() / 1024 << " KB expression\n\n" << fixed << setprecision(2);
+    auto t0 = clock::now();
+    for (int r = 0; r < reps; ++r)
+        for (size_t b = 0; b < blocks; ++b) sink += classifyBlockScalar(expr.data() + 64 * b).digit;
+    auto t1 = clock::now();
+    for (int r = 0; r < reps; ++r)
+        for (size_t b = 0; b < blocks; ++b) sink += classifyBlock(expr.data() + 64 * b).digit;
+    auto t2 = clock::now();
+    LineArena arena;
+    size_t count = 0;
+    auto t3 = clock::now();
+    for (int r = 0; r < 10; ++r) {
+        LineScope scope(arena);
+        count = tokenize(expr, vars).size();
+    }
+    auto t4 = clock::now();
+#if defined(__AVX2__)
+    const char* simd = "AVX2";
+#elif defined(__SSE2__)
+    const char* simd = "SSE2";
+#else
+    const char* simd = "scalar";
+#endif
+    // Tokens are the output: each is a Token with its own std::string, several
+    // times the bytes of input it stands for, so tokenizing cannot run at the
+    // classifier's rate
+    const double perToken = chrono::duration<double, nano>(t4 - t3).count() / 10 / count;
+    cout << "  classify, scalar table    " << setw(7) << gbps(t0, t1, reps) << " GB/s\n"
+         << "  classify, " << left << setw(15) << simd << right << setw(7) << gbps(t1, t2, reps) << " GB/s"
+         << (string(simd) == "AVX2" ? "" : "   (AVX2 needs -march=native or -mavx2)") << "\n"
+         << "  tokenize                  " << setw(7) << gbps(t3, t4, 10) << " GB/s   ("
+         << count << " tokens of " << sizeof(Token) << " bytes, " << setprecision(1) << perToken
+         << " ns each" << (sink ? ")" : ") ") << setprecision(2) << "\n\n";
+}
+
+// Extreme nesting: time per input byte should not grow with depth, and the
+// line arena's high-water mark shows the memory per byte
+void benchNesting() {
+    using clock = chrono::steady_clock;
+    const vector<string> vars = {"x"};
+    const size_t depths[] = {1000, 10000, 100000, 1000000};
+    LineArena arena;
+    cout << "Benchmark: nesting depth, whole pipeline (tokenize to run), ns per input byte\n\n"
+         << "  " << left << setw(14) << "shape" << right;
+    for (size_t d : depths) cout << setw(9) << d;
+    cout << setw(14) << "arena/byte\n" << fixed << setprecision(1);
+    for (auto [open, mid, close] : {tuple<string,string,string>{"(", "x", ")"}, {"1+(", "x", ")"},
+                                    {"sin(", "x", ")"}, {"2^", "x", ""}, {"-", "x", ""}}) {
+        cout << "  " << left << setw(14) << open + "..." + mid + close << right;
+        double perByte = 0;
+        for (size_t d : depths) {
+            string expr;
+            expr.reserve(d * (open.size() + close.size()) + mid.size());
+            for (size_t k = 0; k < d; ++k) expr += open;
+            expr += mid;
+            for (size_t k = 0; k < d; ++k) expr += close;
+            LineScope scope(arena);
+            auto t0 = clock::now();
+            Program prog = compile(infixToPostfix(tokenize(expr, vars)), vars);
+            auto regs = makeRegisters(prog.view());
+            regs[0] = 0.5;
+            volatile double sink = execute(prog.view(), regs.data());
+            (void)sink;
+            auto t1 = clock::now();
+            cout << setw(9) << chrono::duration<double, nano>(t1 - t0).count() / expr.size();
+            perByte = (double)arena.bytesUsed() / expr.size();
+        }
+        cout << setw(12) << perByte << " B\n";
+    }
+    cout << "\n";
+}
+
+// Formatting a million results: ostream manipulators against formatNumber
+void benchFormat() {
+    using clock = chrono::steady_clock;
+    const size_t n = 1 << 20;
+    vector<double> xs(n);
+    uint64_t state = 42;
+    for (double& x : xs) {   // mixed signs and magnitudes from 1e-9 to 1e9
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        x = ldexp((double)(int64_t)state, (int)(state >> 58) - 93);
+    }
+    auto perValue = [&](clock::time_point t0, clock::time_point t1) {
+        return chrono::duration<double, nano>(t1 - t0).count() / n;
+    };
+
+    cout << "Benchmark: formatting " << n << " results\n\n" << fixed << setprecision(1);
+    size_t bytes = 0;
+    ostringstream os;
+    auto t0 = clock::now();
+    for (double x : xs) {
+        os.str("");
+        os << fixed << setprecision(6) << x;
+        bytes += os.str().size();
+    }
+    auto t1 = clock::now();
+    cout << "  ostringstream fixed 6  " << setw(7) << perValue(t0, t1) << " ns/value\n";
+    for (NumberFormat f : {NumberFormat{NumberFormat::Fixed, 6}, NumberFormat{NumberFormat::Shortest},
+                           NumberFormat{NumberFormat::Scientific, 6}, NumberFormat{NumberFormat::Engineering, 6}}) {
+        char buf[numberBufferSize];
+        auto t2 = clock::now();
+        for (double x : xs) bytes += formatNumber(buf, x, f) - buf;
+        auto t3 = clock::now();
+        cout << "  formatNumber " << left << setw(10) << describeFormat(f) << right
+             << setw(7) << perValue(t2, t3) << " ns/value\n";
+    }
+    cout << "  (" << bytes << " bytes)\n\n";
+}
+
+// Adaptive sampling against the uniform grid that would resolve the same detail
+void benchSample() {
+    using clock = chrono::steady_clock;
+    cout << "Benchmark: sample() vs uniform grid at the finest spacing used\n\n"
+         << "  " << left << setw(24) << "expression" << right << setw(10) << "points"
+         << setw(14) << "uniform" << setw(10) << "ms\n";
+    for (auto [expr, a, b] : {tuple<string,double,double>{"sin(1/x)", 0.01, 1},
+                              {"1/(x-0.3)", 0, 1}, {"exp(-x^2)*cos(20*x)", -3, 3}}) {
+        Program f = compile(infixToPostfix(tokenize(expr, {"x"})), {"x"});
+        auto t0 = clock::now();
+        SampleResult r = sampleAdaptive(f.view(), a, b, 1e-4);
+        auto t1 = clock::now();
+        double finest = b - a;
+        for (size_t k = 1; k < r.points.size(); ++k) finest = min(finest, r.points[k].x - r.points[k-1].x);
+        cout << "  " << left << setw(24) << expr << right << setw(10) << r.points.size()
+             << setw(14) << scientific << setprecision(2) << (b - a) / finest
+             << setw(9) << fixed << setprecision(2)
+             << chrono::duration<double, milli>(t1 - t0).count() << "\n";
+    }
+    cout << "\n";
+}
+
+void runBenchmarks(const string& jsonPath) {
+    vector<BenchRecord> log;
+    benchEvaluators();
+    benchCounters(log);
+    benchTokenizer();
+    benchNesting();
+    benchSharing();
+    benchColumns();
+    benchBranches();
+    benchMemo();
+    benchPoly();
+    benchIntegers();
+    benchMatmul();
+    benchComplex();
+    benchFft();
+    benchMonteCarlo();
+    benchSample();
+    benchFormat();
+    benchErrors();
+    if (!jsonPath.empty()) {
+        writeBenchJson(jsonPath, log);
+        cout << "✓ Wrote " << log.size() << " results to " << jsonPath << "\n";
+    }
+}
@@ -0,0 +1,10 @@
+// bench.h
+// Benchmarks (calculator --bench)
+
+#pragma once
+
+#include <string>
+
+// Every benchmark; with jsonPath, the counters benchmark is also written
+// there as JSON
+void runBenchmarks(const std::string& jsonPath = "");
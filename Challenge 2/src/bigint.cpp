@@ -0,0 +1,808 @@
+// bigint.cpp
+// Integer mode (see bigint.h)
+
+#include "bigint.h"
+#include "fixedint.h"
+#include "matrix.h"
+#include "parser.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+static void trimLimbs(Limbs& a) {
+    while (!a.empty() && a.back() == 0) a.pop_back();
+}
+
+static int compareLimbs(const Limbs& a, const Limbs& b) {
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0; )
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+static Limbs addLimbs(const Limbs& a, const Limbs& b) {
+    const Limbs& x = a.size() >= b.size() ? a : b;
+    const Limbs& y = a.size() >= b.size() ? b : a;
+    Limbs r(x.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+        carry += (uint64_t)x[i] + (i < y.size() ? y[i] : 0);
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    r[x.size()] = (uint32_t)carry;
+    trimLimbs(r);
+    return r;
+}
+
+// a - b for a >= b
+static Limbs subLimbs(const Limbs& a, const Limbs& b) {
+    Limbs r(a.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        int64_t d = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = d < 0;
+        r[i] = (uint32_t)d;
+    }
+    trimLimbs(r);
+    return r;
+}
+
+// r[offset...] += x
+static void addShifted(Limbs& r, const Limbs& x, size_t offset) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < x.size() || carry; ++i) {
+        carry += (uint64_t)r[offset + i] + (i < x.size() ? x[i] : 0);
+        r[offset + i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+static const size_t karatsubaCutoff = 40;   // limbs
+
+static Limbs mulLimbs(const Limbs& a, const Limbs& b) {
+    if (a.empty() || b.empty()) return {};
+    if (min(a.size(), b.size()) < karatsubaCutoff) {
+        Limbs r(a.size() + b.size(), 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < b.size(); ++j) {
+                carry += (uint64_t)a[i] * b[j] + r[i + j];
+                r[i + j] = (uint32_t)carry;
+                carry >>= 32;
+            }
+            r[i + b.size()] = (uint32_t)carry;
+        }
+        trimLimbs(r);
+        return r;
+    }
+    // (a1 B + a0)(b1 B + b0) = z2 B^2 + ((a0+a1)(b0+b1) - z0 - z2) B + z0
+    const size_t h = max(a.size(), b.size()) / 2;
+    auto low = [h](const Limbs& x) {
+        Limbs r(x.begin(), x.begin() + min(h, x.size()));
+        trimLimbs(r);
+        return r;
+    };
+    auto high = [h](const Limbs& x) { return x.size() > h ? Limbs(x.begin() + h, x.end()) : Limbs(); };
+    Limbs a0 = low(a), a1 = high(a), b0 = low(b), b1 = high(b);
+    Limbs z0 = mulLimbs(a0, b0), z2 = mulLimbs(a1, b1);
+    Limbs z1 = subLimbs(subLimbs(mulLimbs(addLimbs(a0, a1), addLimbs(b0, b1)), z0), z2);
+    Limbs r(a.size() + b.size() + 1, 0);
+    addShifted(r, z0, 0);
+    addShifted(r, z1, h);
+    addShifted(r, z2, 2 * h);
+    trimLimbs(r);
+    return r;
+}
+
+// a = a * m + add, in place
+static void mulAddSmall(Limbs& a, uint32_t m, uint32_t add) {
+    uint64_t carry = add;
+    for (uint32_t &limb : a) {
+        carry += (uint64_t)limb * m;
+        limb = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry) a.push_back((uint32_t)carry);
+}
+
+// a = a / d in place; returns the remainder
+static uint32_t divSmall(Limbs& a, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = a.size(); i-- > 0; ) {
+        uint64_t cur = (rem << 32) | a[i];
+        a[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    trimLimbs(a);
+    return (uint32_t)rem;
+}
+
+static uint32_t modSmall(const Limbs& a, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = a.size(); i-- > 0; ) rem = ((rem << 32) | a[i]) % d;
+    return (uint32_t)rem;
+}
+
+// q = a / b, r = a % b on magnitudes; b is nonzero
+static void divModLimbs(const Limbs& a, const Limbs& b, Limbs& q, Limbs& r) {
+    if (compareLimbs(a, b) < 0) {
+        q.clear();
+        r = a;
+        return;
+    }
+    if (b.size() == 1) {
+        q = a;
+        uint32_t rem = divSmall(q, b[0]);
+        r = rem ? Limbs{rem} : Limbs{};
+        return;
+    }
+    // Normalize so the divisor's top bit is set, then one quotient limb per step
+    const int s = __builtin_clz(b.back());
+    const size_t n = b.size(), m = a.size() - n;
+    Limbs u(a.size() + 1, 0), v(n, 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        u[i]     |= a[i] << s;
+        u[i + 1] |= s ? a[i] >> (32 - s) : 0;
+    }
+    for (size_t i = 0; i < n; ++i)
+        v[i] = (b[i] << s) | (s && i ? b[i - 1] >> (32 - s) : 0);
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0; ) {
+        uint64_t num  = ((uint64_t)u[j + n] << 32) | u[j + n - 1];
+        uint64_t qhat = num / v[n - 1], rhat = num % v[n - 1];
+        while (qhat >> 32 || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+            --qhat;
+            rhat += v[n - 1];
+            if (rhat >> 32) break;
+        }
+        int64_t  borrow = 0;
+        uint64_t carry  = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t p = qhat * v[i] + carry;
+            carry = p >> 32;
+            int64_t t = (int64_t)u[i + j] - borrow - (int64_t)(uint32_t)p;
+            u[i + j] = (uint32_t)t;
+            borrow = t < 0;
+        }
+        int64_t t = (int64_t)u[j + n] - borrow - (int64_t)carry;
+        u[j + n] = (uint32_t)t;
+        if (t < 0) {   // qhat was one too large: add the divisor back
+            --qhat;
+            uint64_t c = 0;
+            for (size_t i = 0; i < n; ++i) {
+                c += (uint64_t)u[i + j] + v[i];
+                u[i + j] = (uint32_t)c;
+                c >>= 32;
+            }
+            u[j + n] += (uint32_t)c;
+        }
+        q[j] = (uint32_t)qhat;
+    }
+    trimLimbs(q);
+    r.assign(n, 0);
+    for (size_t i = 0; i < n; ++i)
+        r[i] = (u[i] >> s) | (s ? u[i + 1] << (32 - s) : 0);
+    trimLimbs(r);
+}
+
+BigInt::BigInt(int64_t v) : neg(v < 0) {
+    uint64_t m = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+    mag = {(uint32_t)m, (uint32_t)(m >> 32)};
+    trimLimbs(mag);
+}
+
+BigInt BigInt::fromLimbs(Limbs m, bool negative) {
+    BigInt r;
+    trimLimbs(m);
+    r.mag = move(m);
+    r.neg = negative && !r.mag.empty();
+    return r;
+}
+
+BigInt BigInt::parse(const string& s) {
+    if (s.empty() || !all_of(s.begin(), s.end(), [](unsigned char ch) { return isdigit(ch); }))
+        throw runtime_error("Integer mode takes whole numbers, not " + s);
+    BigInt r;
+    for (size_t i = 0; i < s.size(); ) {
+        size_t len = min<size_t>(9, s.size() - i);
+        static const uint32_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000,
+                                         10000000, 100000000, 1000000000};
+        mulAddSmall(r.mag, pow10[len], (uint32_t)stoul(s.substr(i, len)));
+        i += len;
+    }
+    trimLimbs(r.mag);
+    return r;
+}
+
+string BigInt::toString() const {
+    if (mag.empty()) return "0";
+    vector<Limbs> pows = {{1000000000}};   // pows[k] = 10^(9 2^k)
+    for (;;) {
+        Limbs sq = mulLimbs(pows.back(), pows.back());
+        if (compareLimbs(sq, mag) > 0) break;
+        pows.push_back(move(sq));
+    }
+    string s = neg ? "-" : "";
+    // x < 10^(9 2^(k+1)); pad: fill exactly that many digits
+    function<void(const Limbs&, int, bool)> emit = [&](const Limbs& x, int k, bool pad) {
+        if (x.size() <= 32) {
+            Limbs m = x;
+            vector<uint32_t> chunks;   // base 10^9, least significant first
+            while (!m.empty()) {
+                uint64_t rem = 0;
+                for (size_t i = m.size(); i-- > 0; ) {
+                    uint64_t cur = (rem << 32) | m[i];
+                    m[i] = (uint32_t)(cur / 1000000000u);
+                    rem = cur % 1000000000u;
+                }
+                trimLimbs(m);
+                chunks.push_back((uint32_t)rem);
+            }
+            string t;
+            char buf[16];
+            for (size_t i = chunks.size(); i-- > 0; ) {
+                snprintf(buf, sizeof buf, i + 1 == chunks.size() && !pad ? "%u" : "%09u", chunks[i]);
+                t += buf;
+            }
+            if (pad) s.append(9 * ((size_t)2 << k) - t.size(), '0');
+            s += t.empty() && !pad ? "0" : t;
+            return;
+        }
+        Limbs q, r;
+        divModLimbs(x, pows[k], q, r);
+        if (pad || !q.empty()) emit(q, k - 1, pad);
+        emit(r, k - 1, pad || !q.empty());
+    };
+    emit(mag, pows.size() - 1, false);
+    return s;
+}
+
+int compare(const BigInt& a, const BigInt& b) {
+    if (a.neg != b.neg) return a.neg ? -1 : 1;
+    int c = compareLimbs(a.mag, b.mag);
+    return a.neg ? -c : c;
+}
+
+BigInt operator+(const BigInt& a, const BigInt& b) {
+    if (a.neg == b.neg) return BigInt::fromLimbs(addLimbs(a.mag, b.mag), a.neg);
+    if (compareLimbs(a.mag, b.mag) >= 0) return BigInt::fromLimbs(subLimbs(a.mag, b.mag), a.neg);
+    return BigInt::fromLimbs(subLimbs(b.mag, a.mag), b.neg);
+}
+
+BigInt operator*(const BigInt& a, const BigInt& b) {
+    return BigInt::fromLimbs(mulLimbs(a.mag, b.mag), a.neg != b.neg);
+}
+
+void BigInt::divMod(const BigInt& a, const BigInt& b, BigInt& q, BigInt& r) {
+    if (b.isZero()) throw runtime_error("Cannot divide by zero");
+    Limbs qm, rm;
+    divModLimbs(a.mag, b.mag, qm, rm);
+    q = fromLimbs(move(qm), a.neg != b.neg);
+    r = fromLimbs(move(rm), a.neg);
+    if (!r.isZero() && r.neg != b.neg) {
+        q = q - BigInt(1);
+        r = r + b;
+    }
+}
+
+BigInt gcd(BigInt a, BigInt b) {
+    a = a.abs();
+    b = b.abs();
+    while (!b.isZero()) {
+        BigInt r = a % b;
+        a = move(b);
+        b = move(r);
+    }
+    return a;
+}
+
+static uint64_t gcdU64(uint64_t a, uint64_t b) {
+    while (b) {
+        uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// Montgomery arithmetic modulo an odd 64-bit n; values stay below n
+struct Montgomery64 {
+    uint64_t n, inv, r2;   // inv = n^-1 mod 2^64, r2 = 2^128 mod n
+
+    explicit Montgomery64(uint64_t mod) : n(mod), inv(mod) {
+        for (int i = 0; i < 5; ++i) inv *= 2 - n * inv;   // Newton: 5 steps reach 64 bits
+        unsigned __int128 r = ((unsigned __int128)1 << 64) % n;
+        r2 = (uint64_t)(r * r % n);
+    }
+    uint64_t reduce(unsigned __int128 t) const {   // t / 2^64 mod n, for t < n 2^64
+        uint64_t m  = (uint64_t)t * inv;
+        uint64_t hi = (uint64_t)(t >> 64), mn = (uint64_t)(((unsigned __int128)m * n) >> 64);
+        return hi >= mn ? hi - mn : hi - mn + n;
+    }
+    uint64_t mul(uint64_t a, uint64_t b) const { return reduce((unsigned __int128)a * b); }
+    uint64_t to(uint64_t a) const              { return mul(a % n, r2); }
+    uint64_t from(uint64_t a) const            { return reduce(a); }
+    uint64_t add(uint64_t a, uint64_t b) const { return a >= n - b ? a - (n - b) : a + b; }
+};
+
+// Montgomery arithmetic modulo an odd multi-limb m (CIOS multiplication);
+// residues are exactly size() limbs long
+class MontgomeryBig {
+public:
+    explicit MontgomeryBig(const Limbs& mod) : m(mod), n(mod.size()) {
+        uint32_t inv = m[0];
+        for (int i = 0; i < 4; ++i) inv *= 2 - m[0] * inv;
+        minv = 0 - inv;
+        Limbs r2(2 * n + 1, 0), q;
+        r2[2 * n] = 1;
+        divModLimbs(r2, m, q, rr);
+    }
+    size_t size() const { return n; }
+
+    Limbs to(const Limbs& x) const {
+        Limbs q, r;
+        divModLimbs(x, m, q, r);
+        return mul(pad(r), pad(rr));
+    }
+    Limbs from(const Limbs& x) const {
+        Limbs one(n, 0);
+        one[0] = 1;
+        Limbs r = mul(x, one);
+        trimLimbs(r);
+        return r;
+    }
+    Limbs mul(const Limbs& a, const Limbs& b) const {
+        vector<uint32_t> t(n + 2, 0);
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t c = 0;
+            for (size_t j = 0; j < n; ++j) {
+                c += (uint64_t)a[j] * b[i] + t[j];
+                t[j] = (uint32_t)c;
+                c >>= 32;
+            }
+            c += t[n];
+            t[n] = (uint32_t)c;
+            t[n + 1] = (uint32_t)(c >> 32);
+            const uint32_t q = t[0] * minv;
+            c = ((uint64_t)q * m[0] + t[0]) >> 32;
+            for (size_t j = 1; j < n; ++j) {
+                c += (uint64_t)q * m[j] + t[j];
+                t[j - 1] = (uint32_t)c;
+                c >>= 32;
+            }
+            c += t[n];
+            t[n - 1] = (uint32_t)c;
+            t[n] = t[n + 1] + (uint32_t)(c >> 32);
+        }
+        Limbs r(t.begin(), t.begin() + n);
+        if (t[n] || compareLimbs(trimmed(r), m) >= 0) {   // one subtraction brings it below m
+            int64_t borrow = 0;
+            for (size_t j = 0; j < n; ++j) {
+                int64_t d = (int64_t)r[j] - m[j] - borrow;
+                borrow = d < 0;
+                r[j] = (uint32_t)d;
+            }
+        }
+        return r;
+    }
+    Limbs add(const Limbs& a, const Limbs& b) const {   // a + b mod m
+        Limbs s = addLimbs(trimmed(a), trimmed(b));
+        if (compareLimbs(s, m) >= 0) s = subLimbs(s, m);
+        return pad(s);
+    }
+    Limbs pad(Limbs x) const { x.resize(n, 0); return x; }
+
+private:
+    Limbs    m, rr;   // rr = R^2 mod m, R = 2^(32 n)
+    size_t   n;
+    uint32_t minv;    // -m^-1 mod 2^32
+
+    static Limbs trimmed(Limbs x) { trimLimbs(x); return x; }
+};
+
+BigInt powmod(const BigInt& a, const BigInt& e, const BigInt& m) {
+    if (m.isNegative() || m.isZero()) throw runtime_error("powmod needs a positive modulus");
+    if (e.isNegative()) throw runtime_error("powmod needs a nonnegative exponent");
+    if (m == BigInt(1)) return BigInt(0);
+    const BigInt base = a % m;
+    const Limbs& bits = e.limbs();
+    const size_t nbits = e.bitLength();
+    auto bit = [&](size_t i) { return (bits[i / 32] >> (i % 32)) & 1; };
+
+    if (m.isOdd() && m.fitsU64()) {
+        Montgomery64 M(m.toU64());
+        uint64_t x = M.to(1), b = M.to(base.toU64());
+        for (size_t i = nbits; i-- > 0; ) {
+            x = M.mul(x, x);
+            if (bit(i)) x = M.mul(x, b);
+        }
+        return BigInt::fromU64(M.from(x));
+    }
+    if (m.isOdd()) {
+        MontgomeryBig M(m.limbs());
+        Limbs x = M.to({1}), b = M.to(base.limbs());
+        for (size_t i = nbits; i-- > 0; ) {
+            x = M.mul(x, x);
+            if (bit(i)) x = M.mul(x, b);
+        }
+        return BigInt::fromLimbs(M.from(x));
+    }
+    BigInt x(1);   // even modulus: plain square-and-multiply
+    for (size_t i = nbits; i-- > 0; ) {
+        x = x * x % m;
+        if (bit(i)) x = x * base % m;
+    }
+    return x;
+}
+
+static const uint32_t smallPrimes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41};
+
+bool isPrimeU64(uint64_t n) {
+    if (n < 2) return false;
+    for (uint32_t p : smallPrimes) {
+        if (n == p) return true;
+        if (n % p == 0) return false;
+    }
+    uint64_t d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+    Montgomery64 M(n);
+    const uint64_t one = M.to(1), minusOne = M.to(n - 1);
+    for (uint32_t a : smallPrimes) {
+        if (a == 41) break;
+        uint64_t x = M.to(1), b = M.to(a);
+        for (int i = 63 - __builtin_clzll(d); i >= 0; --i) {
+            x = M.mul(x, x);
+            if ((d >> i) & 1) x = M.mul(x, b);
+        }
+        if (x == one || x == minusOne) continue;
+        bool composite = true;
+        for (int r = 1; r < s && composite; ++r) {
+            x = M.mul(x, x);
+            if (x == minusOne) composite = false;
+        }
+        if (composite) return false;
+    }
+    return true;
+}
+
+Primality primality(const BigInt& n) {
+    if (n.isNegative()) return Primality::Composite;
+    if (n.fitsU64()) return isPrimeU64(n.toU64()) ? Primality::Prime : Primality::Composite;
+    for (uint32_t p = 2; p < 1000; p += 1 + (p > 2))
+        if (modSmall(n.limbs(), p) == 0) return Primality::Composite;
+
+    const BigInt nm1 = n - BigInt(1);
+    size_t s = 0;
+    while (!((nm1.limbs()[s / 32] >> (s % 32)) & 1)) ++s;
+    BigInt d = nm1;
+    for (size_t k = 0; k < s; ++k) d = d / BigInt(2);
+
+    MontgomeryBig M(n.limbs());
+    const Limbs one = M.to({1}), minusOne = M.to(nm1.limbs());
+    const bool deterministic = n.bitLength() <= 81;   // 2^81 < 3.3e24
+    vector<uint32_t> bases(begin(smallPrimes), end(smallPrimes));
+    if (!deterministic)
+        for (uint32_t p = 43; bases.size() < 37; p += 2)
+            if (isPrimeU64(p)) bases.push_back(p);
+    for (uint32_t a : bases) {
+        Limbs x = one, b = M.to({a});
+        for (size_t i = d.bitLength(); i-- > 0; ) {
+            x = M.mul(x, x);
+            if ((d.limbs()[i / 32] >> (i % 32)) & 1) x = M.mul(x, b);
+        }
+        if (x == one || x == minusOne) continue;
+        bool composite = true;
+        for (size_t r = 1; r < s && composite; ++r) {
+            x = M.mul(x, x);
+            if (x == minusOne) composite = false;
+        }
+        if (composite) return Primality::Composite;
+    }
+    return deterministic ? Primality::Prime : Primality::ProbablePrime;
+}
+
+uint64_t rhoU64(uint64_t n) {
+    Montgomery64 M(n);
+    for (uint64_t c = 1; ; ++c) {
+        const uint64_t cm = M.to(c);
+        auto f = [&](uint64_t v) { return M.add(M.mul(v, v), cm); };
+        uint64_t x = 0, y = M.to(2), ys = y, q = M.to(1), g = 1;
+        for (uint64_t r = 1; g == 1; r <<= 1) {
+            x = y;
+            for (uint64_t i = 0; i < r; ++i) y = f(y);
+            for (uint64_t k = 0; k < r && g == 1; k += 128) {
+                ys = y;
+                for (uint64_t i = 0; i < min<uint64_t>(128, r - k); ++i) {
+                    y = f(y);
+                    q = M.mul(q, x > y ? x - y : y - x);
+                }
+                g = gcdU64(q, n);
+            }
+        }
+        if (g == n)   // the batch overshot: step back one difference at a time
+            do {
+                ys = f(ys);
+                g = gcdU64(x > ys ? x - ys : ys - x, n);
+            } while (g == 1);
+        if (g != n) return g;
+    }
+}
+
+BigInt rhoBig(const BigInt& n, uint64_t maxSteps) {
+    MontgomeryBig M(n.limbs());
+    auto absDiff = [](Limbs a, Limbs b) {
+        trimLimbs(a);
+        trimLimbs(b);
+        return compareLimbs(a, b) >= 0 ? subLimbs(a, b) : subLimbs(b, a);
+    };
+    const BigInt one(1);
+    for (uint32_t c = 1; c < 16; ++c) {
+        const Limbs cm = M.to({c});
+        auto f = [&](const Limbs& v) { return M.add(M.mul(v, v), cm); };
+        Limbs x, y = M.to({2}), ys = y, q = M.to({1});
+        BigInt g = one;
+        uint64_t steps = 0;
+        for (uint64_t r = 1; g == one && steps < maxSteps; r <<= 1) {
+            x = y;
+            for (uint64_t i = 0; i < r; ++i) y = f(y);
+            for (uint64_t k = 0; k < r && g == one; k += 128) {
+                ys = y;
+                for (uint64_t i = 0; i < min<uint64_t>(128, r - k); ++i) {
+                    y = f(y);
+                    q = M.mul(q, M.pad(absDiff(x, y)));
+                }
+                g = gcd(BigInt::fromLimbs(q), n);
+                steps += 128;
+            }
+        }
+        if (g == one) return BigInt(0);
+        if (g == n)
+            do {
+                ys = f(ys);
+                g = gcd(BigInt::fromLimbs(absDiff(x, ys)), n);
+            } while (g == one);
+        if (g != n) return g;
+    }
+    return BigInt(0);
+}
+
+vector<pair<BigInt,int>> factorize(BigInt n) {
+    vector<BigInt> found;
+    n = n.abs();
+    for (uint32_t p = 2; p < 10000 && !(n == BigInt(1)); p += 1 + (p > 2)) {
+        if ((uint64_t)p * p > n.toU64() && n.fitsU64()) break;
+        while (modSmall(n.limbs(), p) == 0) {
+            found.push_back(BigInt(p));
+            Limbs m = n.limbs();
+            divSmall(m, p);
+            n = BigInt::fromLimbs(m);
+        }
+    }
+    vector<BigInt> todo, stuck;
+    if (!(n == BigInt(1))) todo.push_back(n);
+    while (!todo.empty()) {
+        BigInt c = move(todo.back());
+        todo.pop_back();
+        if (primality(c) != Primality::Composite) {
+            found.push_back(c);
+            continue;
+        }
+        BigInt d = c.fitsU64() ? BigInt::fromU64(rhoU64(c.toU64())) : rhoBig(c);
+        if (d.isZero()) {
+            stuck.push_back(c);
+            continue;
+        }
+        todo.push_back(d);
+        todo.push_back(c / d);
+    }
+    sort(found.begin(), found.end());
+    vector<pair<BigInt,int>> out;
+    for (auto &p : found) {
+        if (!out.empty() && out.back().first == p) out.back().second++;
+        else out.push_back({p, 1});
+    }
+    for (auto &c : stuck) out.push_back({c, 0});
+    return out;
+}
+
+BigInt factorial(uint64_t n) {
+    function<BigInt(uint64_t, uint64_t)> product = [&](uint64_t lo, uint64_t hi) -> BigInt {
+        if (hi - lo < 16) {
+            BigInt r(1);
+            for (uint64_t k = lo; k <= hi; ++k) r = r * BigInt((int64_t)k);
+            return r;
+        }
+        uint64_t mid = lo + (hi - lo) / 2;
+        return product(lo, mid) * product(mid + 1, hi);
+    };
+    return n < 2 ? BigInt(1) : product(2, n);
+}
+
+uint64_t countPrimes(uint64_t a, uint64_t b, vector<uint64_t>& list, size_t keep) {
+    list.clear();
+    if (b < 2 || a > b) return 0;
+    const uint64_t root = (uint64_t)sqrt((double)b) + 1;
+    vector<uint32_t> base;   // odd primes up to sqrt(b)
+    {
+        vector<bool> composite(root + 1, false);
+        for (uint64_t i = 3; i <= root; i += 2) {
+            if (composite[i]) continue;
+            base.push_back(i);
+            for (uint64_t j = i * i; j <= root; j += 2 * i) composite[j] = true;
+        }
+    }
+    const uint64_t lo = max<uint64_t>(a, 3) | 1;   // first odd candidate
+    const uint64_t span = 1 << 19;                 // numbers per segment (256 KB of odd flags)
+    const uint64_t nseg = b >= lo ? (b - lo) / span + 1 : 0;
+    // Segments go in windows of a few per thread; each window's counts and
+    // primes are merged in order before the next starts, so the memory does
+    // not grow with the width of [a, b]
+    const uint64_t window = 64 * (uint64_t)threadPool().size();
+    vector<uint64_t>         counts;
+    vector<vector<uint64_t>> kept;
+    uint64_t total = a <= 2 ? 1 : 0;
+    if (total && keep) list.push_back(2);
+    for (uint64_t w0 = 0; w0 < nseg; w0 += window) {
+        const uint64_t wn = min(window, nseg - w0);
+        const size_t want = keep - list.size();
+        counts.assign(wn, 0);
+        kept.assign(wn, {});
+        atomic<uint64_t> next{0};
+        threadPool().parallel([&](unsigned) {
+            vector<uint8_t> sieve(span / 2);
+            for (uint64_t k; (k = next++) < wn; ) {
+                const uint64_t from = lo + (w0 + k) * span, to = min(b, from + span - 1);
+                const size_t len = (to - from) / 2 + 1;   // odd numbers from, from+2, ...
+                fill_n(sieve.begin(), len, 1);
+                for (uint32_t p : base) {
+                    if ((uint64_t)p * p > to) break;
+                    uint64_t first = max<uint64_t>((uint64_t)p * p, (from + p - 1) / p * p);
+                    if (!(first & 1)) first += p;
+                    for (uint64_t j = (first - from) / 2; j < len; j += p) sieve[j] = 0;
+                }
+                for (size_t j = 0; j < len; ++j) {
+                    if (!sieve[j]) continue;
+                    if (from + 2 * j == 1) continue;
+                    counts[k]++;
+                    if (kept[k].size() < want) kept[k].push_back(from + 2 * j);
+                }
+            }
+        });
+        for (uint64_t k = 0; k < wn; ++k) {
+            total += counts[k];
+            for (uint64_t p : kept[k])
+                if (list.size() < keep) list.push_back(p);
+        }
+    }
+    return total;
+}
+
+IntegerResult evalInteger(const string& expr) {
+    vector<ArrayOp> pf = arrayPostfix(tokenize(expr));
+    vector<BigInt> st;
+    string text;
+    auto pop = [&]() {
+        if (st.empty()) throw runtime_error("Invalid expression");
+        BigInt v = move(st.back());
+        st.pop_back();
+        return v;
+    };
+    auto small = [](const BigInt& v, uint64_t limit, const char* what) {
+        if (v.isNegative() || !v.fitsU64() || v.toU64() > limit)
+            throw runtime_error(string(what) + " must be a whole number from 0 to " + to_string(limit));
+        return v.toU64();
+    };
+    for (size_t i = 0; i < pf.size(); ++i) {
+        const ArrayOp& op = pf[i];
+        if (!text.empty()) throw runtime_error("factor() and primes() must be the whole expression");
+        if (op.kind == ArrayOp::VALUE) st.push_back(BigInt::parse(op.text));
+        else if (op.kind == ArrayOp::BUILD) throw runtime_error("Integer mode has no vectors or matrices");
+        else if (op.kind == ArrayOp::OPERATOR && (op.text == "neg" || op.text == "!")) {
+            BigInt a = pop();
+            st.push_back(op.text == "neg" ? -a : factorial(small(a, 100000, "n in n!")));
+        }
+        else if (op.kind == ArrayOp::OPERATOR && isBitwiseOperator(op.text)) {
+            throw runtime_error("Bitwise operators work on 64-bit values (type \"mode real\")");
+        }
+        else if (op.kind == ArrayOp::OPERATOR) {
+            BigInt b = pop(), a = pop();
+            if      (op.text == "+") st.push_back(a + b);
+            else if (op.text == "-") st.push_back(a - b);
+            else if (op.text == "*") st.push_back(a * b);
+            else if (op.text == "/") st.push_back(a / b);
+            else if (op.text == "%") st.push_back(a % b);
+            else if (isComparison(op.text)) {
+                const int c = compare(a, b);
+                const string& t = op.text;
+                st.push_back(BigInt(t == "<" ? c < 0 : t == "<=" ? c <= 0 : t == ">" ? c > 0 :
+                                    t == ">=" ? c >= 0 : t == "==" ? c == 0 : c != 0));
+            }
+            else {   // ^ and **
+                if (b.isNegative()) throw runtime_error("Integer powers need a nonnegative exponent");
+                if (a.abs() == BigInt(1) || a.isZero() || b.isZero()) {
+                    bool oddPower = b.isOdd();
+                    st.push_back(b.isZero() ? BigInt(1) : a.isNegative() && !oddPower ? BigInt(1) : a);
+                    continue;
+                }
+                uint64_t e = small(b, maxIntegerBits, "The exponent");
+                if ((a.bitLength() - 1) * e > maxIntegerBits) throw runtime_error("Result would be too large");
+                BigInt r(1), base = a;
+                for (; e; e >>= 1) {
+                    if (e & 1) r = r * base;
+                    if (e > 1) base = base * base;
+                }
+                st.push_back(r);
+            }
+        }
+        else if (op.text == "abs" && op.cols == 1) {
+            st.push_back(pop().abs());
+        }
+        else if ((op.text == "min" || op.text == "max") && op.cols == 2) {
+            BigInt b = pop(), a = pop();
+            st.push_back((b < a) == (op.text == "min") ? b : a);
+        }
+        else {   // CALL
+            auto fn = integerFunctions.find(op.text);
+            if (fn == integerFunctions.end())
+                throw runtime_error(op.text + "() is not available in integer mode");
+            if ((int)op.cols != fn->second)
+                throw runtime_error(op.text + " takes " + to_string(fn->second) + " argument(s)");
+            vector<BigInt> args(op.cols);
+            for (size_t k = op.cols; k-- > 0; ) args[k] = pop();
+            if (op.text == "gcd") st.push_back(gcd(args[0], args[1]));
+            else if (op.text == "lcm") {
+                BigInt g = gcd(args[0], args[1]);
+                st.push_back(g.isZero() ? g : (args[0] / g * args[1]).abs());
+            }
+            else if (op.text == "powmod") st.push_back(powmod(args[0], args[1], args[2]));
+            else if (op.text == "isprime") {
+                Primality p = primality(args[0]);
+                st.push_back(BigInt(p != Primality::Composite));
+                if (p == Primality::ProbablePrime) text = "1   (probable prime: Miller-Rabin with 37 bases)";
+            }
+            else if (op.text == "factor") {
+                if (args[0].isZero()) throw runtime_error("0 has no factorization");
+                ostringstream s;
+                s << (args[0].isNegative() ? "-1 * " : "");
+                auto fs = factorize(args[0]);
+                if (fs.empty()) s << "1";
+                for (size_t k = 0; k < fs.size(); ++k) {
+                    s << (k ? " * " : "") << fs[k].first.toString();
+                    if (fs[k].second > 1) s << "^" << fs[k].second;
+                    if (fs[k].second == 0) s << " (composite, not split)";
+                }
+                st.push_back(args[0]);
+                text = s.str();
+            }
+            else {   // primes(a, b)
+                uint64_t a = args[0].isNegative() ? 0 : small(args[0], 1e14, "a in primes(a, b)");
+                uint64_t b = small(args[1], 1e14, "b in primes(a, b)");
+                vector<uint64_t> list;
+                uint64_t count = countPrimes(a, b, list, 30);
+                st.push_back(BigInt::fromU64(count));
+                if (count <= 30 && count > 0) {
+                    ostringstream s;
+                    for (size_t k = 0; k < list.size(); ++k) s << (k ? ", " : "") << list[k];
+                    text = s.str() + "   (" + to_string(count) + " primes)";
+                }
+            }
+        }
+    }
+    if (st.size() != 1) throw runtime_error("Invalid expression");
+    return {st.back(), text};
+}
+
+string abbreviateInteger(const string& s) {
+    if (s.size() <= 24) return s;
+    return s.substr(0, 12) + "…(" + to_string(s.size() - (s[0] == '-')) + " digits)";
+}
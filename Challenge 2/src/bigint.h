@@ -0,0 +1,121 @@
+// bigint.h
+// Integer mode
+//
+// "mode integer" evaluates with arbitrary-size integers: + - * / % ^, the
+// postfix factorial n!, and gcd, lcm, powmod, isprime, factor and primes.
+// / and % round toward negative infinity, so a % m has the sign of m.
+//
+// Magnitudes are little-endian 32-bit limbs.  Products switch to Karatsuba
+// for long operands, division is Knuth's algorithm D, powmod runs in
+// Montgomery form (one 64-bit word when the modulus fits), isprime is
+// Miller-Rabin with bases that are deterministic below 3.3e24, factor is
+// trial division followed by Pollard-Brent rho, and primes(a, b) counts with
+// a segmented odd-only sieve spread over the pool.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using Limbs = std::vector<uint32_t>;
+
+class BigInt {
+public:
+    BigInt() = default;
+    BigInt(int64_t v);
+    static BigInt fromLimbs(Limbs m, bool negative = false);
+    static BigInt fromU64(uint64_t v) { return fromLimbs({(uint32_t)v, (uint32_t)(v >> 32)}); }
+
+    // Whole decimal numbers only ("12", "1e3" and "2.5" are rejected)
+    static BigInt parse(const std::string& s);
+
+    // Divide and conquer on 10^(9 2^k) so long numbers (100000!) convert in
+    // a second rather than by one pass over the whole number per 9 digits
+    std::string toString() const;
+
+    const Limbs& limbs() const { return mag; }
+    bool   isZero() const     { return mag.empty(); }
+    bool   isNegative() const { return neg; }
+    bool   isOdd() const      { return !mag.empty() && (mag[0] & 1); }
+    bool   fitsU64() const    { return mag.size() <= 2 && !neg; }
+    uint64_t toU64() const {
+        return (mag.size() > 0 ? mag[0] : 0) | (mag.size() > 1 ? (uint64_t)mag[1] << 32 : 0);
+    }
+    size_t bitLength() const { return mag.empty() ? 0 : 32 * mag.size() - __builtin_clz(mag.back()); }
+    double toDouble() const {
+        double d = 0;
+        for (size_t i = mag.size(); i-- > 0; ) d = d * 4294967296.0 + mag[i];
+        return neg ? -d : d;
+    }
+    BigInt abs() const { return fromLimbs(mag); }
+
+    BigInt operator-() const { return fromLimbs(mag, !neg); }
+
+    friend int compare(const BigInt& a, const BigInt& b);
+    friend bool operator==(const BigInt& a, const BigInt& b) { return compare(a, b) == 0; }
+    friend bool operator!=(const BigInt& a, const BigInt& b) { return compare(a, b) != 0; }
+    friend bool operator<(const BigInt& a, const BigInt& b)  { return compare(a, b) < 0; }
+
+    friend BigInt operator+(const BigInt& a, const BigInt& b);
+    friend BigInt operator-(const BigInt& a, const BigInt& b) { return a + (-b); }
+    friend BigInt operator*(const BigInt& a, const BigInt& b);
+
+    // Floor division: the remainder takes the divisor's sign
+    static void divMod(const BigInt& a, const BigInt& b, BigInt& q, BigInt& r);
+    friend BigInt operator/(const BigInt& a, const BigInt& b) { BigInt q, r; divMod(a, b, q, r); return q; }
+    friend BigInt operator%(const BigInt& a, const BigInt& b) { BigInt q, r; divMod(a, b, q, r); return r; }
+
+private:
+    bool  neg = false;
+    Limbs mag;   // no leading zero limbs; zero is empty
+};
+
+BigInt gcd(BigInt a, BigInt b);
+
+// a^e mod m for m > 0, e >= 0
+BigInt powmod(const BigInt& a, const BigInt& e, const BigInt& m);
+
+// Deterministic for every 64-bit n (bases up to 37)
+bool isPrimeU64(uint64_t n);
+
+enum class Primality { Composite, Prime, ProbablePrime };
+
+// Miller-Rabin; the 13 prime bases are deterministic below 3.3e24, above
+// that 24 more bases are tried and a pass is only "probable"
+Primality primality(const BigInt& n);
+
+// A nontrivial factor of an odd composite n (Pollard-Brent, products of
+// 128 differences per gcd)
+uint64_t rhoU64(uint64_t n);
+
+// Same for multi-limb n; gives up (returns 0) after maxSteps iterations
+BigInt rhoBig(const BigInt& n, uint64_t maxSteps = 1 << 20);
+
+// Prime factors with multiplicities, ascending; a cofactor rho could not
+// split is returned with multiplicity 0
+std::vector<std::pair<BigInt,int>> factorize(BigInt n);
+
+// n! as a balanced product tree, so the big multiplications are even-sized
+BigInt factorial(uint64_t n);
+
+// Primes in [a, b]: a segmented sieve over odd numbers, segments spread over
+// the pool a bounded window at a time.  Up to `keep` of the smallest primes
+// are returned in `list`.
+uint64_t countPrimes(uint64_t a, uint64_t b, std::vector<uint64_t>& list, size_t keep);
+
+// The value of an integer-mode line; text, when set, is shown instead
+// (factorizations, prime lists)
+struct IntegerResult {
+    BigInt      value;
+    std::string text;
+};
+
+// Results above this many bits are refused rather than computed
+inline constexpr size_t maxIntegerBits = 1 << 24;
+
+IntegerResult evalInteger(const std::string& expr);
+
+// Long results shown in the prompt: leading digits and the length
+std::string abbreviateInteger(const std::string& s);
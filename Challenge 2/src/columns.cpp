@@ -0,0 +1,179 @@
+// columns.cpp
+// Formula columns (see columns.h)
+
+#include "columns.h"
+#include "format.h"
+#include "formulas.h"
+#include "parser.h"
+#include "tables.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+FormulaSet compileFormulaSet(const string& path, uint32_t memoEntries) {
+    vector<FormulaLine> lines = readFormulaFile(path);
+    for (const FormulaLine& f : lines) {   // tables first: formulas call them
+        if (!f.table) continue;
+        try {
+            defineTable(f);
+        }
+        catch (const exception &ex) {
+            throw runtime_error(path + ":" + to_string(f.lineNo) + ": " + ex.what());
+        }
+    }
+    lines.erase(remove_if(lines.begin(), lines.end(), [](const FormulaLine& f) { return f.table; }), lines.end());
+    if (lines.empty()) throw runtime_error(path + ": no formulas");
+    vector<string> names, vars;
+    for (const FormulaLine& f : lines) {
+        if (find(names.begin(), names.end(), f.name) != names.end())
+            throw runtime_error("Formula defined twice: " + f.name);
+        names.push_back(f.name);
+        for (const string& p : f.params)
+            if (find(vars.begin(), vars.end(), p) == vars.end()) vars.push_back(p);
+    }
+    vector<TokenList> pfs;
+    pfs.reserve(lines.size());
+    vector<const TokenList*> ptrs;
+    for (const FormulaLine& f : lines) {
+        try {
+            pfs.push_back(infixToPostfix(tokenize(f.body, f.params)));
+        }
+        catch (const exception &ex) {
+            throw runtime_error(path + ":" + to_string(f.lineNo) + ": " + ex.what());
+        }
+        ptrs.push_back(&pfs.back());
+    }
+    return {move(names), compileAll(ptrs.data(), ptrs.size(), vars, true, memoEntries)};
+}
+
+void evaluateColumns(const Program& prog, const double* const* vars, size_t n,
+                     double* const* outs, MemoStats* memo) {
+    const size_t chunk = 64 * batchLanes;
+    const BatchColumns more{prog.outputs.data() + 1, outs + 1, prog.outputs.size() - 1};
+    atomic<size_t> next{0};
+    mutex memoLock;
+    auto worker = [&](unsigned) {
+        BatchMachine m(prog.view());
+        vector<const double*> cols(prog.vars.size());
+        vector<double*> rest(more.count);
+        for (size_t s; (s = next.fetch_add(chunk)) < n; ) {
+            for (size_t v = 0; v < cols.size(); ++v) cols[v] = vars[v] + s;
+            for (size_t k = 0; k < rest.size(); ++k) rest[k] = outs[k + 1] + s;
+            const BatchColumns shifted{more.regs, rest.data(), more.count};
+            executeBatch(m, cols.data(), min(chunk, n - s), outs[0] + s, nullptr, &shifted);
+        }
+        if (memo && !prog.memoOps.empty()) {
+            lock_guard<mutex> hold(memoLock);
+            memo->add(m.prog, m.memo.data());
+        }
+    };
+    if (n < 4 * chunk) worker(0);
+    else threadPool().parallel(worker);
+}
+
+int runColumns(const string& formulaPath, const string& dataPath, uint32_t memoEntries) {
+    if (memoEntries > maxMemoEntries || (memoEntries & (memoEntries - 1)))
+        throw runtime_error("--memo=N takes a power of two up to " + to_string(maxMemoEntries));
+    const FormulaSet fs = compileFormulaSet(formulaPath, memoEntries);
+    const size_t nv = fs.prog.vars.size(), nf = fs.names.size();
+
+    ifstream file;
+    if (dataPath != "-") {
+        file.open(dataPath, ios::binary);
+        if (!file) throw runtime_error("Cannot open " + dataPath);
+    }
+    istream& in = dataPath == "-" ? cin : file;
+    const string source = dataPath == "-" ? "stdin" : dataPath;
+
+    // Which variable each CSV field feeds, or -1
+    string line;
+    if (!getline(in, line)) throw runtime_error(source + " is empty");
+    vector<string> header;
+    {
+        stringstream ss(line);
+        for (string h; getline(ss, h, ','); ) header.push_back(trim(h));
+    }
+    vector<int> fieldVar(header.size(), -1);
+    for (size_t v = 0; v < nv; ++v) {
+        auto it = find(header.begin(), header.end(), fs.prog.vars[v]);
+        if (it == header.end()) throw runtime_error("No column named " + fs.prog.vars[v] + " in " + source);
+        fieldVar[it - header.begin()] = v;
+    }
+
+    const size_t blockRows = 1 << 16;
+    vector<vector<double>> vals(nv, vector<double>(blockRows)), outs(nf, vector<double>(blockRows));
+    vector<const double*> valPtrs;
+    vector<double*> outPtrs;
+    for (auto &v : vals) valPtrs.push_back(v.data());
+    for (auto &o : outs) outPtrs.push_back(o.data());
+
+    string text;
+    for (size_t k = 0; k < nf; ++k) text += (k ? "," : "") + fs.names[k];
+    text += '\n';
+    cout << text;
+
+    const NumberFormat shortest{NumberFormat::Shortest};
+    size_t rows = 0;
+    MemoStats memo;
+    for (size_t lineNo = 2; ; ) {
+        size_t n = 0;
+        for (; n < blockRows && getline(in, line); ++lineNo) {
+            if (trim(line).empty()) continue;
+            size_t field = 0, start = 0;
+            for (;; ++field) {
+                size_t comma = line.find(',', start);
+                size_t stop  = comma == string::npos ? line.size() : comma;
+                if (field < fieldVar.size() && fieldVar[field] >= 0) {
+                    const char* b = line.data() + start;
+                    const char* e = line.data() + stop;
+                    while (b < e && isspace((unsigned char)*b)) ++b;
+                    while (e > b && isspace((unsigned char)e[-1])) --e;
+                    if (b < e && *b == '+') ++b;
+                    auto [ptr, ec] = from_chars(b, e, vals[fieldVar[field]][n]);
+                    if (ec != errc() || ptr != e || b == e)
+                        throw runtime_error(source + ":" + to_string(lineNo) + ": not a number: '" +
+                                            string(line, start, stop - start) + "'");
+                }
+                if (comma == string::npos) break;
+                start = comma + 1;
+            }
+            if (field + 1 != header.size())
+                throw runtime_error(source + ":" + to_string(lineNo) + ": expected " +
+                                    to_string(header.size()) + " fields, found " + to_string(field + 1));
+            ++n;
+        }
+        if (n == 0) break;
+        evaluateColumns(fs.prog, valPtrs.data(), n, outPtrs.data(), &memo);
+
+        text.resize(n * nf * numberBufferSize);
+        char* p = text.data();
+        for (size_t i = 0; i < n; ++i)
+            for (size_t k = 0; k < nf; ++k) {
+                p = formatNumber(p, outs[k][i], shortest);
+                *p++ = k + 1 < nf ? ',' : '\n';
+            }
+        cout.write(text.data(), p - text.data());
+        rows += n;
+    }
+    cout.flush();
+    if (!cout) throw runtime_error("Cannot write output");
+    cerr << "✓ " << rows << " row(s), " << nf << " formula(s), "
+         << fs.prog.code.size() - 1 << " operation(s) per row";
+    if (fs.prog.shared) cerr << " (" << fs.prog.shared << " repeated operation(s) shared)";
+    cerr << "\n";
+    if (!fs.prog.memoOps.empty()) {
+        cerr << "  " << fs.prog.memoOps.size() << " cached call(s), "
+             << memoStateSize(fs.prog.view()) * sizeof(double) / 1024 << " KB of cache per thread\n";
+        memo.print(cerr);
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+// columns.h
+// Formula columns
+//
+// --columns evaluates every formula of a formula file on each row of a CSV
+// table and writes one column per formula.  The formulas are compiled
+// together by compileAll, so a piece that several of them use (ln(s/k),
+// sqrt(t), ...) is computed once per row, and a single executeBatch pass
+// fills every column.  Rows are read, evaluated on the thread pool and
+// written a block at a time, so a table of any length streams through.
+//
+// The file may declare tables for its formulas to use, and --memo caches
+// pow/exp/ln/trig results per call site, which pays when columns repeat
+// values (ages, ratings, a few rates); the hit rates go to stderr.
+
+#pragma once
+
+#include "vm.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The formulas of a file as one program over the union of their
+// parameters (in order of first appearance); outputs follow file order
+struct FormulaSet {
+    std::vector<std::string> names;
+    Program                  prog;
+};
+
+FormulaSet compileFormulaSet(const std::string& path, uint32_t memoEntries = 0);
+
+// outs[k][i] = formula k on row i of the input columns; memo adds up the
+// cache counters of every thread
+void evaluateColumns(const Program& prog, const double* const* vars, size_t n,
+                     double* const* outs, MemoStats* memo = nullptr);
+
+// --columns formulas.txt [data.csv] [--memo[=N]]: the CSV header names the
+// columns (extra columns are ignored); with no file, or "-", the table is
+// stdin.  memoEntries is the cache size per call site, 0 for none.
+int runColumns(const std::string& formulaPath, const std::string& dataPath, uint32_t memoEntries = 0);
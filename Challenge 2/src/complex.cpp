@@ -0,0 +1,158 @@
+// complex.cpp
+// Complex mode (see complex.h)
+
+#include "complex.h"
+#include "errors.h"
+#include "parser.h"
+#include "tables.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+static inline Cx cxMul(Cx a, Cx b) { return {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re}; }
+
+// Smith's algorithm: no overflow from squaring |b|
+static inline Cx cxDiv(Cx a, Cx b) {
+    if (fabs(b.re) >= fabs(b.im)) {
+        double r = b.im / b.re, d = b.re + b.im * r;
+        return {(a.re + a.im * r) / d, (a.im - a.re * r) / d};
+    }
+    double r = b.re / b.im, d = b.re * r + b.im;
+    return {(a.re * r + a.im) / d, (a.im * r - a.re) / d};
+}
+
+static inline Cx cxExp(Cx a)  { double m = exp(a.re); return {m * cos(a.im), m * sin(a.im)}; }
+// Branch cuts follow the principal value; a -0 imaginary part (from -x)
+// is taken as +0 so that ln(-2) and sqrt(-1) land on the upper side
+static inline Cx cxLn(Cx a)   { return {log(hypot(a.re, a.im)), atan2(a.im + 0.0, a.re)}; }
+static inline Cx cxLog(Cx a)  { Cx l = cxLn(a); return {l.re / M_LN10, l.im / M_LN10}; }
+static inline Cx cxSin(Cx a)  { return {sin(a.re) * cosh(a.im), cos(a.re) * sinh(a.im)}; }
+static inline Cx cxCos(Cx a)  { return {cos(a.re) * cosh(a.im), -sin(a.re) * sinh(a.im)}; }
+static inline Cx cxTan(Cx a)  { return cxDiv(cxSin(a), cxCos(a)); }
+
+// Principal square root
+static inline Cx cxSqrt(Cx a) {
+    if (a.re == 0 && a.im == 0) return {0, 0};
+    double t = sqrt(0.5 * (hypot(a.re, a.im) + fabs(a.re)));
+    if (a.re >= 0) return {t, a.im / (2 * t)};
+    return {fabs(a.im) / (2 * t), a.im < 0 ? -t : t};
+}
+
+// Whole exponents use repeated squaring so i^2 is exactly -1
+static inline Cx cxPow(Cx a, Cx b) {
+    if (b.im == 0 && b.re == floor(b.re) && fabs(b.re) <= 64) {
+        Cx r = {1, 0}, base = a;
+        for (int e = (int)fabs(b.re); e; e >>= 1, base = cxMul(base, base))
+            if (e & 1) r = cxMul(r, base);
+        return b.re < 0 ? cxDiv({1, 0}, r) : r;
+    }
+    if (a.re == 0 && a.im == 0) return b.re > 0 ? Cx{0, 0} : Cx{NAN, NAN};
+    return cxExp(cxMul(b, cxLn(a)));
+}
+
+ComplexMachine::ComplexMachine(const ProgramView& p)
+    : prog(p), re((size_t)p.nregs * batchLanes), im((size_t)p.nregs * batchLanes) {
+    for (uint32_t k = 0; k < p.nconsts; ++k)
+        fill_n(&re[(size_t)(p.nvars + k) * batchLanes], batchLanes, p.consts[k]);
+}
+
+void executeComplexBatch(ComplexMachine& m, const double* const* varRe, const double* const* varIm,
+                         size_t n, double* outRe, double* outIm) {
+    const size_t W = batchLanes;
+    for (size_t base = 0; base < n; base += W) {
+        const size_t cnt = min(W, n - base);
+        for (uint32_t v = 0; v < m.prog.nvars; ++v) {
+            copy(varRe[v] + base, varRe[v] + base + cnt, &m.re[(size_t)v * W]);
+            copy(varIm[v] + base, varIm[v] + base + cnt, &m.im[(size_t)v * W]);
+        }
+        int zeroDivisor = 0;
+        for (const Instr* in = m.prog.code; ; ++in) {
+            double*       dr = &m.re[(size_t)in->dst * W];
+            double*       di = &m.im[(size_t)in->dst * W];
+            const double* ar = &m.re[(size_t)in->a * W];
+            const double* ai = &m.im[(size_t)in->a * W];
+            const double* br = &m.re[(size_t)in->b * W];
+            const double* bi = &m.im[(size_t)in->b * W];
+            const double* cr = &m.re[(size_t)in->c * W];
+            const double* ci = &m.im[(size_t)in->c * W];
+// split form for cheap ops, Cx helpers for the rest
+#define CLANES(re_, im_) \
+    for (size_t l = 0; l < cnt; ++l) { double r_ = (re_), i_ = (im_); dr[l] = r_; di[l] = i_; } break
+#define CFUNC(expr) \
+    for (size_t l = 0; l < cnt; ++l) { Cx z_ = (expr); dr[l] = z_.re; di[l] = z_.im; } break
+#define A Cx{ar[l], ai[l]}
+#define B Cx{br[l], bi[l]}
+            switch (in->op) {
+                case OP_ADD:    CLANES(ar[l] + br[l], ai[l] + bi[l]);
+                case OP_SUB:    CLANES(ar[l] - br[l], ai[l] - bi[l]);
+                case OP_MUL:    CLANES(ar[l] * br[l] - ai[l] * bi[l], ar[l] * bi[l] + ai[l] * br[l]);
+                case OP_DIV:
+                    for (size_t l = 0; l < cnt; ++l) zeroDivisor |= br[l] == 0 && bi[l] == 0;
+                    CFUNC(cxDiv(A, B));
+                case OP_POW:    CFUNC(cxPow(A, B));
+                case OP_SIN:    CFUNC(cxSin(A));
+                case OP_COS:    CFUNC(cxCos(A));
+                case OP_TAN:    CFUNC(cxTan(A));
+                case OP_SQRT:   CFUNC(cxSqrt(A));
+                case OP_LOG:    CFUNC(cxLog(A));
+                case OP_LN:     CFUNC(cxLn(A));
+                case OP_EXP:    CFUNC(cxExp(A));
+                case OP_NEG:    CLANES(-ar[l], -ai[l]);
+                case OP_ABS:    CLANES(hypot(ar[l], ai[l]), 0);
+                case OP_MULADD: CLANES(ar[l] * br[l] - ai[l] * bi[l] + cr[l],
+                                       ar[l] * bi[l] + ai[l] * br[l] + ci[l]);
+                case OP_MULSUB: CLANES(ar[l] * br[l] - ai[l] * bi[l] - cr[l],
+                                       ar[l] * bi[l] + ai[l] * br[l] - ci[l]);
+                case OP_SQR:    CLANES(ar[l] * ar[l] - ai[l] * ai[l], 2 * ar[l] * ai[l]);
+                case OP_MULSIN: CFUNC(cxMul(A, cxSin(B)));
+                case OP_MULCOS: CFUNC(cxMul(A, cxCos(B)));
+                default:        CLANES(NAN, NAN);   // orderings: evalComplex refuses them
+                case OP_RET:
+                    copy(ar, ar + cnt, outRe + base);
+                    copy(ai, ai + cnt, outIm + base);
+                    goto nextBlock;
+            }
+#undef CLANES
+#undef CFUNC
+#undef A
+#undef B
+        }
+    nextBlock:
+        m.divByZero = m.divByZero || zeroDivisor;
+    }
+}
+
+Cx evalComplex(const string& expr) {
+    auto tokens = tokenize(expr, {"i"});
+    for (auto &t : tokens)   // complex numbers have no order
+        if ((t.type == OPERATOR && isComparison(t.text)) ||
+            (t.type == FUNCTION && functionArgs.count(t.text)))
+            throw runtime_error(errorMessage(CalcError::RealOnly, t.text));
+        else if (t.type == FUNCTION && findTable(t.text) >= 0)
+            throw runtime_error("Table " + t.text + " is sampled on real numbers only (type \"mode real\")");
+    Program prog = compile(infixToPostfix(tokens), {"i"});
+    ComplexMachine m(prog.view());
+    const double zero = 0, one = 1;
+    const double* re[1] = {&zero};
+    const double* im[1] = {&one};
+    Cx z;
+    executeComplexBatch(m, re, im, 1, &z.re, &z.im);
+    if (m.divByZero) throw runtime_error("Cannot divide by zero");
+    return z;
+}
+
+string formatComplex(Cx z, const NumberFormat& f) {
+    char buf[2 * numberBufferSize + 4];
+    char* p = formatNumber(buf, z.re, f);
+    const bool hidden = f.mode == NumberFormat::Fixed ? fabs(z.im) < 0.5 * pow(10.0, -f.digits)
+                                                      : fabs(z.im) <= 1e-14 * fabs(z.re);
+    if (!hidden || isnan(z.im)) {
+        p = copy_n(signbit(z.im) ? " - " : " + ", 3, p);
+        p = formatNumber(p, fabs(z.im), f);
+        *p++ = 'i';
+    }
+    return string(buf, p);
+}
@@ -0,0 +1,38 @@
+// complex.h
+// Complex mode
+//
+// "mode complex" runs the same compiled programs over complex values, with
+// i compiled as a variable whose register holds 0+1i.  Registers are split
+// into real and imaginary rows (SoA), so the batch kernels are plain double
+// loops the compiler can vectorize instead of std::complex one element at a
+// time.
+
+#pragma once
+
+#include "format.h"
+#include "vm.h"
+
+#include <string>
+#include <vector>
+
+struct Cx { double re, im; };
+
+// Real and imaginary register rows for one thread running one program
+struct ComplexMachine {
+    ProgramView         prog;
+    std::vector<double> re, im;          // prog.nregs rows of batchLanes each
+    bool                divByZero = false;
+
+    explicit ComplexMachine(const ProgramView& p);
+};
+
+// out[j] = program(vars[0][j], vars[1][j], ...) with complex variables
+void executeComplexBatch(ComplexMachine& m, const double* const* varRe, const double* const* varIm,
+                         size_t n, double* outRe, double* outIm);
+
+// Evaluate one expression in complex mode
+Cx evalComplex(const std::string& expr);
+
+// "a + bi" / "a - bi", or just "a" when the imaginary part rounds to zero
+// (in fixed mode) or is below 1e-14 of the real part (otherwise)
+std::string formatComplex(Cx z, const NumberFormat& f);
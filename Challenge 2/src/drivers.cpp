@@ -0,0 +1,196 @@
+// drivers.cpp
+// Driver calls (see drivers.h)
+
+#include "drivers.h"
+#include "format.h"
+#include "formulas.h"
+#include "numeric.h"
+#include "parser.h"
+#include "random.h"
+#include "sampling.h"
+#include "tables.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+bool parseRange(const string& arg, string& name, vector<double>& values) {
+    size_t eq = arg.find('=');
+    if (eq == string::npos) return false;
+    name = trim(arg.substr(0, eq));
+    string spec = arg.substr(eq + 1);
+    vector<string> parts;
+    for (size_t start = 0, colon; ; start = colon + 1) {
+        colon = spec.find(':', start);
+        parts.push_back(spec.substr(start, colon - start));
+        if (colon == string::npos) break;
+    }
+    if (!isName(name) || (parts.size() != 2 && parts.size() != 3))
+        throw runtime_error("Ranges look like p = 1 : 100 [: step]");
+    double from = evalArg(parts[0]), to = evalArg(parts[1]);
+    double step = parts.size() == 3 ? evalArg(parts[2]) : 1;
+    if (!(step > 0)) throw runtime_error("Range step must be positive");
+    double count = floor((to - from) / step + 1e-9) + 1;
+    if (!(count >= 1 && count <= 1e8)) throw runtime_error("Range is empty or too large");
+    values.resize((size_t)count);
+    for (size_t i = 0; i < values.size(); ++i) values[i] = from + step * i;
+    return true;
+}
+
+bool callDriver(const string& line, double& result, string& note, ostream& os) {
+    size_t lp = line.find('(');
+    if (lp == string::npos || line.back() != ')') return false;
+    int depth = 0;   // the call must be the whole line: not min(a, b) + max(c, d)
+    for (size_t i = lp; i + 1 < line.size(); ++i) {
+        depth += line[i] == '(' ? 1 : line[i] == ')' ? -1 : 0;
+        if (depth == 0) return false;
+    }
+    string name = trim(line.substr(0, lp));
+    static const map<string,Reduction> reductions = {
+        {"sum", Reduction::Sum}, {"prod", Reduction::Prod},
+        {"min", Reduction::Min}, {"max", Reduction::Max}
+    };
+    if (name != "integrate" && name != "solve" && name != "minimize" && name != "mc" &&
+        name != "sample" && !reductions.count(name)) return false;
+    vector<string> args = splitTopLevel(line.substr(lp + 1, line.size() - lp - 2));
+
+    if (reductions.count(name)) {
+        if (args.size() != 4) return false;   // not the range form
+        const string& var = args[0];
+        if (!isName(var)) throw runtime_error("Bad variable name: " + var);
+        Program body = compile(infixToPostfix(tokenize(args[3], {var})), {var});
+        double from = evalArg(args[1]), to = evalArg(args[2]);
+        if (!isfinite(from) || !isfinite(to) || to - from >= 9e15)
+            throw runtime_error("Range must be finite and below 2^53 terms");
+        uint64_t count = to < from ? 0 : (uint64_t)floor(to - from) + 1;
+        result = reduceRange(body.view(), from, count, reductions.at(name));
+        return true;
+    }
+
+    if (name == "mc") {
+        if (args.size() != 2 && args.size() != 3)
+            throw runtime_error("usage: mc(expr, N [, seed])");
+        auto tokens = tokenize(args[0]);
+        vector<string> names = randomVariables(tokens);
+        Program body = compile(infixToPostfix(tokens), names);
+        double n = evalArg(args[1]);
+        if (!(n >= 1 && n <= 9e15)) throw runtime_error("Sample count must be between 1 and 2^53");
+        uint64_t seed = defaultSeed();
+        if (args.size() == 3) {
+            const double s = evalArg(args[2]);
+            if (!(s >= 0 && s < 18446744073709551616.0 && s == floor(s)))
+                throw runtime_error("Seed must be a whole number from 0 to 2^64 - 1");
+            seed = (uint64_t)s;
+        }
+        Moments r = monteCarlo(body.view(), names, (uint64_t)n, seed);
+        ostringstream s;
+        s << "standard error " << setprecision(3) << sqrt(r.variance() / r.count)
+          << " over " << r.count << " samples, seed " << seed;
+        note = s.str();
+        result = r.mean;
+        return true;
+    }
+
+    if (name == "sample") {
+        // an optional last argument naming a .csv or .bin file
+        string path;
+        if (args.size() >= 5) {
+            const string& last = args.back();
+            for (const char* ext : {".csv", ".bin"})
+                if (last.size() > 4 && last.compare(last.size() - 4, 4, ext) == 0) path = last;
+            if (!path.empty()) args.pop_back();
+        }
+        if (args.size() != 4 && args.size() != 5)
+            throw runtime_error("usage: sample(expr, x, a, b [, tol] [, file.csv | file.bin])");
+        const string& var = args[1];
+        if (!isName(var)) throw runtime_error("Bad variable name: " + var);
+        Program f = compile(infixToPostfix(tokenize(args[0], {var})), {var});
+        double tol = args.size() == 5 ? evalArg(args[4]) : 1e-3;
+        if (!(tol > 0)) throw runtime_error("Tolerance must be positive");
+        SampleResult r = sampleAdaptive(f.view(), evalArg(args[2]), evalArg(args[3]), tol);
+        ostringstream s;
+        s << r.points.size() << " points after " << r.levels << " refinement level(s)";
+        if (r.truncated) s << ", stopped at the point budget";
+        if (!path.empty()) {
+            writeSamples(path, r.points);
+            s << ", written to " << path;
+        }
+        else if (r.points.size() <= 600) {
+            const NumberFormat exact{NumberFormat::Shortest};
+            os << "  " << var << ", y\n";
+            for (auto &p : r.points) {
+                os << "  " << formatNumber(p.x, exact);
+                os << ", " << formatNumber(p.y, exact) << "\n";
+            }
+        }
+        else s << "; add a .csv or .bin file name to save them";
+        note = s.str();
+        result = r.points.size();
+        return true;
+    }
+
+    if (name == "integrate") {
+        if (args.size() != 4 && args.size() != 5)
+            throw runtime_error("usage: integrate(expr, x, a, b [, tol])");
+        const string& var = args[1];
+        if (!isName(var)) throw runtime_error("Bad variable name: " + var);
+        Program f = compile(infixToPostfix(tokenize(args[0], {var})), {var});
+        double tol = args.size() == 5 ? evalArg(args[4]) : 1e-10;
+        if (!(tol > 0)) throw runtime_error("Tolerance must be positive");
+        Integral r = integrate(f.view(), evalArg(args[2]), evalArg(args[3]), tol);
+        if (!r.converged) {
+            ostringstream s;
+            s << "integral did not reach the tolerance (error estimate "
+              << scientific << setprecision(2) << r.error << ")";
+            note = s.str();
+        }
+        result = r.value;
+    }
+    else {   // solve / minimize
+        bool minimize = name == "minimize";
+        if (!minimize && args.size() == 2) return false;   // linear solve(A, b)
+        if (args.size() != 4 && args.size() != 5)
+            throw runtime_error("usage: " + name + "(expr, x, a, b [, p = from : to [: step]])");
+        vector<string> vars = {args[1]};
+        if (!isName(vars[0])) throw runtime_error("Bad variable name: " + vars[0]);
+        string param;
+        vector<double> values;
+        if (args.size() == 5) {
+            if (!parseRange(args[4], param, values))
+                throw runtime_error("Ranges look like p = 1 : 100 [: step]");
+            vars.push_back(param);
+        }
+        Objective o = compileObjective(args[0], vars);
+        double a = evalArg(args[2]), b = evalArg(args[3]);
+
+        if (args.size() == 5) {   // batch: one instance per parameter value
+            vector<double> xs = solveBatch(o, minimize, a, b, values);
+            const NumberFormat exact{NumberFormat::Shortest};
+            os << "  " << param << ", " << vars[0] << "\n";
+            for (size_t i = 0; i < xs.size(); ++i) {
+                os << "  " << formatNumber(values[i], exact);
+                os << ", " << formatNumber(xs[i], exact) << "\n";
+            }
+            result = xs.back();
+            note = to_string(count_if(xs.begin(), xs.end(), [](double x) { return isnan(x); })) +
+                   " of " + to_string(xs.size()) + " instances failed";
+            if (note[0] == '0') note.clear();
+        }
+        else {
+            ObjectiveRunner r(o);
+            result = minimize ? findMinimum(r, a, b) : findRoot(r, a, b).get();
+            r.check();
+            if (minimize) {
+                ostringstream s;
+                s << "minimum value " << setprecision(10) << r.f(result);
+                note = s.str();
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,18 @@
+// drivers.h
+// Driver calls
+//
+// Whole-line calls such as integrate(x^2, x, 0, 1) that take an expression
+// in a named variable and run it many times on the compiled fast paths.
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Parse "name = from : to [: step]" into the list of values it covers
+bool parseRange(const std::string& arg, std::string& name, std::vector<double>& values);
+
+// If line is a driver call, run it and return true.  `note` collects
+// warnings; tables (batch forms) are written to os.
+bool callDriver(const std::string& line, double& result, std::string& note, std::ostream& os);
@@ -0,0 +1,27 @@
+// errors.cpp
+// Error codes and their messages (see errors.h)
+
+#include "errors.h"
+
+using namespace std;
+
+string errorMessage(CalcError e, const string& detail) {
+    switch (e) {
+        case CalcError::None:              return "";
+        case CalcError::DivideByZero:      return "Cannot divide by zero";
+        case CalcError::InvalidExpression: return "Invalid expression";
+        case CalcError::UnknownName:       return "Unknown name: " + detail;
+        case CalcError::InvalidCharacter:  return "Invalid character: " + detail;
+        case CalcError::InvalidLiteral:    return "Invalid literal: " + detail;
+        case CalcError::LiteralTooLarge:   return "Literal does not fit in 64 bits: " + detail;
+        case CalcError::Unexpected:        return "Unexpected '" + detail + "'";
+        case CalcError::NeedsIntegerMode:  return "'" + detail + "' needs integer mode (type \"mode integer\")";
+        case CalcError::WholeNumbersOnly:  return "'" + detail + "' works on whole numbers only, e.g. 0xff & 12";
+        case CalcError::NoBracketedRoot:   return "f has the same sign at both ends; no bracketed root";
+        case CalcError::TooLong:           return "Expression is longer than " + detail + " characters (see \"limits\")";
+        case CalcError::TooDeep:           return "Expression nests deeper than " + detail + " levels (see \"limits\")";
+        case CalcError::RealOnly:          return "'" + detail + "' compares numbers, so it needs real mode (type \"mode real\")";
+        case CalcError::Overflow:          return "Result does not fit in a 64-bit integer (write 2.0^70 for floating point)";
+    }
+    return "Error";
+}
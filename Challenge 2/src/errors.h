@@ -0,0 +1,40 @@
+// errors.h
+// Why parsing or evaluation failed.  tokenize, infixToPostfix, evalPostfix
+// and the VM report these codes instead of throwing, so batch jobs where
+// many rows hit an error do not pay for unwinding; the throwing wrappers
+// the REPL uses turn them into the usual messages.
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+enum class CalcError : uint8_t {
+    None, DivideByZero, InvalidExpression, UnknownName, InvalidCharacter,
+    InvalidLiteral, LiteralTooLarge, Unexpected, NeedsIntegerMode, WholeNumbersOnly,
+    NoBracketedRoot, TooLong, TooDeep, RealOnly, Overflow
+};
+
+// The friendly message for an error; detail is the offending name or text
+std::string errorMessage(CalcError e, const std::string& detail = "");
+
+// A value or the reason there is none (an expected-style result).  detail
+// is only filled in on the error path.
+template<class T>
+struct Result {
+    T           value{};
+    CalcError   error = CalcError::None;
+    std::string detail;
+
+    Result() = default;
+    Result(T v) : value(std::move(v)) {}
+    Result(CalcError e, std::string d = "") : error(e), detail(std::move(d)) {}
+    bool ok() const { return error == CalcError::None; }
+    // The value, or the error as a runtime_error for callers that want one
+    T get() && {
+        if (!ok()) throw std::runtime_error(errorMessage(error, detail));
+        return std::move(value);
+    }
+};
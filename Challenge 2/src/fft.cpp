@@ -0,0 +1,327 @@
+// fft.cpp
+// FFT (see fft.h)
+
+#include "fft.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"   // local vec4 helpers, as in simd.h
+#endif
+
+static inline double broadcast(double x, const double&) { return x; }
+static inline vec4   broadcast(double x, const vec4&)   { return splat4(x); }
+
+// DFT of R = 2, 3 or 4 points; T is double, or vec4 for four sub-transforms
+// side by side
+template <int R, class T>
+static inline void butterfly(const T* ar, const T* ai, T* br, T* bi) {
+    if constexpr (R == 2) {
+        br[0] = ar[0] + ar[1]; bi[0] = ai[0] + ai[1];
+        br[1] = ar[0] - ar[1]; bi[1] = ai[0] - ai[1];
+    }
+    else if constexpr (R == 4) {
+        T t0r = ar[0] + ar[2], t0i = ai[0] + ai[2];
+        T t1r = ar[0] - ar[2], t1i = ai[0] - ai[2];
+        T t2r = ar[1] + ar[3], t2i = ai[1] + ai[3];
+        T t3r = ai[1] - ai[3], t3i = ar[3] - ar[1];   // (a1 - a3) * -i
+        br[0] = t0r + t2r; bi[0] = t0i + t2i;
+        br[1] = t1r + t3r; bi[1] = t1i + t3i;
+        br[2] = t0r - t2r; bi[2] = t0i - t2i;
+        br[3] = t1r - t3r; bi[3] = t1i - t3i;
+    }
+    else {
+        static_assert(R == 3, "radix 2, 3 or 4");
+        const T h    = broadcast(0.86602540378443864676, ar[0]);   // sin(2pi/3)
+        const T half = broadcast(0.5, ar[0]);
+        T sr = ar[1] + ar[2], si = ai[1] + ai[2];
+        T dr = ar[1] - ar[2], di = ai[1] - ai[2];
+        T tr = ar[0] - half * sr, ti = ai[0] - half * si;
+        br[0] = ar[0] + sr; bi[0] = ai[0] + si;
+        br[1] = tr + h * di; bi[1] = ti - h * dr;
+        br[2] = tr - h * di; bi[2] = ti + h * dr;
+    }
+}
+
+// One radix-R stage: y[q + s(Rp + j)] = tw[j m + p] * DFT_R(x[q + s(p + k m)])_j
+// From the second stage on the stride s is at least 2, and once it reaches
+// 4 the q loop runs four butterflies at a time on contiguous vec4 loads.
+template <int R>
+static void fftStage(const FftPlan& plan, const FftStage& st, const double* xr, const double* xi,
+                     double* yr, double* yi, size_t p0, size_t p1, size_t q0, size_t q1, int radix) {
+    const int    r = R ? R : radix;
+    const size_t s = st.stride, m = st.n / r;
+    const double* twr = &plan.twRe[st.tw];
+    const double* twi = &plan.twIm[st.tw];
+    // roots of unity for the generic radix
+    double wr[64], wi[64];
+    if (!R) for (int k = 0; k < r; ++k) { wr[k] = cos(-2 * M_PI * k / r); wi[k] = sin(-2 * M_PI * k / r); }
+
+    for (size_t p = p0; p < p1; ++p) {
+        size_t q = q0;
+        if constexpr (R != 0) {
+            if (s >= 4) {
+                vec4 cr[R], ci[R];
+                for (int j = 0; j < R; ++j) {
+                    cr[j] = splat4(twr[j * m + p]);
+                    ci[j] = splat4(twi[j * m + p]);
+                }
+                for (; q + 4 <= q1; q += 4) {
+                    vec4 ar[R], ai[R], br[R], bi[R];
+                    for (int k = 0; k < R; ++k) {
+                        ar[k] = load4(xr + q + s * (p + k * m));
+                        ai[k] = load4(xi + q + s * (p + k * m));
+                    }
+                    butterfly<R>(ar, ai, br, bi);
+                    for (int j = 0; j < R; ++j) {
+                        store4(yr + q + s * (R * p + j), br[j] * cr[j] - bi[j] * ci[j]);
+                        store4(yi + q + s * (R * p + j), br[j] * ci[j] + bi[j] * cr[j]);
+                    }
+                }
+            }
+        }
+        for (; q < q1; ++q) {
+            double ar[R ? R : 64], ai[R ? R : 64], br[R ? R : 64], bi[R ? R : 64];
+            for (int k = 0; k < r; ++k) {
+                ar[k] = xr[q + s * (p + k * m)];
+                ai[k] = xi[q + s * (p + k * m)];
+            }
+            if constexpr (R != 0) butterfly<R>(ar, ai, br, bi);
+            else {
+                for (int j = 0; j < r; ++j) {
+                    double sr = 0, si = 0;
+                    for (int k = 0; k < r; ++k) {
+                        int e = (j * k) % r;
+                        sr += ar[k] * wr[e] - ai[k] * wi[e];
+                        si += ar[k] * wi[e] + ai[k] * wr[e];
+                    }
+                    br[j] = sr; bi[j] = si;
+                }
+            }
+            for (int j = 0; j < r; ++j) {
+                double cr = twr[j * m + p], ci = twi[j * m + p];
+                yr[q + s * (r * p + j)] = br[j] * cr - bi[j] * ci;
+                yi[q + s * (r * p + j)] = br[j] * ci + bi[j] * cr;
+            }
+        }
+    }
+}
+
+void fftForward(const FftPlan& plan, double* re, double* im, vector<double>& scratch) {
+    const size_t n = plan.n;
+    if (n <= 1) return;
+
+    if (plan.inner) {   // Bluestein: X = chirp * (conv(x * chirp, filter))
+        const FftPlan& in = *plan.inner;
+        const size_t m = in.n;
+        vector<double> ar(m, 0.0), ai(m, 0.0), sub;
+        for (size_t k = 0; k < n; ++k) {
+            ar[k] = re[k] * plan.chirpRe[k] - im[k] * plan.chirpIm[k];
+            ai[k] = re[k] * plan.chirpIm[k] + im[k] * plan.chirpRe[k];
+        }
+        fftForward(in, ar.data(), ai.data(), sub);
+        for (size_t k = 0; k < m; ++k) {   // multiply, then inverse via conjugation
+            double r = ar[k] * plan.filterRe[k] - ai[k] * plan.filterIm[k];
+            double i = ar[k] * plan.filterIm[k] + ai[k] * plan.filterRe[k];
+            ar[k] = r;
+            ai[k] = -i;
+        }
+        fftForward(in, ar.data(), ai.data(), sub);
+        for (size_t k = 0; k < n; ++k) {
+            double r = ar[k] / m, i = -ai[k] / m;
+            re[k] = r * plan.chirpRe[k] - i * plan.chirpIm[k];
+            im[k] = r * plan.chirpIm[k] + i * plan.chirpRe[k];
+        }
+        return;
+    }
+
+    scratch.resize(2 * n);
+    double *xr = re, *xi = im, *yr = scratch.data(), *yi = scratch.data() + n;
+    for (const FftStage& st : plan.stages) {
+        const size_t m = st.n / st.radix;
+        auto run = [&](size_t p0, size_t p1, size_t q0, size_t q1) {
+            switch (st.radix) {
+                case 2:  fftStage<2>(plan, st, xr, xi, yr, yi, p0, p1, q0, q1, 2); break;
+                case 3:  fftStage<3>(plan, st, xr, xi, yr, yi, p0, p1, q0, q1, 3); break;
+                case 4:  fftStage<4>(plan, st, xr, xi, yr, yi, p0, p1, q0, q1, 4); break;
+                default: fftStage<0>(plan, st, xr, xi, yr, yi, p0, p1, q0, q1, st.radix); break;
+            }
+        };
+        const size_t s = st.stride;
+        if (n < (1 << 15) || threadPool().size() == 1) run(0, m, 0, s);
+        else {
+            // split whichever of the p and stride ranges is longer
+            const bool byP = m >= s;
+            const size_t total = byP ? m : s;
+            const size_t chunk = max<size_t>(1, total / (8 * threadPool().size()));
+            atomic<size_t> next{0};
+            threadPool().parallel([&](unsigned) {
+                for (size_t i; (i = next.fetch_add(chunk)) < total; ) {
+                    size_t j = min(total, i + chunk);
+                    if (byP) run(i, j, 0, s);
+                    else     run(0, m, i, j);
+                }
+            });
+        }
+        swap(xr, yr);
+        swap(xi, yi);
+    }
+    if (xr != re) {
+        copy(xr, xr + n, re);
+        copy(xi, xi + n, im);
+    }
+}
+
+void fftInverse(const FftPlan& plan, double* re, double* im, vector<double>& scratch) {
+    const size_t n = plan.n;
+    for (size_t k = 0; k < n; ++k) im[k] = -im[k];
+    fftForward(plan, re, im, scratch);
+    for (size_t k = 0; k < n; ++k) {
+        re[k] /= n;
+        im[k] = -im[k] / n;
+    }
+}
+
+// A new plan: factorization and twiddles, or Bluestein's chirp and filter
+static unique_ptr<FftPlan> buildPlan(size_t n) {
+    auto built = make_unique<FftPlan>();
+    FftPlan& plan = *built;
+    plan.n = n;
+
+    // factor: 4s first, then 2, 3, and remaining primes
+    vector<int> radices;
+    size_t rest = n;
+    while (rest % 4 == 0) { radices.push_back(4); rest /= 4; }
+    for (size_t f = 2; f <= 64 && rest > 1; ++f)
+        while (rest % f == 0) { radices.push_back(f); rest /= f; }
+    if (rest > 1) {   // a prime factor above 64: Bluestein
+        size_t m = 1;
+        while (m < 2 * n - 1) m *= 2;
+        plan.chirpRe.resize(n);
+        plan.chirpIm.resize(n);
+        for (size_t k = 0; k < n; ++k) {
+            double a = -M_PI * (double)((uint64_t)k * k % (2 * n)) / n;
+            plan.chirpRe[k] = cos(a);
+            plan.chirpIm[k] = sin(a);
+        }
+        plan.filterRe.assign(m, 0.0);
+        plan.filterIm.assign(m, 0.0);
+        for (size_t k = 0; k < n; ++k) {
+            plan.filterRe[k] = plan.chirpRe[k];
+            plan.filterIm[k] = -plan.chirpIm[k];
+            if (k) {
+                plan.filterRe[m - k] = plan.chirpRe[k];
+                plan.filterIm[m - k] = -plan.chirpIm[k];
+            }
+        }
+        plan.inner = &fftPlan(m);
+        vector<double> scratch;
+        fftForward(*plan.inner, plan.filterRe.data(), plan.filterIm.data(), scratch);
+        return built;
+    }
+
+    size_t len = n, stride = 1;
+    for (int r : radices) {
+        FftStage st{r, len, stride, plan.twRe.size()};
+        const size_t m = len / r;
+        for (int j = 0; j < r; ++j)
+            for (size_t p = 0; p < m; ++p) {
+                double a = -2 * M_PI * (double)((uint64_t)j * p % len) / len;
+                plan.twRe.push_back(cos(a));
+                plan.twIm.push_back(sin(a));
+            }
+        plan.stages.push_back(st);
+        len = m;
+        stride *= r;
+    }
+    return built;
+}
+
+const FftPlan& fftPlan(size_t n) {
+    if (n == 0) throw runtime_error("An FFT needs at least one point");
+    static mutex lock;
+    static map<size_t, unique_ptr<FftPlan>> cache;
+    {
+        lock_guard<mutex> lk(lock);
+        auto it = cache.find(n);
+        if (it != cache.end()) return *it->second;
+    }
+    // Built outside the lock (a Bluestein plan fetches its inner plan from
+    // here) and published only once complete, so no thread ever sees a half
+    // built plan.  If another thread published first, its plan is kept.
+    auto built = buildPlan(n);
+    lock_guard<mutex> lk(lock);
+    auto &slot = cache[n];
+    if (!slot) slot = move(built);
+    return *slot;
+}
+
+// Real row/column or [re; im] -> split arrays
+static void complexArgument(const Matrix& x, const char* fn, vector<double>& re, vector<double>& im) {
+    if (x.rows == 2 && x.cols > 1) {
+        re.assign(x.data.begin(), x.data.begin() + x.cols);
+        im.assign(x.data.begin() + x.cols, x.data.end());
+    }
+    else if (x.rows == 1 || x.cols == 1) {
+        re = x.data;
+        im.assign(re.size(), 0.0);
+    }
+    else throw runtime_error(string(fn) + " needs a vector or a [re; im] matrix");
+}
+
+static Matrix complexResult(const vector<double>& re, const vector<double>& im) {
+    Matrix r(2, re.size());
+    copy(re.begin(), re.end(), r.data.begin());
+    copy(im.begin(), im.end(), r.data.begin() + re.size());
+    return r;
+}
+
+Matrix fftMatrix(const Matrix& x, bool inverse) {
+    vector<double> re, im, scratch;
+    complexArgument(x, inverse ? "ifft" : "fft", re, im);
+    if (re.empty()) throw runtime_error(string(inverse ? "ifft" : "fft") + " needs at least one element");
+    const FftPlan& plan = fftPlan(re.size());
+    if (inverse) fftInverse(plan, re.data(), im.data(), scratch);
+    else         fftForward(plan, re.data(), im.data(), scratch);
+    return complexResult(re, im);
+}
+
+Matrix convolve(const Matrix& a, const Matrix& b) {
+    if ((a.rows != 1 && a.cols != 1) || (b.rows != 1 && b.cols != 1))
+        throw runtime_error("conv needs two vectors");
+    if (a.data.empty() || b.data.empty()) throw runtime_error("conv needs two non-empty vectors");
+    const size_t na = a.data.size(), nb = b.data.size(), n = na + nb - 1;
+    Matrix out(1, n);
+    if (na * nb <= 4096) {
+        for (size_t i = 0; i < na; ++i)
+            for (size_t j = 0; j < nb; ++j) out.data[i + j] += a.data[i] * b.data[j];
+        return out;
+    }
+    size_t m = 1;
+    while (m < n) m *= 2;
+    vector<double> ar(m, 0.0), ai(m, 0.0), br(m, 0.0), bi(m, 0.0), scratch;
+    copy(a.data.begin(), a.data.end(), ar.begin());
+    copy(b.data.begin(), b.data.end(), br.begin());
+    const FftPlan& plan = fftPlan(m);
+    fftForward(plan, ar.data(), ai.data(), scratch);
+    fftForward(plan, br.data(), bi.data(), scratch);
+    for (size_t k = 0; k < m; ++k) {
+        double r = ar[k] * br[k] - ai[k] * bi[k], i = ar[k] * bi[k] + ai[k] * br[k];
+        ar[k] = r;
+        ai[k] = i;
+    }
+    fftInverse(plan, ar.data(), ai.data(), scratch);
+    copy(ar.begin(), ar.begin() + n, out.data.begin());
+    return out;
+}
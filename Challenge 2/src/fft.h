@@ -0,0 +1,47 @@
+// fft.h
+// FFT
+//
+// Mixed-radix Stockham FFT on split real/imaginary arrays.  A plan is built
+// once per size (factorization plus per-stage twiddle tables) and cached.
+// Radix 4, 2 and 3 have dedicated butterflies; other primes up to 64 use a
+// generic one, and sizes with a larger prime factor go through Bluestein's
+// chirp-z on a power-of-two plan.  Stages over large inputs are split across
+// the thread pool.
+//
+// In expressions, complex arrays are 2-row matrices [re; im]:
+//   fft(x), ifft(X)   x real (1 row / column) or [re; im]; result [re; im]
+//   conv(a, b)        linear convolution of two real vectors
+
+#pragma once
+
+#include "matrix.h"
+
+#include <vector>
+
+struct FftStage {
+    int    radix;
+    size_t n, stride;   // sub-transform length and stride at this stage
+    size_t tw;          // offset of this stage's twiddles (radix * n/radix of them)
+};
+
+struct FftPlan {
+    size_t n = 0;
+    std::vector<FftStage> stages;
+    std::vector<double>   twRe, twIm;
+    // Bluestein (stages empty): chirp, FFT of the chirp filter, and the
+    // power-of-two plan they run on
+    const FftPlan*        inner = nullptr;
+    std::vector<double>   chirpRe, chirpIm, filterRe, filterIm;
+};
+
+// Build (or fetch) the plan for length n >= 1
+const FftPlan& fftPlan(size_t n);
+
+// Forward FFT in place; scratch is resized as needed
+void fftForward(const FftPlan& plan, double* re, double* im, std::vector<double>& scratch);
+void fftInverse(const FftPlan& plan, double* re, double* im, std::vector<double>& scratch);
+
+Matrix fftMatrix(const Matrix& x, bool inverse);
+
+// Linear convolution of two real vectors (direct for small inputs)
+Matrix convolve(const Matrix& a, const Matrix& b);
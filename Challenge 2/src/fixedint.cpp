@@ -0,0 +1,263 @@
+// fixedint.cpp
+// Fixed-width integers (see fixedint.h)
+
+#include "fixedint.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+static const map<string,IntOpCode> intBinOps = {
+    {"+", IOP_ADD}, {"-", IOP_SUB}, {"*", IOP_MUL}, {"/", IOP_DIV}, {"%", IOP_MOD},
+    {"^", IOP_POW}, {"**", IOP_POW}, {"&", IOP_AND}, {"|", IOP_OR}, {"xor", IOP_XOR},
+    {"<<", IOP_SHL}, {">>", IOP_SHR}
+};
+
+bool isIntegerExpression(const TokenList& tokens) {
+    for (auto &t : tokens) {
+        if (t.type == NUMBER) {
+            if (!all_of(t.text.begin(), t.text.end(), [](unsigned char ch) { return isdigit(ch); }))
+                return false;
+        }
+        else if (t.type == OPERATOR) {
+            if (!intBinOps.count(t.text) && t.text != "neg" && t.text != "~") return false;
+        }
+        else if (t.type != LEFT_PAREN && t.type != RIGHT_PAREN) return false;
+    }
+    return true;
+}
+
+IntProgram compileInteger(const TokenList& pf, const vector<string>& vars) {
+    IntProgram prog;
+    prog.vars = vars;
+    prog.wrap = any_of(pf.begin(), pf.end(), [](const Token& t) {
+        return (t.type == OPERATOR && isBitwiseOperator(t.text)) ||
+               (t.type == NUMBER && stoull(t.text) > (uint64_t)INT64_MAX);
+    });
+    const uint32_t nv = vars.size();
+    // Operands are (is temp, index) until the constant count is known
+    struct Operand { bool temp; uint32_t index; };
+    pmr::vector<Operand> st(scratch());
+    pmr::vector<pair<IntOpCode, array<Operand,2>>> ops(scratch());   // one per instruction, temps numbered in order
+    pmr::map<uint64_t,uint32_t> constIndex(scratch());
+    ops.reserve(pf.size());
+    for (auto &tok : pf) {
+        if (tok.type == NUMBER) {
+            uint64_t v = stoull(tok.text);
+            auto it = constIndex.emplace(v, prog.consts.size()).first;
+            if (it->second == prog.consts.size()) prog.consts.push_back(v);
+            st.push_back({false, nv + it->second});
+        }
+        else if (tok.type == VARIABLE) {
+            auto it = find(vars.begin(), vars.end(), tok.text);
+            if (it == vars.end()) throw runtime_error("Unknown name: " + tok.text);
+            st.push_back({false, (uint32_t)(it - vars.begin())});
+        }
+        else if (tok.type == OPERATOR && (tok.text == "neg" || tok.text == "~")) {
+            if (st.empty()) throw runtime_error("Invalid expression");
+            Operand a = st.back();
+            st.back() = {true, (uint32_t)ops.size()};
+            ops.push_back({tok.text == "neg" ? IOP_NEG : IOP_NOT, {a, a}});
+        }
+        else if (tok.type == OPERATOR) {
+            if (st.size() < 2) throw runtime_error("Invalid expression");
+            Operand b = st.back(); st.pop_back();
+            Operand a = st.back();
+            st.back() = {true, (uint32_t)ops.size()};
+            ops.push_back({intBinOps.at(tok.text), {a, b}});
+        }
+        else throw runtime_error("Mismatched parentheses");
+    }
+    if (st.size() != 1) throw runtime_error("Invalid expression");
+
+    // Each temporary is read exactly once (a tree), so its register is free
+    // as soon as the instruction reading it has been emitted
+    const uint32_t firstTemp = nv + prog.consts.size();
+    uint32_t next = firstTemp;
+    pmr::vector<uint32_t> freeRegs(scratch()), tempReg(ops.size(), scratch());
+    auto reg = [&](Operand o) { return o.temp ? tempReg[o.index] : o.index; };
+    prog.code.reserve(ops.size() + 1);
+    for (size_t k = 0; k < ops.size(); ++k) {
+        auto [op, src] = ops[k];
+        Instr in{op, 0, reg(src[0]), reg(src[1]), 0};
+        for (int s = 0; s < (op == IOP_NEG || op == IOP_NOT ? 1 : 2); ++s)
+            if (src[s].temp) freeRegs.push_back(tempReg[src[s].index]);
+        if (freeRegs.empty()) in.dst = next++;
+        else { in.dst = freeRegs.back(); freeRegs.pop_back(); }
+        tempReg[k] = in.dst;
+        prog.code.push_back(in);
+    }
+    prog.code.push_back({IOP_RET, 0, reg(st.back()), 0, 0});
+    prog.nregs = next;
+    return prog;
+}
+
+// One integer operation.  In checked arithmetic `bad` is set when the
+// answer is not a whole number (the caller falls back to doubles) and `ovf`
+// when it does not fit in an i64 (the caller reports CalcError::Overflow).
+// A zero divisor gives 0; callers check for it and report
+// CalcError::DivideByZero.
+static inline uint64_t intOp(uint8_t op, uint64_t a, uint64_t b, bool wrap, bool& bad, bool& ovf) {
+    int64_t r, sa = (int64_t)a, sb = (int64_t)b;
+    switch (op) {
+        case IOP_ADD:
+            if (!wrap && __builtin_add_overflow(sa, sb, &r)) ovf = true;
+            return a + b;
+        case IOP_SUB:
+            if (!wrap && __builtin_sub_overflow(sa, sb, &r)) ovf = true;
+            return a - b;
+        case IOP_MUL:
+            if (!wrap && __builtin_mul_overflow(sa, sb, &r)) ovf = true;
+            return a * b;
+        case IOP_DIV:
+        case IOP_MOD:
+            if (b == 0) return 0;
+            if (wrap) return op == IOP_DIV ? a / b : a % b;
+            if (sa == INT64_MIN && sb == -1) { ovf = true; return 0; }
+            if (op == IOP_DIV) {
+                if (sa % sb) bad = true;   // 7/2 stays 3.5
+                return (uint64_t)(sa / sb);
+            }
+            r = sa % sb;   // floor modulo, like integer mode
+            return (uint64_t)(r != 0 && (r < 0) != (sb < 0) ? r + sb : r);
+        case IOP_POW: {
+            if (!wrap && sb < 0) { bad = true; return 0; }
+            uint64_t x = 1;
+            for (uint64_t e = b, base = a; e; e >>= 1) {
+                if (e & 1) {
+                    if (!wrap && __builtin_mul_overflow((int64_t)x, (int64_t)base, &r)) ovf = true;
+                    x *= base;
+                }
+                if (e > 1) {
+                    if (!wrap && __builtin_mul_overflow((int64_t)base, (int64_t)base, &r)) ovf = true;
+                    base *= base;
+                }
+                if (ovf) return 0;
+            }
+            return x;
+        }
+        case IOP_AND: return a & b;
+        case IOP_OR:  return a | b;
+        case IOP_XOR: return a ^ b;
+        case IOP_SHL: return b >= 64 ? 0 : a << b;
+        case IOP_SHR: return b >= 64 ? 0 : a >> b;
+        case IOP_NOT: return ~a;
+        case IOP_NEG:
+            if (!wrap && sa == INT64_MIN) ovf = true;
+            return 0 - a;
+    }
+    return 0;
+}
+
+uint64_t executeInteger(const IntProgram& prog, uint64_t* R, bool& bad, CalcError& error) {
+    for (const Instr& in : prog.code) {
+        if (in.op == IOP_RET) return R[in.a];
+        if ((in.op == IOP_DIV || in.op == IOP_MOD) && R[in.b] == 0) {
+            error = CalcError::DivideByZero;
+            return 0;
+        }
+        bool ovf = false;
+        R[in.dst] = intOp(in.op, R[in.a], R[in.b], prog.wrap, bad, ovf);
+        if (ovf) error = CalcError::Overflow;
+        if (bad || ovf) return 0;
+    }
+    return 0;
+}
+
+pmr::vector<uint64_t> makeIntegerRegisters(const IntProgram& prog) {
+    pmr::vector<uint64_t> regs(prog.nregs, 0, scratch());
+    copy(prog.consts.begin(), prog.consts.end(), regs.begin() + prog.vars.size());
+    return regs;
+}
+
+bool executeIntegerBatch(const IntProgram& prog, const uint64_t* const* vars, size_t n, uint64_t* out,
+                         uint64_t* errorMask) {
+    const size_t W = batchLanes;
+    vector<uint64_t> R((size_t)prog.nregs * W);
+    for (size_t k = 0; k < prog.consts.size(); ++k)
+        fill_n(&R[(prog.vars.size() + k) * W], W, prog.consts[k]);
+    bool bad = false, ovf = false;
+    for (size_t base = 0; base < n; base += W) {
+        const size_t cnt = min(W, n - base);
+        for (size_t v = 0; v < prog.vars.size(); ++v) {
+            uint64_t* row = &R[v * W];
+            copy(vars[v] + base, vars[v] + base + cnt, row);
+            fill(row + cnt, row + W, row[cnt - 1]);
+        }
+        uint64_t zero = 0;   // lanes that divided by zero
+        for (const Instr& in : prog.code) {
+            const uint64_t* a = &R[(size_t)in.a * W];
+            const uint64_t* b = &R[(size_t)in.b * W];
+            uint64_t*       d = &R[(size_t)in.dst * W];
+            if (in.op == IOP_DIV || in.op == IOP_MOD)
+                for (size_t l = 0; l < W; ++l) zero |= (uint64_t)(b[l] == 0) << l;
+            if (in.op == IOP_RET && errorMask)
+                errorMask[base / W] = cnt == W ? zero : zero & ((uint64_t(1) << cnt) - 1);
+#define ILANES(expr) for (size_t l = 0; l < W; ++l) d[l] = (expr)
+            if (prog.wrap) {
+                switch (in.op) {
+                    case IOP_ADD: ILANES(a[l] + b[l]); break;
+                    case IOP_SUB: ILANES(a[l] - b[l]); break;
+                    case IOP_MUL: ILANES(a[l] * b[l]); break;
+                    case IOP_AND: ILANES(a[l] & b[l]); break;
+                    case IOP_OR:  ILANES(a[l] | b[l]); break;
+                    case IOP_XOR: ILANES(a[l] ^ b[l]); break;
+                    case IOP_SHL: ILANES(b[l] >= 64 ? 0 : a[l] << b[l]); break;
+                    case IOP_SHR: ILANES(b[l] >= 64 ? 0 : a[l] >> b[l]); break;
+                    case IOP_NOT: ILANES(~a[l]); break;
+                    case IOP_NEG: ILANES(0 - a[l]); break;
+                    case IOP_RET: copy(a, a + cnt, out + base); break;
+                    default:      ILANES(intOp(in.op, a[l], b[l], true, bad, ovf)); break;
+                }
+            }
+            else {
+                const int64_t* sa = (const int64_t*)a;
+                const int64_t* sb = (const int64_t*)b;
+                int64_t*       sd = (int64_t*)d;
+                bool carry = false;
+#define CHECKED(builtin) for (size_t l = 0; l < W; ++l) carry |= builtin(sa[l], sb[l], &sd[l]); break
+                switch (in.op) {
+                    case IOP_ADD: CHECKED(__builtin_add_overflow);
+                    case IOP_SUB: CHECKED(__builtin_sub_overflow);
+                    case IOP_MUL: CHECKED(__builtin_mul_overflow);
+                    case IOP_RET: copy(a, a + cnt, out + base); break;
+                    default:      ILANES(intOp(in.op, a[l], b[l], false, bad, ovf)); break;
+                }
+#undef CHECKED
+                ovf |= carry;
+            }
+#undef ILANES
+        }
+    }
+    return !bad && !ovf;
+}
+
+bool evalFixedWidth(const TokenList& tokens, uint64_t& value, bool& wrap) {
+    for (auto &t : tokens) {
+        errno = 0;
+        if (t.type == NUMBER && (strtoull(t.text.c_str(), nullptr, 10), errno == ERANGE))
+            throw runtime_error(errorMessage(CalcError::LiteralTooLarge, t.text));
+    }
+    IntProgram prog = compileInteger(infixToPostfix(tokens, true));
+    auto regs = makeIntegerRegisters(prog);
+    bool bad = false;
+    CalcError error = CalcError::None;
+    value = executeInteger(prog, regs.data(), bad, error);
+    if (error != CalcError::None) throw runtime_error(errorMessage(error));
+    wrap  = prog.wrap;
+    return !bad;
+}
+
+string formatInteger(uint64_t v, bool wrap) {
+    if (!wrap) return to_string((int64_t)v);
+    ostringstream s;
+    s << v;
+    if ((int64_t)v < 0) s << " = " << (int64_t)v;
+    s << "   (0x" << hex << v << ")";
+    return s.str();
+}
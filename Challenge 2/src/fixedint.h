@@ -0,0 +1,75 @@
+// fixedint.h
+// Fixed-width integers
+//
+// An expression made only of whole-number literals and integer operators
+// (+ - * / % ^, and the bitwise & | xor << >> ~) is compiled to 64-bit
+// integer code instead of double code, so 2^60 + 1 is exact.
+//
+// Without bitwise operators or literals of 2^63 and up the arithmetic is
+// checked signed 64-bit: an inexact division or a negative power falls back
+// to doubles, which is what the expression meant before, and overflow is an
+// error rather than a rounded double.  With bitwise operators, or a literal
+// such as 0xFFFFFFFFFFFFFFFF that only fits as a u64 bit pattern, values are
+// u64 and everything wraps modulo 2^64 as in C; / and % are unsigned, and
+// shifts by 64 or more give 0.
+
+#pragma once
+
+#include "arena.h"
+#include "errors.h"
+#include "parser.h"
+#include "vm.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+enum IntOpCode : uint8_t {
+    IOP_ADD, IOP_SUB, IOP_MUL, IOP_DIV, IOP_MOD, IOP_POW,
+    IOP_AND, IOP_OR, IOP_XOR, IOP_SHL, IOP_SHR, IOP_NOT, IOP_NEG, IOP_RET
+};
+
+inline bool isBitwiseOperator(const std::string& op) {
+    return op == "&" || op == "|" || op == "xor" || op == "<<" || op == ">>" || op == "~";
+}
+
+// A compiled integer expression; code uses Instr with IntOpCode ops and the
+// same [vars][consts][temps] register layout as Program
+struct IntProgram {
+    std::pmr::vector<Instr>    code{scratch()};
+    std::pmr::vector<uint64_t> consts{scratch()};
+    std::vector<std::string>   vars;
+    uint32_t         nregs = 0;
+    bool             wrap  = false;   // u64 semantics (bitwise operators present)
+};
+
+// Whether tokens form a constant expression the integer path can take
+bool isIntegerExpression(const TokenList& tokens);
+
+IntProgram compileInteger(const TokenList& pf, const std::vector<std::string>& vars = {});
+
+// Run an integer program; registers hold [vars][consts][temps].  A division
+// by zero or a checked overflow sets error and returns 0; an inexact result
+// sets bad.  Nothing is thrown.
+uint64_t executeInteger(const IntProgram& prog, uint64_t* R, bool& bad, CalcError& error);
+
+std::pmr::vector<uint64_t> makeIntegerRegisters(const IntProgram& prog);
+
+// out[i] = program(vars[0][i], ...) in 64-lane blocks.  Wrapping and bitwise
+// operations are straight lane loops the compiler vectorizes; checked
+// arithmetic OR-s its overflow flags across the block.  Returns false if any
+// lane was inexact or overflowed.  A row that divides by zero gives 0 and, with errorMask,
+// sets bit i % 64 of errorMask[i / 64] as in executeBatch; the other rows
+// carry on.
+bool executeIntegerBatch(const IntProgram& prog, const uint64_t* const* vars, size_t n, uint64_t* out,
+                         uint64_t* errorMask = nullptr);
+
+// Evaluate an integer expression (see isIntegerExpression) exactly.  Returns
+// false when a division was inexact or a power negative, so the caller
+// should use doubles instead.  This is the REPL wrapper: a division by zero
+// or an overflow throws, as does a literal of 2^64 or more.
+bool evalFixedWidth(const TokenList& tokens, uint64_t& value, bool& wrap);
+
+// "255   (0xff)"; wrapped results with the top bit set also show the signed value
+std::string formatInteger(uint64_t v, bool wrap);
@@ -0,0 +1,81 @@
+// format.cpp
+// Result formatting (see format.h)
+
+#include "format.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+char* formatNumber(char* out, double v, const NumberFormat& f) {
+    char* const end = out + numberBufferSize;
+    const double a = fabs(v);
+    NumberFormat::Mode mode = f.mode;
+    if (mode == NumberFormat::Fixed && isfinite(v) &&
+        (a >= 1e16 || (a != 0 && a < 0.5 && a < 0.5 * pow(10.0, -f.digits))))
+        mode = NumberFormat::Scientific;
+    switch (mode) {
+        case NumberFormat::Fixed:      return to_chars(out, end, v, chars_format::fixed, f.digits).ptr;
+        case NumberFormat::Shortest:   return to_chars(out, end, v).ptr;
+        case NumberFormat::Scientific: return to_chars(out, end, v, chars_format::scientific, f.digits).ptr;
+        case NumberFormat::Engineering: break;
+    }
+    // Scientific with N + (exponent mod 3) decimals, then move the point
+    // right by exponent mod 3.  Rounding can carry into the next power of
+    // ten, so the exponent is read back and the (then all-zero) tail
+    // padded or cut to match it.
+    int exp = 0;
+    {
+        char* p = to_chars(out, end, v, chars_format::scientific).ptr;
+        char* e = find(out, p, 'e');
+        if (e == p) return p;   // inf, nan
+        from_chars(e + 1 + (e[1] == '+'), p, exp);
+    }
+    char digits[maxFormatDigits + 8];
+    size_t n = 0;
+    for (int pass = 0; ; ++pass) {
+        const int shift = ((exp % 3) + 3) % 3;
+        char* p = to_chars(out, end, v, chars_format::scientific, f.digits + shift).ptr;
+        char* e = find(out, p, 'e');
+        int got = 0;
+        from_chars(e + 1 + (e[1] == '+'), p, got);
+        n = 0;
+        for (char* c = out + signbit(v); c < e; ++c)
+            if (*c != '.') digits[n++] = *c;
+        if (got < exp && pass == 0) { exp = got; continue; }   // one fewer digit: redo
+        exp = got;
+        break;
+    }
+    const int shift = ((exp % 3) + 3) % 3;
+    const size_t want = 1 + shift + f.digits;
+    while (n < want) digits[n++] = '0';
+    n = want;
+
+    char* q = out;
+    if (signbit(v)) *q++ = '-';
+    q = copy_n(digits, 1 + shift, q);
+    if (f.digits > 0) {
+        *q++ = '.';
+        q = copy(digits + 1 + shift, digits + n, q);
+    }
+    exp -= shift;
+    *q++ = 'e';
+    *q++ = exp < 0 ? '-' : '+';
+    if (abs(exp) < 10) *q++ = '0';
+    return to_chars(q, end, abs(exp)).ptr;
+}
+
+string_view formatNumber(double v, const NumberFormat& f) {
+    static thread_local char buf[numberBufferSize];
+    return string_view(buf, formatNumber(buf, v, f) - buf);
+}
+
+string describeFormat(const NumberFormat& f) {
+    static const char* const names[] = {"fixed", "shortest", "sci", "eng"};
+    string s = names[f.mode];
+    if (f.mode != NumberFormat::Shortest) s += " " + to_string(f.digits);
+    return s;
+}
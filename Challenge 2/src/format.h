@@ -0,0 +1,38 @@
+// format.h
+// Result formatting
+//
+// Numbers are written with std::to_chars straight into a char buffer: no
+// streams, no locale.  Modes:
+//   fixed N      N decimals (the default, N = 6); values that would need
+//                more than 16 integer digits or would round to 0 switch to
+//                scientific so 1e300 and 1e-9 stay readable
+//   shortest     the fewest digits that read back as the same double
+//   sci N        d.ddd...e+XX with N decimals
+//   eng N        like sci, but the exponent is a multiple of 3: one to three
+//                digits before the point and N after it
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+struct NumberFormat {
+    enum Mode { Fixed, Shortest, Scientific, Engineering };
+    Mode mode   = Fixed;
+    int  digits = 6;
+};
+
+// Longest output of formatNumber: sign, 17 digits of mantissa, up to
+// maxFormatDigits decimals, point, exponent
+inline constexpr int    maxFormatDigits    = 30;
+inline constexpr size_t numberBufferSize   = 64;
+
+// Write v at out (numberBufferSize bytes of room); returns the end
+char* formatNumber(char* out, double v, const NumberFormat& f);
+
+// v formatted into a per-thread buffer; valid until the next call
+std::string_view formatNumber(double v, const NumberFormat& f);
+
+// "fixed 6", "shortest", ... for the format command
+std::string describeFormat(const NumberFormat& f);
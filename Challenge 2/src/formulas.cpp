@@ -0,0 +1,268 @@
+// formulas.cpp
+// Formula files and .cbc files (see formulas.h)
+
+#include "formulas.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+string trim(const string& s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+vector<string> splitTopLevel(const string& s) {
+    vector<string> parts;
+    int depth = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if      (s[i] == '(' || s[i] == '[') depth++;
+        else if (s[i] == ')' || s[i] == ']') depth--;
+        else if (s[i] == ',' && depth == 0) {
+            parts.push_back(trim(s.substr(start, i - start)));
+            start = i + 1;
+        }
+    }
+    parts.push_back(trim(s.substr(start)));
+    return parts;
+}
+
+bool isName(const string& s) {
+    return !s.empty() && isalpha((unsigned char)s[0]) &&
+           all_of(s.begin(), s.end(), [](unsigned char c) { return isalnum(c); });
+}
+
+FormulaLine parseFormulaLine(string line, int lineNo) {
+    FormulaLine f{"f" + to_string(lineNo), line, {}, lineNo};
+    if (line.rfind("table ", 0) == 0) {
+        f.table = true;
+        line = trim(line.substr(6));
+    }
+    size_t eq = line.find('=');   // the definition's, not part of <= >= == !=
+    while (eq != string::npos && ((eq > 0 && isComparisonStart(line[eq-1])) ||
+                                  (eq + 1 < line.size() && line[eq+1] == '=')))
+        eq = line.find('=', eq + 2);
+    if (f.table && eq == string::npos) throw runtime_error("Tables look like table f(x) = expr, from : to");
+    if (eq != string::npos) {
+        string lhs = trim(line.substr(0, eq));
+        f.body = line.substr(eq + 1);
+        size_t lp = lhs.find('(');
+        f.name = trim(lhs.substr(0, lp));
+        if (lp != string::npos) {
+            if (lhs.back() != ')') throw runtime_error("Expected ')' after parameters");
+            f.params = splitTopLevel(lhs.substr(lp + 1, lhs.size() - lp - 2));
+            if (f.params.size() == 1 && f.params[0].empty()) f.params.clear();
+        }
+        for (auto &p : f.params)   // the tokenizer reads names as letters only
+            if (!isName(p) || !all_of(p.begin(), p.end(), [](unsigned char ch) { return isalpha(ch); }))
+                throw runtime_error("Bad parameter name: " + p);
+    }
+    if (!isName(f.name)) throw runtime_error("Bad formula name: " + f.name);
+    return f;
+}
+
+vector<FormulaLine> readFormulaFile(const string& path) {
+    ifstream in(path);
+    if (!in) throw runtime_error("Cannot open " + path);
+
+    vector<FormulaLine> out;
+    string line;
+    for (int lineNo = 1; getline(in, line); ++lineNo) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        try {
+            out.push_back(parseFormulaLine(line, lineNo));
+        }
+        catch (const exception &ex) {
+            throw runtime_error(path + ":" + to_string(lineNo) + ": " + ex.what());
+        }
+    }
+    return out;
+}
+
+vector<NamedProgram> compileFormulaFile(const string& path) {
+    vector<NamedProgram> out;
+    for (const FormulaLine& f : readFormulaFile(path)) {
+        try {
+            if (f.table) throw runtime_error(".cbc files hold plain formulas; tables work with --columns");
+            out.push_back({f.name, compile(infixToPostfix(tokenize(f.body, f.params)), f.params)});
+        }
+        catch (const exception &ex) {
+            throw runtime_error(path + ":" + to_string(f.lineNo) + ": " + ex.what());
+        }
+    }
+    sort(out.begin(), out.end(),
+         [](const NamedProgram& x, const NamedProgram& y) { return x.name < y.name; });
+    for (size_t i = 1; i < out.size(); ++i)
+        if (out[i].name == out[i-1].name)
+            throw runtime_error("Formula defined twice: " + out[i].name);
+    return out;
+}
+
+void writeCompiledFile(const string& path, const vector<NamedProgram>& progs) {
+    const uint64_t base = sizeof(CbcHeader) + progs.size() * sizeof(CbcEntry);
+    vector<char> data;
+    auto here   = [&]() { return base + data.size(); };
+    auto align8 = [&]() { while (here() % 8) data.push_back(0); };
+    auto append = [&](const void* p, size_t n) {
+        uint64_t off = here();
+        data.insert(data.end(), (const char*)p, (const char*)p + n);
+        return off;
+    };
+
+    vector<CbcEntry> entries;
+    for (auto &np : progs) {
+        const Program &p = np.prog;
+        CbcEntry e{};
+        e.nameOff = append(np.name.c_str(), np.name.size() + 1);
+        e.varsOff = here();
+        for (auto &v : p.vars) append(v.c_str(), v.size() + 1);
+        align8();
+        e.constsOff = append(p.consts.data(), p.consts.size() * sizeof(double));
+        align8();
+        e.codeOff = here();
+        for (auto &in : p.code) {
+            Instr rec;
+            memset(&rec, 0, sizeof rec);   // keep padding bytes deterministic
+            rec.op = in.op; rec.dst = in.dst; rec.a = in.a; rec.b = in.b; rec.c = in.c;
+            append(&rec, sizeof rec);
+        }
+        align8();
+        e.ncode   = p.code.size();
+        e.nconsts = p.consts.size();
+        e.nvars   = p.vars.size();
+        e.nregs   = p.nregs;
+        entries.push_back(e);
+    }
+
+    CbcHeader h{};
+    memcpy(h.magic, cbcMagic, sizeof h.magic);
+    h.version   = cbcVersion;
+    h.byteOrder = cbcByteOrder;
+    h.instrSize = sizeof(Instr);
+    h.count     = progs.size();
+    h.fileSize  = here();
+
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write((const char*)&h, sizeof h);
+    out.write((const char*)entries.data(), entries.size() * sizeof(CbcEntry));
+    out.write(data.data(), data.size());
+    if (!out) throw runtime_error("Cannot write " + path);
+}
+
+CompiledFile::CompiledFile(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("Cannot open " + path);
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size < (off_t)sizeof(CbcHeader)) {
+        close(fd);
+        throw runtime_error(path + ": not a compiled formula file");
+    }
+    length = sb.st_size;
+    void* m = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) throw runtime_error("Cannot map " + path);
+    base = (const char*)m;
+    try { validate(); }
+    catch (const exception &ex) {
+        munmap((void*)base, length);
+        throw runtime_error(path + ": " + ex.what());
+    }
+}
+
+CompiledFile::~CompiledFile() { munmap((void*)base, length); }
+
+const char* CompiledFile::param(size_t i, uint32_t k) const {
+    const char* p = base + entries[i].varsOff;
+    while (k--) p += strlen(p) + 1;
+    return p;
+}
+
+long CompiledFile::find(const string& nm) const {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int c = strcmp(name(mid), nm.c_str());
+        if (c == 0) return mid;
+        if (c < 0) lo = mid + 1; else hi = mid;
+    }
+    return -1;
+}
+
+void CompiledFile::validate() {
+    const CbcHeader* h = (const CbcHeader*)base;
+    if (memcmp(h->magic, cbcMagic, sizeof cbcMagic) != 0)
+        throw runtime_error("not a compiled formula file");
+    if (h->version != cbcVersion)
+        throw runtime_error("unsupported version " + to_string(h->version));
+    if (h->byteOrder != cbcByteOrder || h->instrSize != sizeof(Instr))
+        throw runtime_error("compiled on an incompatible machine");
+    if (h->fileSize != length ||
+        h->count > (length - sizeof(CbcHeader)) / sizeof(CbcEntry))
+        throw runtime_error("file is truncated");
+    count   = h->count;
+    entries = (const CbcEntry*)(base + sizeof(CbcHeader));
+
+    auto inside = [&](uint64_t off, uint64_t bytes) {
+        return off <= length && bytes <= length - off;
+    };
+    auto cstring = [&](uint64_t off) {
+        return off < length && memchr(base + off, 0, length - off) != nullptr;
+    };
+    for (uint32_t i = 0; i < count; ++i) {
+        const CbcEntry &e = entries[i];
+        bool ok = cstring(e.nameOff) &&
+                  e.constsOff % 8 == 0 && e.codeOff % 8 == 0 &&
+                  inside(e.constsOff, (uint64_t)e.nconsts * sizeof(double)) &&
+                  inside(e.codeOff, (uint64_t)e.ncode * sizeof(Instr)) &&
+                  e.ncode > 0 && (uint64_t)e.nvars + e.nconsts <= e.nregs;
+        uint64_t v = e.varsOff;
+        for (uint32_t k = 0; ok && k < e.nvars; ++k) {
+            ok = cstring(v);
+            if (ok) v += strlen(base + v) + 1;
+        }
+        const Instr* code = (const Instr*)(base + e.codeOff);
+        for (uint32_t k = 0; ok && k < e.ncode; ++k) {
+            const Instr &in = code[k];
+            ok = in.op < OP_MEMO && in.a < e.nregs && in.b < e.nregs && in.c < e.nregs &&
+                 (isJump(in.op) ? in.dst > k && in.dst < e.ncode : in.dst < e.nregs) &&
+                 (in.op == OP_RET) == (k + 1 == e.ncode);
+        }
+        if (!ok) throw runtime_error("program " + to_string(i) + " is corrupt");
+    }
+}
+
+bool callFormula(const CompiledFile& file, const string& line, double& result) {
+    size_t j = 0;
+    while (j < line.size() && isalnum((unsigned char)line[j])) j++;
+    long idx = file.find(line.substr(0, j));
+    if (idx < 0) return false;
+
+    string rest = trim(line.substr(j));
+    vector<string> args;
+    if (!rest.empty()) {
+        if (rest.front() != '(' || rest.back() != ')') return false;
+        args = splitTopLevel(rest.substr(1, rest.size() - 2));
+        if (args.size() == 1 && args[0].empty()) args.clear();
+    }
+    if (args.size() != file.paramCount(idx)) {
+        throw runtime_error(string(file.name(idx)) + " expects " +
+                            to_string(file.paramCount(idx)) + " argument(s)");
+    }
+
+    ProgramView prog = file.program(idx);
+    auto regs = makeRegisters(prog);
+    for (size_t k = 0; k < args.size(); ++k)
+        regs[k] = execute(compile(infixToPostfix(tokenize(args[k]))));
+    result = execute(prog, regs.data());
+    return true;
+}
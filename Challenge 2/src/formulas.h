@@ -0,0 +1,121 @@
+// formulas.h
+// Formula files and ahead-of-time compiled formula files (.cbc)
+//
+// "calculator --compile formulas.txt -o formulas.cbc" compiles every formula
+// once and writes the programs out; loading maps the file and hands the VM
+// pointers straight into the mapping.  Layout, in native byte order:
+//
+//   CbcHeader
+//   CbcEntry[count]            sorted by name for binary search
+//   data                       names, variable names, constants, code
+//
+// Every offset is relative to the start of the file, so the image does not
+// care where it is mapped.
+
+#pragma once
+
+#include "vm.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+inline constexpr char     cbcMagic[8]  = {'C','A','L','C','B','C','\0','\0'};
+inline constexpr uint32_t cbcVersion   = 3;   // 2: OP_NEG, 3: comparisons, select and jumps
+inline constexpr uint32_t cbcByteOrder = 0x01020304;
+
+struct CbcHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;   // cbcByteOrder as written by the producer
+    uint32_t instrSize;   // sizeof(Instr) as written by the producer
+    uint32_t count;       // number of programs
+    uint64_t fileSize;
+};
+
+struct CbcEntry {
+    uint64_t nameOff;     // NUL-terminated formula name
+    uint64_t varsOff;     // nvars NUL-terminated parameter names, back to back
+    uint64_t constsOff;   // nconsts doubles, 8-byte aligned
+    uint64_t codeOff;     // ncode Instr records, 8-byte aligned
+    uint32_t ncode, nconsts, nvars, nregs;
+};
+
+static_assert(sizeof(Instr) == 20, "Instr layout is part of the .cbc format");
+static_assert(sizeof(CbcHeader) == 32 && sizeof(CbcEntry) == 48, "unexpected .cbc padding");
+
+// A formula with a name, ready to be written out
+struct NamedProgram {
+    std::string name;
+    Program     prog;
+};
+
+// Trim spaces from both ends
+std::string trim(const std::string& s);
+
+// Split "a, f(b, c), [d, e]" on commas that are not nested inside brackets
+std::vector<std::string> splitTopLevel(const std::string& s);
+
+// Formula names: a letter followed by letters or digits
+bool isName(const std::string& s);
+
+// One formula of a formula file, not yet compiled
+struct FormulaLine {
+    std::string              name, body;
+    std::vector<std::string> params;
+    int                      lineNo;
+    bool                     table = false;   // "table name(x) = ...", see defineTable
+};
+
+// One line of a formula file (trimmed, not blank or a comment)
+FormulaLine parseFormulaLine(std::string line, int lineNo);
+
+// Read a formula file: one formula per line, written as
+//   name(x, y) = expression      name = expression      expression
+// or a table declaration, table name(x) = expression, from : to (see
+// defineTable).  Blank lines and lines starting with '#' are skipped.
+std::vector<FormulaLine> readFormulaFile(const std::string& path);
+
+// Compile every formula of a file, sorted by name
+std::vector<NamedProgram> compileFormulaFile(const std::string& path);
+
+// Write programs (already sorted by name) to a .cbc file
+void writeCompiledFile(const std::string& path, const std::vector<NamedProgram>& progs);
+
+// A memory-mapped .cbc file; programs are used in place
+class CompiledFile {
+public:
+    explicit CompiledFile(const std::string& path);
+    ~CompiledFile();
+    CompiledFile(const CompiledFile&) = delete;
+    CompiledFile& operator=(const CompiledFile&) = delete;
+
+    size_t      size() const                { return count; }
+    const char* name(size_t i) const        { return base + entries[i].nameOff; }
+    uint32_t    paramCount(size_t i) const  { return entries[i].nvars; }
+
+    // Parameter names of program i, NUL-separated in the mapping
+    const char* param(size_t i, uint32_t k) const;
+
+    ProgramView program(size_t i) const {
+        const CbcEntry &e = entries[i];
+        return {(const Instr*)(base + e.codeOff), (const double*)(base + e.constsOff),
+                e.ncode, e.nconsts, e.nvars, e.nregs};
+    }
+
+    // Index of a formula by name, or -1
+    long find(const std::string& nm) const;
+
+private:
+    const char*     base    = nullptr;
+    size_t          length  = 0;
+    const CbcEntry* entries = nullptr;
+    uint32_t        count   = 0;
+
+    // Bounds-check the image once so the VM never reads outside the mapping
+    void validate();
+};
+
+// If line is a call to a loaded formula, e.g. "area(2, 3)" or "golden",
+// evaluate it and return true
+bool callFormula(const CompiledFile& file, const std::string& line, double& result);
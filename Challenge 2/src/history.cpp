@@ -0,0 +1,237 @@
+// history.cpp
+// Persistent history (see history.h)
+
+#include "history.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+void GrowableMap::reset() {
+    if (base) munmap(base, cap);
+    if (fd >= 0) close(fd);
+    fd   = -1;
+    base = nullptr;
+    cap  = 0;
+}
+
+bool GrowableMap::open(const string& path) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) return false;
+    struct stat sb;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &sb) != 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    if (sb.st_size > 0) remap(sb.st_size);
+    return true;
+}
+
+void GrowableMap::reserve(size_t bytes) {
+    if (bytes <= cap) return;
+    size_t want = max({bytes, cap * 2, (size_t)1 << 16});
+    want = (want + 4095) & ~(size_t)4095;
+    if (fd >= 0 && ftruncate(fd, want) != 0)
+        throw runtime_error("Cannot grow history file");
+    remap(want);
+}
+
+void GrowableMap::remap(size_t bytes) {
+    void* m = fd >= 0
+        ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) throw runtime_error("Cannot map history");
+    if (base) {
+        if (fd < 0) memcpy(m, base, cap);
+        munmap(base, cap);
+    }
+    base = (char*)m;
+    cap  = bytes;
+}
+
+History::History(const string& path) {
+    if (!path.empty() && !(attach(log, path, "CALCLOG") &&
+                           attach(index, path + ".idx", "CALCIDX"))) {
+        note = "history file " + path + " is unavailable or in use; "
+               "this session's history will not be saved";
+        log.reset();
+        index.reset();
+    }
+    if (log.capacity() == 0)   attach(log, "", "CALCLOG");
+    if (index.capacity() == 0) attach(index, "", "CALCIDX");
+    persistent = note.empty() && !path.empty() && attach(trigrams, path + ".tri", "CALCTRI");
+    if (!persistent) {
+        trigrams.reset();
+        attach(trigrams, "", "CALCTRI");
+    }
+
+    const size_t n = validEntries();
+    if (n < size()) {
+        note = "history index " + path + ".idx is damaged; kept its first " +
+               to_string(n) + " entries";
+        header(index).used = sizeof(HistHeader) + 8 * n;
+    }
+}
+
+History::~History() {
+    try { saveGrams(); } catch (const exception&) {}   // the next session rebuilds it
+}
+
+size_t History::validEntries() const {
+    const size_t n = (header(index).used - sizeof(HistHeader)) / 8;
+    const uint64_t used = header(log).used;
+    for (size_t i = 0; i < n; ++i) {
+        const uint64_t at = offsets()[i];
+        if (at < sizeof(HistHeader) || at > used || used - at < 12) return i;
+        uint32_t len;
+        memcpy(&len, log.data() + at + 8, sizeof len);
+        if (used - at - 12 < len) return i;
+    }
+    return n;
+}
+
+void History::append(const string& text, double result) {
+    const uint32_t len = (uint32_t)min(text.size(), maxInput);
+    uint64_t at  = header(log).used;
+    uint64_t end = (at + 12 + len + 7) & ~(uint64_t)7;
+    log.reserve(end);
+    char* rec = log.data() + at;
+    memcpy(rec, &result, 8);
+    memcpy(rec + 8, &len, 4);
+    memcpy(rec + 12, text.data(), len);
+    header(log).used = end;
+
+    uint64_t slot = header(index).used;
+    index.reserve(slot + 8);
+    memcpy(index.data() + slot, &at, 8);
+    header(index).used = slot + 8;
+}
+
+void History::clear() {
+    header(log).used   = sizeof(HistHeader);
+    header(index).used = sizeof(HistHeader);
+    header(trigrams).used = sizeof(HistHeader);
+    grams.clear();
+    indexed = saved = 0;
+}
+
+vector<size_t> History::search(const string& text, bool prefix, size_t limit) const {
+    // prefixes are matched as substrings of the text with a start marker
+    const string q = prefix ? anchor + text : text;
+    vector<size_t> hits;
+    auto matches = [&](size_t i) {
+        string_view in = input(i);
+        return prefix ? in.substr(0, text.size()) == text
+                      : in.find(q) != string_view::npos;
+    };
+
+    if (q.size() < 3) {   // too short for trigrams: walk back from the newest
+        for (size_t i = size(); i-- > 0 && hits.size() < limit; )
+            if (matches(i)) hits.push_back(i);
+        return hits;
+    }
+
+    catchUp();
+    vector<const pmr::vector<uint32_t>*> lists;
+    for (size_t p = 0; p + 3 <= q.size(); ++p) {
+        auto it = grams.find(gram(q.data() + p));
+        if (it == grams.end()) return hits;
+        lists.push_back(&it->second);
+    }
+    sort(lists.begin(), lists.end(),
+         [](auto* x, auto* y) { return x->size() < y->size(); });
+    const pmr::vector<uint32_t> &seed = *lists[0];
+    for (size_t k = seed.size(); k-- > 0 && hits.size() < limit; ) {
+        uint32_t id = seed[k];
+        bool all = true;
+        for (size_t l = 1; all && l < lists.size(); ++l)
+            all = binary_search(lists[l]->begin(), lists[l]->end(), id);
+        if (all && matches(id)) hits.push_back(id);   // trigrams can overlap by accident
+    }
+    return hits;
+}
+
+bool History::attach(GrowableMap& m, const string& path, const char* magic) {
+    if (!path.empty() && !m.open(path)) return false;
+    m.reserve(sizeof(HistHeader));
+    HistHeader &h = header(m);
+    if (h.used == 0) {
+        memcpy(h.magic, magic, 8);
+        h.version = 1;
+        h.used    = sizeof(HistHeader);
+    }
+    return memcmp(h.magic, magic, 8) == 0 && h.version == 1 &&
+           h.used >= sizeof(HistHeader) && h.used <= m.capacity();
+}
+
+void History::catchUp() const {
+    if (indexed == 0 && !loadGrams()) grams.clear();
+    string text;
+    for (; indexed < size(); ++indexed) {
+        text = anchor;
+        text += input(indexed);
+        for (size_t p = 0; p + 3 <= text.size(); ++p) {
+            auto &ids = grams[gram(text.data() + p)];
+            if (ids.empty() || ids.back() != indexed) ids.push_back(indexed);
+        }
+    }
+}
+
+bool History::loadGrams() const {
+    const char* p   = trigrams.data() + sizeof(HistHeader);
+    const char* end = trigrams.data() + header(trigrams).used;
+    uint64_t head[3];   // entries, last offset, trigrams
+    if (end - p < (ptrdiff_t)sizeof head) return false;
+    memcpy(head, p, sizeof head);
+    p += sizeof head;
+    if (head[0] == 0 || head[0] > size() || offsets()[head[0] - 1] != head[1]) return false;
+    for (uint64_t g = 0; g < head[2]; ++g) {
+        uint32_t rec[2];   // gram, count
+        if (end - p < (ptrdiff_t)sizeof rec) return false;
+        memcpy(rec, p, sizeof rec);
+        p += sizeof rec;
+        if ((size_t)(end - p) / 4 < rec[1]) return false;
+        auto &ids = grams[rec[0]];
+        ids.resize(rec[1]);
+        memcpy(ids.data(), p, 4 * (size_t)rec[1]);
+        p += 4 * (size_t)rec[1];
+        for (size_t k = 0; k < ids.size(); ++k)
+            if (ids[k] >= head[0] || (k > 0 && ids[k] <= ids[k - 1])) return false;
+    }
+    indexed = saved = head[0];
+    return true;
+}
+
+void History::saveGrams() {
+    if (!persistent || indexed <= saved) return;
+    size_t bytes = sizeof(HistHeader) + 24;
+    for (auto& [g, ids] : grams) bytes += 8 + 4 * ids.size();
+    header(trigrams).used = sizeof(HistHeader);   // a partial write reads as empty
+    trigrams.reserve(bytes);
+    char* p = trigrams.data() + sizeof(HistHeader);
+    const uint64_t head[3] = {indexed, offsets()[indexed - 1], grams.size()};
+    memcpy(p, head, sizeof head);
+    p += sizeof head;
+    for (auto& [g, ids] : grams) {
+        const uint32_t rec[2] = {g, (uint32_t)ids.size()};
+        memcpy(p, rec, sizeof rec);
+        memcpy(p + sizeof rec, ids.data(), 4 * ids.size());
+        p += sizeof rec + 4 * ids.size();
+    }
+    header(trigrams).used = bytes;
+    saved = indexed;
+}
+
+string historyPath() {
+    if (const char* p = getenv("CALC_HISTORY")) return p;
+    if (const char* home = getenv("HOME")) return string(home) + "/.calculator_history";
+    return "";
+}
@@ -0,0 +1,128 @@
+// history.h
+// Persistent history
+//
+// Two append-only files mapped into memory:
+//   <path>       log: header, then records [double result][u32 length][text]
+//   <path>.idx   index: header, then one u64 record offset per entry
+// so recalling entry N is one index lookup; offsets that point outside the
+// log are dropped when the files are opened.  Searching goes through a
+// trigram index instead of walking the log.  It is built on first search,
+// then kept up to date, and saved to <path>.tri when the session ends, so
+// the next session only indexes the entries added since.  The history lives in $CALC_HISTORY, or
+// ~/.calculator_history; set CALC_HISTORY to an empty string to keep it in
+// memory only.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A read-write mapping of a file, or of anonymous memory, that can grow
+class GrowableMap {
+public:
+    GrowableMap() = default;
+    GrowableMap(const GrowableMap&) = delete;
+    GrowableMap& operator=(const GrowableMap&) = delete;
+    ~GrowableMap() { reset(); }
+
+    // Unmap and close, leaving an empty in-memory map
+    void reset();
+
+    // Map an existing or new file; false if it cannot be opened or is in use
+    bool open(const std::string& path);
+
+    // Make sure at least `bytes` are mapped (new space reads as zeros)
+    void reserve(size_t bytes);
+
+    char*  data()     const { return base; }
+    size_t capacity() const { return cap; }
+
+private:
+    int    fd   = -1;
+    char*  base = nullptr;
+    size_t cap  = 0;
+
+    void remap(size_t bytes);
+};
+
+struct HistHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t used;        // bytes in use, header included
+};
+
+class History {
+public:
+    // path == "": memory only.  `note` explains a fallback to memory.
+    explicit History(const std::string& path);
+    ~History();
+
+    std::string note;
+
+    size_t size() const { return (header(index).used - sizeof(HistHeader)) / 8; }
+
+    std::string_view input(size_t i) const {
+        const char* rec = log.data() + offsets()[i];
+        uint32_t len;
+        memcpy(&len, rec + 8, sizeof len);
+        return std::string_view(rec + 12, len);
+    }
+
+    double result(size_t i) const {
+        double r;
+        memcpy(&r, log.data() + offsets()[i], sizeof r);
+        return r;
+    }
+
+    // Longest input a record can hold (its length is a u32); longer text is
+    // cut to this many bytes
+    static constexpr size_t maxInput = UINT32_MAX;
+
+    void append(const std::string& text, double result);
+    void clear();
+
+    // Entries containing `text` (or starting with it), newest first
+    std::vector<size_t> search(const std::string& text, bool prefix, size_t limit) const;
+
+private:
+    // <path>.tri after its header: u64 entries covered, u64 log offset of
+    // the last of them, u64 trigram count, then per trigram u32 gram,
+    // u32 n and n ascending entry ids
+    GrowableMap log, index, trigrams;
+    bool        persistent = false;   // trigrams is a file worth saving
+    // The trigram index lives for the session and grows in small steps, so
+    // it draws from a pool that recycles blocks rather than from malloc
+    mutable std::pmr::unsynchronized_pool_resource                               pool;
+    mutable std::pmr::unordered_map<uint32_t, std::pmr::vector<uint32_t>> grams{&pool};   // trigram -> entry ids
+    mutable size_t indexed = 0;                                // entries in `grams`
+    mutable size_t saved   = 0;                                // entries in <path>.tri
+    static constexpr char anchor = '\x01';
+
+    static HistHeader& header(const GrowableMap& m) { return *(HistHeader*)m.data(); }
+    const uint64_t* offsets() const { return (const uint64_t*)(index.data() + sizeof(HistHeader)); }
+
+    static uint32_t gram(const char* p) {
+        return (uint8_t)p[0] | (uint8_t)p[1] << 8 | (uint32_t)(uint8_t)p[2] << 16;
+    }
+
+    // Map a file (or memory, for path "") and check or write its header
+    static bool attach(GrowableMap& m, const std::string& path, const char* magic);
+
+    // Entries at the start of the index whose records lie inside the log
+    size_t validEntries() const;
+
+    // Add entries appended since the last search to the trigram index,
+    // starting from <path>.tri in a new session
+    void catchUp() const;
+    bool loadGrams() const;
+    void saveGrams();
+};
+
+// Where the history lives: $CALC_HISTORY, else ~/.calculator_history
+std::string historyPath();
@@ -0,0 +1,573 @@
+// matrix.cpp
+// Vectors and matrices (see matrix.h)
+
+#include "matrix.h"
+#include "errors.h"
+#include "fft.h"
+#include "simd.h"
+#include "tables.h"
+#include "threadpool.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"   // local vec4 helpers, as in simd.h
+#endif
+
+// Apply f to every element pair, broadcasting a scalar operand
+template <class F>
+Matrix zipWith(const Matrix& a, const Matrix& b, F f) {
+    if (!a.isScalar() && !b.isScalar() && (a.rows != b.rows || a.cols != b.cols))
+        throw runtime_error("Shapes do not match: " + to_string(a.rows) + "x" + to_string(a.cols) +
+                            " and " + to_string(b.rows) + "x" + to_string(b.cols));
+    const Matrix& shape = a.isScalar() ? b : a;
+    Matrix r(shape.rows, shape.cols);
+    const size_t n = r.data.size();
+    double* out = r.data.data();
+    const double *x = a.data.data(), *y = b.data.data();
+    if      (a.isScalar() && !b.isScalar()) for (size_t i = 0; i < n; ++i) out[i] = f(x[0], y[i]);
+    else if (b.isScalar() && !a.isScalar()) for (size_t i = 0; i < n; ++i) out[i] = f(x[i], y[0]);
+    else                                    for (size_t i = 0; i < n; ++i) out[i] = f(x[i], y[i]);
+    return r;
+}
+
+template <class F>
+Matrix mapEach(Matrix a, F f) {
+    for (auto &v : a.data) v = f(v);
+    return a;
+}
+
+Matrix transpose(const Matrix& a) {
+    Matrix t(a.cols, a.rows);
+    const size_t B = 32;   // tiles keep both sides in cache
+    for (size_t i0 = 0; i0 < a.rows; i0 += B)
+        for (size_t j0 = 0; j0 < a.cols; j0 += B)
+            for (size_t i = i0; i < min(i0 + B, a.rows); ++i)
+                for (size_t j = j0; j < min(j0 + B, a.cols); ++j)
+                    t.at(j, i) = a.at(i, j);
+    return t;
+}
+
+double dot(const Matrix& a, const Matrix& b) {
+    if (a.data.size() != b.data.size()) throw runtime_error("dot needs equal lengths");
+    const size_t n = a.data.size();
+    const double *x = a.data.data(), *y = b.data.data();
+    vec4 acc0 = splat4(0), acc1 = splat4(0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 += load4(x + i) * load4(y + i);
+        acc1 += load4(x + i + 4) * load4(y + i + 4);
+    }
+    double lanes[4], s = 0;
+    acc0 += acc1;
+    store4(lanes, acc0);
+    for (double l : lanes) s += l;
+    for (; i < n; ++i) s += x[i] * y[i];
+    return s;
+}
+
+// C[mr x nr] += a-panel * b-panel over kb; panels are packed 4 rows / 8 columns wide
+static void gemmMicro(size_t kb, const double* a, const double* b,
+                      double* c, size_t ldc, size_t mr, size_t nr) {
+    vec4 acc[4][2];
+    for (auto &row : acc) row[0] = row[1] = splat4(0);
+    for (size_t k = 0; k < kb; ++k) {
+        vec4 b0 = load4(b + k * 8), b1 = load4(b + k * 8 + 4);
+        for (int r = 0; r < 4; ++r) {
+            vec4 av = splat4(a[k * 4 + r]);
+            acc[r][0] += av * b0;
+            acc[r][1] += av * b1;
+        }
+    }
+    double tile[4][8];
+    for (int r = 0; r < 4; ++r) {
+        store4(tile[r], acc[r][0]);
+        store4(tile[r] + 4, acc[r][1]);
+    }
+    for (size_t r = 0; r < mr; ++r)
+        for (size_t j = 0; j < nr; ++j) c[r * ldc + j] += tile[r][j];
+}
+
+Matrix matmul(const Matrix& A, const Matrix& B) {
+    if (A.cols != B.rows)
+        throw runtime_error("matmul: inner sizes differ (" + to_string(A.cols) +
+                            " vs " + to_string(B.rows) + ")");
+    const size_t M = A.rows, N = B.cols, K = A.cols;
+    const size_t MB = 64, NB = 256, KB = 128, MR = 4, NR = 8;
+    Matrix C(M, N);
+    const size_t mTiles = (M + MB - 1) / MB, nTiles = (N + NB - 1) / NB;
+    atomic<size_t> next{0};
+
+    auto work = [&](unsigned) {
+        vector<double> Ap(MB * KB), Bp(KB * NB);
+        for (size_t t; (t = next.fetch_add(1)) < mTiles * nTiles; ) {
+            const size_t i0 = t / nTiles * MB, j0 = t % nTiles * NB;
+            const size_t mb = min(MB, M - i0), nb = min(NB, N - j0);
+            for (size_t k0 = 0; k0 < K; k0 += KB) {
+                const size_t kb = min(KB, K - k0);
+                // pack A into MR-row panels and B into NR-column panels, zero-padded
+                for (size_t p = 0; p < mb; p += MR)
+                    for (size_t k = 0; k < kb; ++k)
+                        for (size_t r = 0; r < MR; ++r)
+                            Ap[p * kb + k * MR + r] = p + r < mb ? A.at(i0 + p + r, k0 + k) : 0;
+                for (size_t q = 0; q < nb; q += NR)
+                    for (size_t k = 0; k < kb; ++k)
+                        for (size_t c = 0; c < NR; ++c)
+                            Bp[q * kb + k * NR + c] = q + c < nb ? B.at(k0 + k, j0 + q + c) : 0;
+                for (size_t p = 0; p < mb; p += MR)
+                    for (size_t q = 0; q < nb; q += NR)
+                        gemmMicro(kb, &Ap[p * kb], &Bp[q * kb], &C.at(i0 + p, j0 + q), N,
+                                  min(MR, mb - p), min(NR, nb - q));
+            }
+        }
+    };
+    if ((double)M * N * K < 1e6) work(0);
+    else threadPool().parallel(work);
+    return C;
+}
+
+bool luDecompose(Matrix& A, vector<size_t>& perm, int& sign) {
+    const size_t n = A.rows;
+    perm.resize(n);
+    for (size_t i = 0; i < n; ++i) perm[i] = i;
+    sign = 1;
+    for (size_t k = 0; k < n; ++k) {
+        size_t p = k;
+        for (size_t i = k + 1; i < n; ++i)
+            if (fabs(A.at(i, k)) > fabs(A.at(p, k))) p = i;
+        if (A.at(p, k) == 0) return false;
+        if (p != k) {
+            swap_ranges(&A.at(k, 0), &A.at(k, 0) + n, &A.at(p, 0));
+            swap(perm[k], perm[p]);
+            sign = -sign;
+        }
+        const double* pivotRow = &A.at(k, 0);
+        auto update = [&](size_t i) {
+            double* row = &A.at(i, 0);
+            double l = row[k] /= pivotRow[k];
+            for (size_t j = k + 1; j < n; ++j) row[j] -= l * pivotRow[j];
+        };
+        if ((n - k) * (n - k) < 1 << 16) {
+            for (size_t i = k + 1; i < n; ++i) update(i);
+        }
+        else {
+            atomic<size_t> next{k + 1};
+            threadPool().parallel([&](unsigned) {
+                for (size_t i; (i = next.fetch_add(16)) < n; )
+                    for (size_t r = i; r < min(i + 16, n); ++r) update(r);
+            });
+        }
+    }
+    return true;
+}
+
+double det(const Matrix& A) {
+    if (A.rows != A.cols) throw runtime_error("det needs a square matrix");
+    Matrix lu = A;
+    vector<size_t> perm;
+    int sign;
+    if (!luDecompose(lu, perm, sign)) return 0;
+    double d = sign;
+    for (size_t i = 0; i < lu.rows; ++i) d *= lu.at(i, i);
+    return d;
+}
+
+Matrix solveLinear(const Matrix& A, const Matrix& Bin) {
+    if (A.rows != A.cols) throw runtime_error("solve needs a square matrix");
+    const bool asRow = Bin.rows == 1 && Bin.cols == A.rows && A.rows != 1;
+    Matrix B = asRow ? transpose(Bin) : Bin;
+    if (B.rows != A.rows) throw runtime_error("solve: right-hand side has the wrong size");
+    Matrix lu = A;
+    vector<size_t> perm;
+    int sign;
+    if (!luDecompose(lu, perm, sign)) throw runtime_error("Matrix is singular");
+    const size_t n = A.rows;
+    Matrix X(n, B.cols);
+    vector<double> y(n);
+    for (size_t c = 0; c < B.cols; ++c) {
+        for (size_t i = 0; i < n; ++i) {
+            double s = B.at(perm[i], c);
+            for (size_t j = 0; j < i; ++j) s -= lu.at(i, j) * y[j];
+            y[i] = s;
+        }
+        for (size_t i = n; i-- > 0; ) {
+            double s = y[i];
+            for (size_t j = i + 1; j < n; ++j) s -= lu.at(i, j) * X.at(j, c);
+            X.at(i, c) = s / lu.at(i, i);
+        }
+    }
+    return asRow ? transpose(X) : X;
+}
+
+void polyBulk(const vector<double>& coeffs, const double* x, double* out, size_t n) {
+    if (coeffs.empty()) {
+        fill(out, out + n, 0.0);
+        return;
+    }
+    const vector<double> a(coeffs.rbegin(), coeffs.rend());   // lowest first
+    const size_t d = a.size() - 1, W = 64;
+    auto block = [&](size_t base, size_t cnt, vector<double>& p) {
+        const double* xs = x + base;
+        double*       ys = out + base;
+        if (d < 8) {
+            double acc[W], xv[W];
+            copy_n(xs, cnt, xv);
+            fill(xv + cnt, xv + W, 0.0);
+            fill_n(acc, W, a[d]);
+            for (size_t k = d; k-- > 0; ) {
+                const double ak = a[k];
+                for (size_t l = 0; l < W; ++l) acc[l] = fmadd(acc[l], xv[l], ak);
+            }
+            copy_n(acc, cnt, ys);
+            return;
+        }
+        // p_j = a_2j + a_2j+1 x, then pairs combine with x^2, x^4, ...
+        size_t m = (d + 2) / 2;
+        p.resize(m * W);
+        for (size_t j = 0; j < m; ++j) {
+            double hi = 2 * j + 1 <= d ? a[2 * j + 1] : 0;
+            for (size_t l = 0; l < cnt; ++l) p[j * W + l] = fmadd(hi, xs[l], a[2 * j]);
+        }
+        double pw[W];
+        for (size_t l = 0; l < cnt; ++l) pw[l] = xs[l] * xs[l];
+        for (; m > 1; m = (m + 1) / 2) {
+            for (size_t j = 0; j < m / 2; ++j)
+                for (size_t l = 0; l < cnt; ++l)
+                    p[j * W + l] = fmadd(p[(2 * j + 1) * W + l], pw[l], p[2 * j * W + l]);
+            if (m & 1) copy_n(&p[(m - 1) * W], cnt, &p[(m / 2) * W]);
+            for (size_t l = 0; l < cnt; ++l) pw[l] *= pw[l];
+        }
+        copy_n(p.data(), cnt, ys);
+    };
+    const size_t nblocks = (n + W - 1) / W;
+    atomic<size_t> next{0};
+    auto worker = [&](unsigned) {
+        vector<double> p;
+        for (size_t b; (b = next.fetch_add(16)) < nblocks; )
+            for (size_t e = min(nblocks, b + 16); b < e; ++b) block(b * W, min(W, n - b * W), p);
+    };
+    if (n < (1 << 16)) worker(0);
+    else threadPool().parallel(worker);
+}
+
+// ---------------------------------------------------------------------------
+// Matrix expressions
+// ---------------------------------------------------------------------------
+
+// Matrix-only functions and how many arguments each takes (min, max)
+static const map<string,pair<int,int>> matrixFunctions = {
+    {"dot", {2, 2}}, {"matmul", {2, 2}}, {"transpose", {1, 1}}, {"solve", {2, 2}},
+    {"det", {1, 1}}, {"zeros", {1, 2}},  {"ones", {1, 2}},      {"eye", {1, 1}},
+    {"linspace", {3, 3}}, {"fft", {1, 1}}, {"ifft", {1, 1}}, {"conv", {2, 2}},
+    {"poly", {2, 2}}
+};
+
+bool isArrayExpression(const TokenList& tokens) {
+    for (auto &t : tokens)
+        if (t.type == SEMICOLON || t.type == LEFT_BRACKET ||
+            t.type == RIGHT_BRACKET || (t.type == FUNCTION && matrixFunctions.count(t.text)))
+            return true;
+    return false;
+}
+
+vector<ArrayOp> arrayPostfix(const TokenList& in) {
+    struct Pending {
+        Token  tok;
+        size_t count = 0;              // call arguments, or items in the current row
+        size_t rows = 0, cols = 0;     // literal shape so far
+    };
+    vector<ArrayOp> out;
+    vector<Pending> ops;
+    auto popOne = [&]() {
+        const Token &t = ops.back().tok;
+        if (t.type == OPERATOR) out.push_back({ArrayOp::OPERATOR, t.text});
+        else if (t.type == FUNCTION) out.push_back({ArrayOp::CALL, t.text, 0, 0, 1});
+        else throw runtime_error("Mismatched brackets");
+        ops.pop_back();
+    };
+    auto popUntilOpen = [&](const Token& closer) {
+        while (!ops.empty() && ops.back().tok.type != LEFT_PAREN &&
+               ops.back().tok.type != LEFT_BRACKET) popOne();
+        if (ops.empty()) throw runtime_error("Unexpected '" + closer.text + "'");
+    };
+    auto endRow = [&](Pending& lit) {
+        if (lit.rows > 0 && lit.count != lit.cols) throw runtime_error("Rows have different lengths");
+        lit.cols = lit.count;
+        lit.rows++;
+        lit.count = 0;
+    };
+
+    for (size_t i = 0; i < in.size(); ++i) {
+        const Token &tok = in[i];
+        const bool closesNext = i + 1 < in.size() && in[i+1].type == RIGHT_PAREN;
+        switch (tok.type) {
+            case NUMBER:
+                out.push_back({ArrayOp::VALUE, tok.text, numberValue(tok)});
+                break;
+            case VARIABLE:
+                throw runtime_error("Unknown name: " + tok.text);
+            case FUNCTION:
+                ops.push_back({tok});
+                break;
+            case LEFT_PAREN:
+                ops.push_back({tok});
+                // a call's parenthesis counts its arguments
+                if (ops.size() > 1 && ops[ops.size()-2].tok.type == FUNCTION)
+                    ops.back().count = closesNext ? 0 : 1;
+                break;
+            case LEFT_BRACKET:
+                ops.push_back({tok, 1});
+                break;
+            case COMMA:
+                popUntilOpen(tok);
+                ops.back().count++;
+                break;
+            case SEMICOLON:
+                popUntilOpen(tok);
+                if (ops.back().tok.type != LEFT_BRACKET) throw runtime_error("';' outside [ ]");
+                endRow(ops.back());
+                ops.back().count = 1;
+                break;
+            case RIGHT_PAREN: {
+                popUntilOpen(tok);
+                if (ops.back().tok.type != LEFT_PAREN) throw runtime_error("Mismatched brackets");
+                size_t args = ops.back().count;
+                ops.pop_back();
+                if (!ops.empty() && ops.back().tok.type == FUNCTION) {
+                    out.push_back({ArrayOp::CALL, ops.back().tok.text, 0, 0, args});
+                    ops.pop_back();
+                }
+                break;
+            }
+            case RIGHT_BRACKET: {
+                popUntilOpen(tok);
+                if (ops.back().tok.type != LEFT_BRACKET) throw runtime_error("Mismatched brackets");
+                endRow(ops.back());
+                out.push_back({ArrayOp::BUILD, "[]", 0, ops.back().rows, ops.back().cols});
+                ops.pop_back();
+                break;
+            }
+            case OPERATOR:
+                if (tok.text == "!") {   // postfix: applies to the operand just finished
+                    out.push_back({ArrayOp::OPERATOR, "!"});
+                    break;
+                }
+                while (tok.text != "neg" && tok.text != "~" && !ops.empty() &&
+                      (ops.back().tok.type == FUNCTION ||
+                       (ops.back().tok.type == OPERATOR &&
+                        (opPrec.at(ops.back().tok.text) > opPrec.at(tok.text) ||
+                        (opPrec.at(ops.back().tok.text) == opPrec.at(tok.text) &&
+                         !opRight.count(tok.text))))))
+                    popOne();
+                ops.push_back({tok});
+                break;
+        }
+        if (ops.size() > parseLimits.maxDepth)
+            throw runtime_error(errorMessage(CalcError::TooDeep, to_string(parseLimits.maxDepth)));
+    }
+    while (!ops.empty()) popOne();
+    return out;
+}
+
+// A matrix on evalArray's stack, with the elements that divided by zero
+// (empty when none).  Like the scalar VM, a division by zero is an error,
+// but only when such an element reaches the result: if() drops the marks
+// of the side it does not choose, so if(x != 0, 1/x, 0) still guards.
+struct MarkedMatrix : Matrix {
+    vector<uint8_t> zeroDiv;
+
+    MarkedMatrix(Matrix m = Matrix()) : Matrix(move(m)) {}
+
+    bool marked() const { return find(zeroDiv.begin(), zeroDiv.end(), 1) != zeroDiv.end(); }
+    // Mark of element k, a scalar broadcasting its one mark
+    uint8_t mark(size_t k) const { return zeroDiv.empty() ? 0 : zeroDiv[isScalar() ? 0 : k]; }
+};
+
+// r = an elementwise function of the operands: r's elements inherit their marks
+static MarkedMatrix withMarks(MarkedMatrix r, initializer_list<const MarkedMatrix*> from) {
+    for (const MarkedMatrix* m : from) {
+        if (m->zeroDiv.empty()) continue;
+        r.zeroDiv.resize(r.data.size());
+        for (size_t k = 0; k < r.data.size(); ++k) r.zeroDiv[k] |= m->mark(k);
+    }
+    return r;
+}
+
+Matrix evalArray(const vector<ArrayOp>& pf) {
+    vector<MarkedMatrix> st;
+    auto pop = [&]() {
+        if (st.empty()) throw runtime_error("Invalid expression");
+        MarkedMatrix m = move(st.back());
+        st.pop_back();
+        return m;
+    };
+    auto size = [](const Matrix& m) {
+        if (!m.isScalar() || m.data[0] < 0 || m.data[0] > 1e5 || m.data[0] != floor(m.data[0]))
+            throw runtime_error("Sizes must be whole numbers up to 100000");
+        return (size_t)m.data[0];
+    };
+
+    for (auto &op : pf) {
+        if (op.kind == ArrayOp::VALUE) {
+            st.push_back(Matrix(1, 1, op.value));
+        }
+        else if (op.kind == ArrayOp::BUILD) {
+            if (st.size() < op.rows * op.cols) throw runtime_error("Invalid expression");
+            MarkedMatrix m(Matrix(op.rows, op.cols));
+            size_t first = st.size() - op.rows * op.cols;
+            for (size_t k = 0; k < m.data.size(); ++k) {
+                if (!st[first + k].isScalar()) throw runtime_error("Matrix entries must be numbers");
+                m.data[k] = st[first + k].data[0];
+                if (st[first + k].mark(0)) {
+                    m.zeroDiv.resize(m.data.size());
+                    m.zeroDiv[k] = 1;
+                }
+            }
+            st.resize(first);
+            st.push_back(move(m));
+        }
+        else if (op.kind == ArrayOp::OPERATOR) {
+            if (op.text == "neg") {
+                MarkedMatrix a = pop();
+                st.push_back(withMarks(mapEach(a, [](double v) { return -v; }), {&a}));
+                continue;
+            }
+            MarkedMatrix b = pop(), a = pop();
+            const string& t = op.text;
+            Matrix r;
+            if      (t == "+") r = zipWith(a, b, [](double x, double y) { return x + y; });
+            else if (t == "-") r = zipWith(a, b, [](double x, double y) { return x - y; });
+            else if (t == "*") r = zipWith(a, b, [](double x, double y) { return x * y; });
+            else if (t == "/") r = zipWith(a, b, [](double x, double y) { return x / y; });
+            else if (t == "<")  r = zipWith(a, b, [](double x, double y) -> double { return x < y; });
+            else if (t == "<=") r = zipWith(a, b, [](double x, double y) -> double { return x <= y; });
+            else if (t == ">")  r = zipWith(a, b, [](double x, double y) -> double { return x > y; });
+            else if (t == ">=") r = zipWith(a, b, [](double x, double y) -> double { return x >= y; });
+            else if (t == "==") r = zipWith(a, b, [](double x, double y) -> double { return x == y; });
+            else if (t == "!=") r = zipWith(a, b, [](double x, double y) -> double { return x != y; });
+            else               r = zipWith(a, b, [](double x, double y) { return pow(x, y); });
+            MarkedMatrix m = withMarks(move(r), {&a, &b});
+            if (t == "/")
+                for (size_t k = 0; k < m.data.size(); ++k)
+                    if (b.data[b.isScalar() ? 0 : k] == 0) {
+                        m.zeroDiv.resize(m.data.size());
+                        m.zeroDiv[k] = 1;
+                    }
+            st.push_back(move(m));
+        }
+        else {   // CALL
+            const string& f = op.text;
+            size_t argc = op.cols;
+            auto it = matrixFunctions.find(f);
+            const int scalarArgs = functionArgs.count(f) ? functionArgs.at(f) : 1;
+            int lo = it == matrixFunctions.end() ? scalarArgs : it->second.first;
+            int hi = it == matrixFunctions.end() ? scalarArgs : it->second.second;
+            if ((int)argc < lo || (int)argc > hi)
+                throw runtime_error(f + " takes " + to_string(lo) +
+                                    (lo == hi ? "" : "-" + to_string(hi)) + " argument(s)");
+            if (st.size() < argc) throw runtime_error("Invalid expression");
+            vector<MarkedMatrix> args(make_move_iterator(st.end() - argc), make_move_iterator(st.end()));
+            st.resize(st.size() - argc);
+            // the other matrix functions mix elements, so any mark is final
+            if (it != matrixFunctions.end() &&
+                any_of(args.begin(), args.end(), [](const MarkedMatrix& m) { return m.marked(); }))
+                throw runtime_error(errorMessage(CalcError::DivideByZero));
+
+            if      (f == "dot")       st.push_back(Matrix(1, 1, dot(args[0], args[1])));
+            else if (f == "matmul")    st.push_back(matmul(args[0], args[1]));
+            else if (f == "transpose") st.push_back(transpose(args[0]));
+            else if (f == "solve")     st.push_back(solveLinear(args[0], args[1]));
+            else if (f == "det")       st.push_back(Matrix(1, 1, det(args[0])));
+            else if (f == "zeros" || f == "ones") {
+                size_t r = size(args[0]), c = argc == 2 ? size(args[1]) : r;
+                st.push_back(Matrix(r, c, f == "ones" ? 1 : 0));
+            }
+            else if (f == "linspace") {
+                if (!args[0].isScalar() || !args[1].isScalar())
+                    throw runtime_error("linspace(from, to, count)");
+                size_t n = size(args[2]);
+                Matrix m(1, n);
+                for (size_t k = 0; k < n; ++k)
+                    m.data[k] = n == 1 ? args[0].data[0]
+                                       : args[0].data[0] + (args[1].data[0] - args[0].data[0]) * k / (n - 1);
+                st.push_back(move(m));
+            }
+            else if (f == "fft" || f == "ifft") st.push_back(fftMatrix(args[0], f == "ifft"));
+            else if (f == "conv")               st.push_back(convolve(args[0], args[1]));
+            else if (f == "poly") {   // poly([c_n, ..., c_0], X), elementwise over X
+                if (args[0].rows != 1 && args[0].cols != 1)
+                    throw runtime_error("poly needs a coefficient vector");
+                Matrix r(args[1].rows, args[1].cols);
+                polyBulk(args[0].data, args[1].data.data(), r.data.data(), r.data.size());
+                st.push_back(move(r));
+            }
+            else if (f == "eye") {
+                size_t n = size(args[0]);
+                Matrix m(n, n);
+                for (size_t i = 0; i < n; ++i) m.at(i, i) = 1;
+                st.push_back(move(m));
+            }
+            else if (f == "min") st.push_back(withMarks(zipWith(args[0], args[1], minOf), {&args[0], &args[1]}));
+            else if (f == "max") st.push_back(withMarks(zipWith(args[0], args[1], maxOf), {&args[0], &args[1]}));
+            else if (f == "if") {   // elementwise select, scalars broadcast
+                auto first  = [](double x, double) { return x; };
+                auto second = [](double, double y) { return y; };
+                MarkedMatrix r = zipWith(zipWith(args[1], args[0], first), args[2], first);
+                Matrix cond    = zipWith(r, args[0], second);
+                Matrix other   = zipWith(r, args[2], second);
+                const bool marks = args[0].marked() || args[1].marked() || args[2].marked();
+                if (marks) r.zeroDiv.resize(r.data.size());
+                for (size_t k = 0; k < r.data.size(); ++k) {
+                    const bool yes = cond.data[k] != 0;
+                    if (!yes) r.data[k] = other.data[k];
+                    if (marks) r.zeroDiv[k] = args[0].mark(k) | (yes ? args[1].mark(k) : args[2].mark(k));
+                }
+                st.push_back(move(r));
+            }
+            else if (findTable(f) >= 0) {
+                const Table& t = tabulated()[findTable(f)];
+                st.push_back(withMarks(mapEach(args[0], [&t](double v) { return t.at(v); }), {&args[0]}));
+            }
+            else {   // scalar functions apply elementwise
+                static const map<string,double(*)(double)> fns = {
+                    {"sin", sin}, {"cos", cos}, {"tan", tan}, {"sqrt", sqrt},
+                    {"log", log10}, {"ln", log}, {"exp", exp}, {"abs", fabs}
+                };
+                st.push_back(withMarks(mapEach(args[0], fns.at(f)), {&args[0]}));
+            }
+        }
+    }
+    if (st.size() != 1) throw runtime_error("Invalid expression");
+    if (st.back().marked()) throw runtime_error(errorMessage(CalcError::DivideByZero));
+    return move(st.back());
+}
+
+void printMatrix(const Matrix& m, ostream& os, const NumberFormat& f) {
+    const size_t show = 6;
+    auto visible = [&](size_t i, size_t n) { return n <= 2 * show || i < show || i >= n - show; };
+    for (size_t i = 0; i < m.rows; ++i) {
+        if (!visible(i, m.rows)) {
+            if (i == show) os << "  ...\n";
+            continue;
+        }
+        os << (i == 0 ? "[ " : "  ");
+        for (size_t j = 0; j < m.cols; ++j) {
+            if (!visible(j, m.cols)) {
+                if (j == show) os << "  ...";
+                continue;
+            }
+            os << (j ? "  " : "") << formatNumber(m.at(i, j), f);
+        }
+        os << (i + 1 == m.rows ? " ]\n" : "\n");
+    }
+    os << "  (" << m.rows << "x" << m.cols << ")\n";
+}
@@ -0,0 +1,74 @@
+// matrix.h
+// Vectors and matrices
+//
+// Expressions containing [ ... ] literals or matrix functions are evaluated
+// here instead of by the scalar VM.  A scalar is just a 1x1 matrix.
+// Arithmetic operators work elementwise (a scalar operand is broadcast),
+// and dividing by zero is an error as it is for scalars unless if()
+// discards that element.  Products and solves go through the functions
+// below.  matmul is a packed, cache-blocked kernel with a 4x8 SIMD
+// micro-kernel, split across the thread pool for large sizes.
+
+#pragma once
+
+#include "format.h"
+#include "parser.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct Matrix {
+    size_t rows = 1, cols = 1;
+    std::vector<double> data;   // row-major
+
+    Matrix(size_t r = 1, size_t c = 1, double fill = 0) : rows(r), cols(c), data(r * c, fill) {}
+
+    bool    isScalar() const             { return rows == 1 && cols == 1; }
+    double& at(size_t i, size_t j)       { return data[i * cols + j]; }
+    double  at(size_t i, size_t j) const { return data[i * cols + j]; }
+};
+
+Matrix transpose(const Matrix& a);
+double dot(const Matrix& a, const Matrix& b);
+Matrix matmul(const Matrix& A, const Matrix& B);
+
+// In-place LU with partial pivoting (row-major, rank-1 row updates spread
+// over the pool for big systems).  Returns false if A is singular.
+bool luDecompose(Matrix& A, std::vector<size_t>& perm, int& sign);
+
+double det(const Matrix& A);
+
+// Solve A X = B; a row vector B is treated as a column
+Matrix solveLinear(const Matrix& A, const Matrix& Bin);
+
+// Evaluate a polynomial (coefficients highest degree first, as typed) at
+// every x.  Lanes are processed 64 at a time; from degree 8 up Estrin's
+// scheme replaces Horner's so the multiply-adds of one lane do not form a
+// single dependency chain.
+void polyBulk(const std::vector<double>& coeffs, const double* x, double* out, size_t n);
+
+// ---------------------------------------------------------------------------
+// Matrix expressions
+// ---------------------------------------------------------------------------
+
+// Postfix for matrix expressions: calls carry their argument count and
+// literals their shape, which plain Tokens cannot express
+struct ArrayOp {
+    enum Kind { VALUE, OPERATOR, CALL, BUILD } kind;
+    std::string text;
+    double value = 0;
+    size_t rows = 0, cols = 0;   // BUILD shape; CALL uses cols as the argument count
+};
+
+// (commas alone are the arguments of if, min and max)
+bool isArrayExpression(const TokenList& tokens);
+
+// Shunting-yard for matrix expressions (same precedence rules as infixToPostfix)
+std::vector<ArrayOp> arrayPostfix(const TokenList& in);
+
+// Evaluate matrix postfix
+Matrix evalArray(const std::vector<ArrayOp>& pf);
+
+// Print a matrix, eliding the middle of big ones
+void printMatrix(const Matrix& m, std::ostream& os, const NumberFormat& f);
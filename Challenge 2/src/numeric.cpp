@@ -0,0 +1,489 @@
+// numeric.cpp
+// Integration, differentiation, solvers and reductions (see numeric.h)
+
+#include "numeric.h"
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+// Kronrod nodes (positive half, center last) and weights; the 7-point Gauss
+// rule uses the odd-numbered Kronrod nodes
+static const double gkNodes[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+static const double gkWeights[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+static const double gaussWeights[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+Integral integrate(const ProgramView& f, double a, double b, double tol, size_t maxIntervals) {
+    struct Piece { double a, b; };
+    struct Done  { double a, value, error; };   // an accepted interval
+    const size_t perBatch = batchLanes / 15 + 1;   // intervals evaluated together
+
+    // 15 nodes per interval through one batch call; returns (Kronrod, |K - G|)
+    auto rule = [&](BatchMachine& m, const vector<Piece>& ps,
+                    vector<double>& xs, vector<double>& fx, vector<pair<double,double>>& res) {
+        xs.resize(ps.size() * 15);
+        fx.resize(xs.size());
+        for (size_t i = 0; i < ps.size(); ++i) {
+            double c = 0.5 * (ps[i].a + ps[i].b), h = 0.5 * (ps[i].b - ps[i].a);
+            for (int k = 0; k < 7; ++k) {
+                xs[i*15 + 2*k]     = c - h * gkNodes[k];
+                xs[i*15 + 2*k + 1] = c + h * gkNodes[k];
+            }
+            xs[i*15 + 14] = c;
+        }
+        const double* cols[1] = {xs.data()};
+        executeBatch(m, cols, xs.size(), fx.data());
+        res.resize(ps.size());
+        for (size_t i = 0; i < ps.size(); ++i) {
+            const double* y = &fx[i*15];
+            double h = 0.5 * (ps[i].b - ps[i].a);
+            double kr = gkWeights[7] * y[14], ga = gaussWeights[3] * y[14];
+            for (int k = 0; k < 7; ++k) {
+                kr += gkWeights[k] * (y[2*k] + y[2*k + 1]);
+                if (k % 2 == 1) ga += gaussWeights[k / 2] * (y[2*k] + y[2*k + 1]);
+            }
+            res[i] = {kr * h, fabs(kr - ga) * h};
+        }
+    };
+
+    // First estimate over the whole range sets the (mixed abs/rel) target
+    double target;
+    {
+        BatchMachine m(f);
+        vector<double> xs, fx;
+        vector<pair<double,double>> r;
+        rule(m, {{a, b}}, xs, fx, r);
+        target = tol * max(1.0, fabs(r[0].first));
+        if (r[0].second <= target || a == b) return {r[0].first, r[0].second, 1, true};
+    }
+
+    mutex m;
+    condition_variable cv;
+    vector<Piece> queue;
+    const int seed = 16;
+    for (int i = 0; i < seed; ++i)
+        queue.push_back({a + (b - a) * i / seed, i + 1 == seed ? b : a + (b - a) * (i + 1) / seed});
+    size_t busy = 0, accepted = 0;
+    bool   converged = true;
+    vector<Done> done;   // from every thread, summed in interval order below
+
+    threadPool().parallel([&](unsigned) {
+        BatchMachine bm(f);
+        vector<double> xs, fx;
+        vector<pair<double,double>> res;
+        vector<Piece> mine, split;
+        vector<Done>  kept;
+        bool ok = true;
+
+        unique_lock<mutex> lk(m);
+        for (;;) {
+            cv.wait(lk, [&] { return !queue.empty() || busy == 0; });
+            if (queue.empty()) break;
+            size_t take = min(perBatch, queue.size());
+            mine.assign(queue.end() - take, queue.end());
+            queue.resize(queue.size() - take);
+            bool overBudget = accepted + queue.size() > maxIntervals;
+            busy++;
+            lk.unlock();
+
+            rule(bm, mine, xs, fx, res);
+            split.clear();
+            for (size_t i = 0; i < mine.size(); ++i) {
+                double len = mine[i].b - mine[i].a, mid = mine[i].a + 0.5 * len;
+                bool good = res[i].second <= target * fabs(len / (b - a));
+                bool stuck = overBudget || !isfinite(res[i].first) ||
+                             mid <= mine[i].a || mid >= mine[i].b;
+                if (good || stuck) {
+                    kept.push_back({mine[i].a, res[i].first, res[i].second});
+                    ok = ok && good;
+                }
+                else {
+                    split.push_back({mine[i].a, mid});
+                    split.push_back({mid, mine[i].b});
+                }
+            }
+
+            lk.lock();
+            queue.insert(queue.end(), split.begin(), split.end());
+            accepted += mine.size() - split.size() / 2;
+            busy--;
+            cv.notify_all();
+        }
+        done.insert(done.end(), kept.begin(), kept.end());
+        converged = converged && ok;
+        lk.unlock();
+        cv.notify_all();
+    });
+
+    // Which thread accepted an interval, and when, depends on scheduling;
+    // summing in interval order makes the result the same on every run
+    sort(done.begin(), done.end(), [](const Done& x, const Done& y) { return x.a < y.a; });
+    double value = 0, comp = 0, error = 0;   // Neumaier-compensated
+    for (const Done& d : done) {
+        const double t = value + d.value;
+        comp += fabs(value) >= fabs(d.value) ? (value - t) + d.value : (d.value - t) + value;
+        value = t;
+        error += d.error;
+    }
+    value += comp;
+    // intervals that could not be split further are fine if the total is
+    return {value, error, accepted, converged || error <= target};
+}
+
+Token numberToken(double v) {
+    ostringstream s;
+    s << setprecision(17) << v;
+    return {s.str(), NUMBER};
+}
+
+TokenList differentiate(const TokenList& pf, const string& var) {
+    struct Term {
+        TokenList f, d;   // postfix of the subexpression and of its derivative
+        bool zero, one;       // derivative is exactly 0 / exactly 1
+    };
+    auto cat = [](initializer_list<TokenList> parts) {
+        TokenList out;
+        for (auto &p : parts) out.insert(out.end(), p.begin(), p.end());
+        return out;
+    };
+    auto op  = [](const char* s) { return TokenList{{s, OPERATOR}}; };
+    auto fn  = [](const char* s) { return TokenList{{s, FUNCTION}}; };
+    auto num = [](double v) { return TokenList{numberToken(v)}; };
+    // g'(a) * a'
+    auto chain = [&](const TokenList& outer, const Term& a) {
+        Term t{{}, a.one ? outer : cat({outer, a.d, op("*")}), a.zero, false};
+        if (a.zero) t.d.clear();
+        return t;
+    };
+
+    vector<Term> st;
+    for (auto &tok : pf) {
+        if (tok.type == NUMBER || tok.type == VARIABLE) {
+            bool isVar = tok.type == VARIABLE && tok.text == var;
+            st.push_back({{tok}, isVar ? num(1) : TokenList{}, !isVar, isVar});
+            continue;
+        }
+        size_t need = tokenArity(tok);
+        if (st.size() < need) throw runtime_error("Invalid expression");
+        Term c;
+        if (need == 3) { c = st.back(); st.pop_back(); }
+        Term b = st.back(); st.pop_back();
+        Term a = need >= 2 ? st.back() : b;
+        if (need >= 2) st.pop_back();
+        Term r;
+        const string& t = tok.text;
+        // if(cond, da, db), or 0 when both are
+        auto pick = [&](const TokenList& cond, const Term& x, const Term& y) {
+            Term p{{}, {}, x.zero && y.zero, x.one && y.one};
+            if (!p.zero) p.d = cat({cond, x.zero ? num(0) : x.d, y.zero ? num(0) : y.d, fn("if")});
+            return p;
+        };
+
+        if (isComparison(t)) {   // piecewise constant
+            r.zero = true;
+            r.one  = false;
+        }
+        else if (t == "if") {    // a is the condition
+            r = pick(a.f, b, c);
+        }
+        else if (t == "min" || t == "max") {   // the derivative of the side chosen
+            r = pick(cat({a.f, b.f, op(t == "min" ? "<" : ">")}), a, b);
+        }
+        else if (t == "abs") {
+            r = chain(cat({a.f, num(0), op("<"), num(-1), num(1), fn("if")}), a);
+        }
+        else if (tok.type == FUNCTION) {
+            const TokenList& x = a.f;
+            TokenList g;
+            if      (t == "sin")  g = cat({x, fn("cos")});
+            else if (t == "cos")  g = cat({x, fn("sin"), op("neg")});
+            else if (t == "tan")  g = cat({num(1), x, fn("cos"), num(2), op("^"), op("/")});
+            else if (t == "sqrt") g = cat({num(0.5), x, fn("sqrt"), op("/")});
+            else if (t == "log")  g = cat({num(1), x, num(M_LN10), op("*"), op("/")});
+            else if (t == "ln")   g = cat({num(1), x, op("/")});
+            else if (t == "exp")  g = cat({x, fn("exp")});
+            else throw runtime_error("Cannot differentiate " + t);
+            r = chain(g, a);
+            r.f = cat({x, {tok}});
+        }
+        else if (t == "neg") {
+            r = {cat({a.f, {tok}}), a.zero ? TokenList{} : cat({a.d, op("neg")}), a.zero, false};
+        }
+        else if (t == "+" || t == "-") {
+            r.zero = a.zero && b.zero;
+            r.one  = (b.zero && a.one) || (t == "+" && a.zero && b.one);
+            if      (r.zero) {}
+            else if (b.zero) r.d = a.d;
+            else if (a.zero) r.d = t == "+" ? b.d : cat({b.d, op("neg")});
+            else             r.d = cat({a.d, b.d, {tok}});
+        }
+        else if (t == "*") {
+            r.zero = a.zero && b.zero;
+            r.one  = false;
+            TokenList left  = a.zero ? TokenList{} : a.one ? b.f : cat({a.d, b.f, op("*")});
+            TokenList right = b.zero ? TokenList{} : b.one ? a.f : cat({a.f, b.d, op("*")});
+            if      (r.zero)     {}
+            else if (b.zero)     r.d = left;
+            else if (a.zero)     r.d = right;
+            else                 r.d = cat({left, right, op("+")});
+        }
+        else if (t == "/") {
+            r.zero = a.zero && b.zero;
+            r.one  = false;
+            if (r.zero) {}
+            else if (b.zero) r.d = cat({a.d, b.f, op("/")});
+            else {
+                TokenList num2 = a.zero ? cat({a.f, b.d, op("*"), op("neg")})
+                                            : cat({a.d, b.f, op("*"), a.f, b.d, op("*"), op("-")});
+                r.d = cat({num2, b.f, num(2), op("^"), op("/")});
+            }
+        }
+        else {   // ^ and **
+            r.one = false;
+            if (b.zero) {   // constant exponent: b * a^(b-1) * a'
+                r.zero = a.zero;
+                if (!a.zero) r = chain(cat({b.f, a.f, b.f, num(1), op("-"), op("^"), op("*")}), a);
+            }
+            else {          // a^b * (b' ln a + b a' / a)
+                r.zero = false;
+                TokenList inner = cat({b.d, a.f, fn("ln"), op("*")});
+                if (!a.zero) inner = cat({inner, b.f, a.d, op("*"), a.f, op("/"), op("+")});
+                r.d = cat({a.f, b.f, op("^"), inner, op("*")});
+            }
+        }
+        if (r.f.empty()) r.f = cat({a.f, need >= 2 ? b.f : TokenList{}, need == 3 ? c.f : TokenList{}, {tok}});
+        st.push_back(move(r));
+    }
+    if (st.size() != 1) throw runtime_error("Invalid expression");
+    return st.back().zero ? num(0) : st.back().d;
+}
+
+Objective compileObjective(const string& expr, const vector<string>& vars) {
+    Objective o;
+    auto pf = infixToPostfix(tokenize(expr, vars));
+    o.f = compile(pf, vars);
+    try {
+        auto d1 = differentiate(pf, vars[0]);
+        o.df = compile(d1, vars);
+        o.hasDf = true;
+        o.d2f = compile(differentiate(d1, vars[0]), vars);
+        o.hasD2f = true;
+    }
+    catch (const exception&) {}   // no derivative: derivative-free methods only
+    return o;
+}
+
+Result<double> findRoot(ObjectiveRunner& r, double a, double b) {
+    const double eps = numeric_limits<double>::epsilon();
+    double fa = r.f(a), fb = r.f(b);
+    if (fa == 0) return a;
+    if (fb == 0) return b;
+    if ((fa > 0) == (fb > 0) || isnan(fa) || isnan(fb))
+        return CalcError::NoBracketedRoot;
+
+    if (r.o.hasDf) {   // safeguarded Newton
+        double lo = fa < 0 ? a : b, hi = fa < 0 ? b : a;
+        double x = 0.5 * (a + b), dxOld = fabs(b - a), dx = dxOld;
+        double fx = r.f(x), dfx = r.df(x);
+        for (int it = 0; it < 200; ++it) {
+            bool outside = ((x - hi) * dfx - fx) * ((x - lo) * dfx - fx) > 0;
+            if (outside || !isfinite(dfx) || fabs(2 * fx) > fabs(dxOld * dfx)) {
+                dxOld = dx;
+                dx = 0.5 * (hi - lo);
+                x = lo + dx;
+            }
+            else {
+                dxOld = dx;
+                dx = fx / dfx;
+                x -= dx;
+            }
+            if (fabs(dx) <= 2 * eps * fabs(x) + 1e-300) return x;
+            fx = r.f(x);
+            dfx = r.df(x);
+            if (fx == 0) return x;
+            if (fx < 0) lo = x; else hi = x;
+        }
+        return x;
+    }
+
+    // Brent's method
+    double c = b, fc = fb, d = b - a, e = d;
+    for (int it = 0; it < 300; ++it) {
+        if ((fb > 0) == (fc > 0)) { c = a; fc = fa; d = e = b - a; }
+        if (fabs(fc) < fabs(fb)) { a = b; b = c; c = a; fa = fb; fb = fc; fc = fa; }
+        double tol = 2 * eps * fabs(b) + 1e-300, m = 0.5 * (c - b);
+        if (fabs(m) <= tol || fb == 0) return b;
+        if (fabs(e) >= tol && fabs(fa) > fabs(fb)) {
+            double s = fb / fa, p, q;
+            if (a == c) { p = 2 * m * s; q = 1 - s; }
+            else {
+                double qq = fa / fc, rr = fb / fc;
+                p = s * (2 * m * qq * (qq - rr) - (b - a) * (rr - 1));
+                q = (qq - 1) * (rr - 1) * (s - 1);
+            }
+            if (p > 0) q = -q; else p = -p;
+            if (2 * p < min(3 * m * q - fabs(tol * q), fabs(e * q))) { e = d; d = p / q; }
+            else { d = m; e = m; }
+        }
+        else { d = m; e = m; }
+        a = b; fa = fb;
+        b += fabs(d) > tol ? d : (m > 0 ? tol : -tol);
+        fb = r.f(b);
+    }
+    return b;
+}
+
+double findMinimum(ObjectiveRunner& r, double a, double b) {
+    const double golden = 0.3819660112501051, eps = sqrt(numeric_limits<double>::epsilon());
+    if (a > b) swap(a, b);
+    double x = a + golden * (b - a), w = x, v = x;
+    double fx = r.f(x), fw = fx, fv = fx, d = 0, e = 0;
+    for (int it = 0; it < 500; ++it) {
+        double m = 0.5 * (a + b), tol = eps * fabs(x) + 1e-12;
+        if (fabs(x - m) <= 2 * tol - 0.5 * (b - a)) break;
+        bool golden_step = true;
+        if (fabs(e) > tol) {   // try a parabola through x, w, v
+            double p = (x - v) * (x - v) * (fx - fw) - (x - w) * (x - w) * (fx - fv);
+            double q = 2 * ((x - v) * (fx - fw) - (x - w) * (fx - fv));
+            if (q > 0) p = -p; else q = -q;
+            if (fabs(p) < fabs(0.5 * q * e) && p > q * (a - x) && p < q * (b - x)) {
+                e = d;
+                d = p / q;
+                double u = x + d;
+                if (u - a < 2 * tol || b - u < 2 * tol) d = x < m ? tol : -tol;
+                golden_step = false;
+            }
+        }
+        if (golden_step) {
+            e = (x < m ? b : a) - x;
+            d = golden * e;
+        }
+        double u = x + (fabs(d) >= tol ? d : (d > 0 ? tol : -tol));
+        double fu = r.f(u);
+        if (fu <= fx) {
+            (u < x ? b : a) = x;
+            v = w; fv = fw; w = x; fw = fx; x = u; fx = fu;
+        }
+        else {
+            (u < x ? a : b) = u;
+            if (fu <= fw || w == x)      { v = w; fv = fw; w = u; fw = fu; }
+            else if (fu <= fv || v == x || v == w) { v = u; fv = fu; }
+        }
+    }
+
+    // Brent stops near sqrt(eps); a few Newton steps on f' get to full precision
+    if (r.o.hasD2f) {
+        for (int it = 0; it < 8; ++it) {
+            double h = r.d2f(x);
+            if (!(h > 0)) break;
+            double u = x - r.df(x) / h;
+            if (!(u >= a && u <= b) || !(r.f(u) <= fx)) break;
+            if (u == x) break;
+            x = u;
+            fx = r.f(x);
+        }
+    }
+    return x;
+}
+
+vector<double> solveBatch(const Objective& o, bool minimize, double a, double b,
+                          const vector<double>& params) {
+    vector<double> out(params.size());
+    atomic<size_t> next{0};
+    const size_t chunk = 64;
+    threadPool().parallel([&](unsigned) {
+        ObjectiveRunner r(o);
+        for (size_t start; (start = next.fetch_add(chunk)) < params.size(); ) {
+            for (size_t i = start; i < min(start + chunk, params.size()); ++i) {
+                r.setParams(&params[i], 1);
+                r.error = CalcError::None;
+                Result<double> x = minimize ? Result<double>(findMinimum(r, a, b)) : findRoot(r, a, b);
+                out[i] = x.ok() && r.error == CalcError::None ? x.value : NAN;
+            }
+        }
+    });
+    return out;
+}
+
+double reduceRange(const ProgramView& body, double from, uint64_t count, Reduction op,
+                   ThreadPool& pool) {
+    if (count == 0) {
+        switch (op) {
+            case Reduction::Sum:  return 0;
+            case Reduction::Prod: return 1;
+            default:              return NAN;
+        }
+    }
+    // 4096 terms per block, more for huge ranges so at most 2^20 partials
+    const uint64_t block   = max<uint64_t>(4096, (count >> 20) + 1);
+    const uint64_t nblocks = (count + block - 1) / block;
+    vector<NeumaierSum> partial(nblocks);   // Prod/Min/Max only use .sum
+    atomic<uint64_t> next{0};
+
+    pool.parallel([&](unsigned) {
+        BatchMachine m(body);
+        vector<double> ks(batchLanes), vals(batchLanes);
+        const double* cols[1] = {ks.data()};
+        for (uint64_t bi; (bi = next.fetch_add(1)) < nblocks; ) {
+            const uint64_t lo = bi * block, hi = min(count, lo + block);
+            NeumaierSum acc;
+            if (op == Reduction::Prod) acc.sum = 1;
+            if (op == Reduction::Min)  acc.sum = INFINITY;
+            if (op == Reduction::Max)  acc.sum = -INFINITY;
+            for (uint64_t i = lo; i < hi; i += batchLanes) {
+                size_t n = min<uint64_t>(batchLanes, hi - i);
+                for (size_t l = 0; l < n; ++l) ks[l] = from + (double)(i + l);
+                executeBatch(m, cols, n, vals.data());
+                for (size_t l = 0; l < n; ++l) {
+                    double v = vals[l];
+                    switch (op) {
+                        case Reduction::Sum:  acc.add(v); break;
+                        case Reduction::Prod: acc.sum *= v; break;
+                        case Reduction::Min:  acc.sum = (v < acc.sum || isnan(v)) ? v : acc.sum; break;
+                        case Reduction::Max:  acc.sum = (v > acc.sum || isnan(v)) ? v : acc.sum; break;
+                    }
+                    if (isnan(acc.sum) && op != Reduction::Sum) break;
+                }
+            }
+            partial[bi] = acc;
+        }
+    });
+
+    NeumaierSum total;
+    double r = partial[0].sum;
+    if (op == Reduction::Sum) {
+        for (auto &p : partial) { total.add(p.sum); total.add(p.comp); }
+        return total.value();
+    }
+    for (uint64_t bi = 1; bi < nblocks; ++bi) {
+        double v = partial[bi].sum;
+        switch (op) {
+            case Reduction::Prod: r *= v; break;
+            case Reduction::Min:  r = (v < r || isnan(v)) ? v : r; break;
+            case Reduction::Max:  r = (v > r || isnan(v)) ? v : r; break;
+            default: break;
+        }
+    }
+    return r;
+}
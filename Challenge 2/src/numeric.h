@@ -0,0 +1,136 @@
+// numeric.h
+// Numerical integration, symbolic differentiation, root finding and
+// minimization, and range reductions
+
+#pragma once
+
+#include "errors.h"
+#include "parser.h"
+#include "threadpool.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Numerical integration
+//
+// Adaptive 15-point Gauss-Kronrod.  Subintervals sit in a shared work queue;
+// each thread takes several at a time so that all their nodes go through
+// executeBatch together, and splits any interval whose error estimate is
+// above its share of the tolerance.  Accepted intervals are summed in order
+// of position, not in the order threads finish, so repeated runs agree to
+// the last bit.
+// ---------------------------------------------------------------------------
+
+struct Integral {
+    double value, error;
+    size_t intervals;     // subintervals accepted
+    bool   converged;
+};
+
+// Integrate a one-variable program over [a, b]
+Integral integrate(const ProgramView& f, double a, double b, double tol = 1e-10,
+                   size_t maxIntervals = 1 << 20);
+
+// ---------------------------------------------------------------------------
+// Symbolic differentiation
+//
+// differentiate() turns the postfix of f into the postfix of df/dvar, one
+// token at a time with an explicit stack (no recursion).  Terms that are
+// known to be 0 or 1 are dropped as they appear so the result stays small.
+// ---------------------------------------------------------------------------
+
+// A number token that keeps every digit of v
+Token numberToken(double v);
+
+TokenList differentiate(const TokenList& pf, const std::string& var);
+
+// ---------------------------------------------------------------------------
+// Root finding and minimization
+//
+// solve() brackets a root and refines it with Newton steps when f' can be
+// derived symbolically, falling back to bisection whenever a Newton step
+// leaves the bracket; without f' it uses Brent's method.  minimize() uses
+// Brent's parabolic/golden-section search, then polishes with Newton on f'.
+// Everything runs on compiled programs, so an iteration is one VM call.
+// ---------------------------------------------------------------------------
+
+// f and, where they can be derived, f' and f''; variables are {x, params...}
+struct Objective {
+    Program f, df, d2f;
+    bool    hasDf = false, hasD2f = false;
+};
+
+Objective compileObjective(const std::string& expr, const std::vector<std::string>& vars);
+
+// Per-thread registers for an Objective; error remembers the first
+// evaluation that divided by zero
+struct ObjectiveRunner {
+    const Objective&         o;
+    std::pmr::vector<double> rf, rd{scratch()}, rd2{scratch()};
+    CalcError                error = CalcError::None;
+
+    explicit ObjectiveRunner(const Objective& obj)
+        : o(obj), rf(makeRegisters(obj.f.view())) {
+        if (o.hasDf)  rd  = makeRegisters(o.df.view());
+        if (o.hasD2f) rd2 = makeRegisters(o.d2f.view());
+    }
+    // Parameters fill variables 1..n
+    void setParams(const double* p, size_t n) {
+        std::copy(p, p + n, rf.begin() + 1);
+        if (o.hasDf)  std::copy(p, p + n, rd.begin() + 1);
+        if (o.hasD2f) std::copy(p, p + n, rd2.begin() + 1);
+    }
+    double f(double x)   { rf[0] = x;  return execute(o.f.view(), rf.data(), error); }
+    double df(double x)  { rd[0] = x;  return execute(o.df.view(), rd.data(), error); }
+    double d2f(double x) { rd2[0] = x; return execute(o.d2f.view(), rd2.data(), error); }
+    // Throw the remembered error, for single solves in the REPL
+    void check() const {
+        if (error != CalcError::None) throw std::runtime_error(errorMessage(error));
+    }
+};
+
+// Root of f in [a, b]; f(a) and f(b) must differ in sign
+Result<double> findRoot(ObjectiveRunner& r, double a, double b);
+
+// Location of the minimum of f in [a, b]
+double findMinimum(ObjectiveRunner& r, double a, double b);
+
+// Solve or minimize one instance per parameter value, spread over the pool.
+// Instances that fail come back as nan; nothing is thrown per instance.
+std::vector<double> solveBatch(const Objective& o, bool minimize, double a, double b,
+                               const std::vector<double>& params);
+
+// ---------------------------------------------------------------------------
+// Range reductions: sum / prod / min / max over k = from, from+1, ..., to
+//
+// The body is compiled once and evaluated in executeBatch blocks.  The range
+// is cut into blocks whose size depends only on the number of terms; each
+// block is reduced in a fixed order and the block results are combined in
+// block order, so the answer is bit-identical whatever the thread count.
+// Sums are Neumaier-compensated at both levels.
+// ---------------------------------------------------------------------------
+
+enum class Reduction { Sum, Prod, Min, Max };
+
+// Compensated running sum
+struct NeumaierSum {
+    double sum = 0, comp = 0;
+    void add(double v) {
+        double t = sum + v;
+        comp += std::fabs(sum) >= std::fabs(v) ? (sum - t) + v : (v - t) + sum;
+        sum = t;
+    }
+    double value() const { return sum + comp; }
+};
+
+// Reduce body(k) over count terms from k = from; pool is only a choice of
+// threads, never a change in the result
+double reduceRange(const ProgramView& body, double from, uint64_t count, Reduction op,
+                   ThreadPool& pool = threadPool());
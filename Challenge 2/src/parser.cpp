@@ -0,0 +1,543 @@
+// parser.cpp
+// Tokens, the tokenizer, infix to postfix and the postfix evaluator (see parser.h)
+
+#include "parser.h"
+
+#include "arena.h"
+#include "tables.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <regex>
+#include <stack>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+double numberValue(const Token& t) {
+    if (isalpha((unsigned char)t.text[0])) return constants.at(t.text);
+    return strtod(t.text.c_str(), nullptr);
+}
+
+BlockMasks classifyBlockScalar(const char* p) {
+    BlockMasks m;
+    for (int k = 0; k < 64; ++k) {
+        const uint64_t bit = 1ULL << k;
+        switch (charClasses[(uint8_t)p[k]]) {
+            case CC_DIGIT: m.digit |= bit; break;
+            case CC_ALPHA: m.alpha |= bit; break;
+            case CC_SPACE: m.space |= bit; break;
+            case CC_DOT:   m.dot   |= bit; break;
+            case CC_OPERATOR:
+            case CC_PUNCT: m.op    |= bit; break;
+        }
+    }
+    return m;
+}
+
+#if defined(__AVX2__)
+// Bytes are compared as signed, so anything >= 0x80 falls outside every range
+static inline __m256i between32(__m256i c, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), c));
+}
+
+static inline uint64_t inRange32(__m256i c, char lo, char hi) {
+    return (uint32_t)_mm256_movemask_epi8(between32(c, lo, hi));
+}
+
+// ! % & ( ) * + , - / ; < = > [ ] ^ | ~ as four ranges and five single bytes
+static inline uint64_t operators32(__m256i c) {
+    auto is = [&](char x) { return _mm256_cmpeq_epi8(c, _mm256_set1_epi8(x)); };
+    __m256i r = _mm256_or_si256(_mm256_or_si256(between32(c, '%', '&'), between32(c, '(', '-')),
+                                _mm256_or_si256(between32(c, ';', '>'), between32(c, ']', '^')));
+    r = _mm256_or_si256(r, _mm256_or_si256(_mm256_or_si256(is('!'), is('/')),
+                                           _mm256_or_si256(_mm256_or_si256(is('['), is('|')), is('~'))));
+    return (uint32_t)_mm256_movemask_epi8(r);
+}
+
+BlockMasks classifyBlock(const char* p) {
+    BlockMasks m;
+    for (int h = 0; h < 2; ++h) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(p + 32 * h));
+        __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+        __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')),
+                                        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(8)),
+                                                         _mm256_cmpgt_epi8(_mm256_set1_epi8(14), c)));
+        m.digit |= inRange32(c, '0', '9') << (32 * h);
+        m.alpha |= inRange32(lower, 'a', 'z') << (32 * h);
+        m.space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(blank) << (32 * h);
+        m.dot   |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('.'))) << (32 * h);
+        m.op    |= operators32(c) << (32 * h);
+    }
+    return m;
+}
+#elif defined(__SSE2__)
+static inline __m128i between16(__m128i c, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+}
+
+static inline uint64_t inRange16(__m128i c, char lo, char hi) {
+    return (uint16_t)_mm_movemask_epi8(between16(c, lo, hi));
+}
+
+static inline uint64_t operators16(__m128i c) {
+    auto is = [&](char x) { return _mm_cmpeq_epi8(c, _mm_set1_epi8(x)); };
+    __m128i r = _mm_or_si128(_mm_or_si128(between16(c, '%', '&'), between16(c, '(', '-')),
+                             _mm_or_si128(between16(c, ';', '>'), between16(c, ']', '^')));
+    r = _mm_or_si128(r, _mm_or_si128(_mm_or_si128(is('!'), is('/')),
+                                     _mm_or_si128(_mm_or_si128(is('['), is('|')), is('~'))));
+    return (uint16_t)_mm_movemask_epi8(r);
+}
+
+BlockMasks classifyBlock(const char* p) {
+    BlockMasks m;
+    for (int q = 0; q < 4; ++q) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(p + 16 * q));
+        __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+                                     _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(8)),
+                                                   _mm_cmplt_epi8(c, _mm_set1_epi8(14))));
+        m.digit |= inRange16(c, '0', '9') << (16 * q);
+        m.alpha |= inRange16(lower, 'a', 'z') << (16 * q);
+        m.space |= (uint64_t)(uint16_t)_mm_movemask_epi8(blank) << (16 * q);
+        m.dot   |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('.'))) << (16 * q);
+        m.op    |= operators16(c) << (16 * q);
+    }
+    return m;
+}
+#else
+BlockMasks classifyBlock(const char* p) { return classifyBlockScalar(p); }
+#endif
+
+// Finds the ends of character runs in one string, classifying each 64-byte
+// block once (the tokenizer asks about the same block many times)
+class CharScanner {
+public:
+    explicit CharScanner(string_view s) : s(s) {}
+
+    // First position >= pos whose class is not in classes (CC_* bits, where
+    // CC_OPERATOR and CC_PUNCT go together), or size()
+    size_t skip(size_t pos, uint8_t classes) {
+        while (pos < s.size()) {
+            const BlockMasks& m = block(pos / 64);
+            uint64_t in = (classes & CC_DIGIT ? m.digit : 0) | (classes & CC_ALPHA ? m.alpha : 0) |
+                          (classes & CC_SPACE ? m.space : 0) | (classes & CC_DOT ? m.dot : 0) |
+                          (classes & (CC_OPERATOR | CC_PUNCT) ? m.op : 0);
+            uint64_t out = ~in >> (pos % 64);
+            if (out) return min(s.size(), pos + __builtin_ctzll(out));
+            pos = (pos / 64 + 1) * 64;
+        }
+        return s.size();
+    }
+
+    // An upper bound on the number of tokens in s: one per run of letters,
+    // digits and '.', plus one per operator or punctuation byte (any other
+    // byte is an invalid character and ends tokenizing)
+    size_t maxTokens() {
+        size_t count = 0;
+        uint64_t inWord = 0;   // the previous block ended inside a run
+        for (size_t b = 0; 64 * b < s.size(); ++b) {
+            const BlockMasks& m = block(b);
+            const uint64_t word = m.digit | m.alpha | m.dot;
+            count += __builtin_popcountll(word & ~((word << 1) | inWord)) + __builtin_popcountll(m.op);
+            inWord = word >> 63;
+        }
+        return count;
+    }
+
+private:
+    const BlockMasks& block(size_t b) {
+        if (b != cachedBlock) {
+            cachedBlock = b;
+            if (s.size() - 64 * b >= 64) masks = classifyBlock(s.data() + 64 * b);
+            else {   // the last, partial block: zero padding is in no class
+                char tail[64] = {};
+                memcpy(tail, s.data() + 64 * b, s.size() - 64 * b);
+                masks = classifyBlock(tail);
+            }
+        }
+        return masks;
+    }
+
+    string_view s;
+    size_t      cachedBlock = SIZE_MAX;
+    BlockMasks  masks;
+};
+
+const unordered_map<string_view, TokenType>& reservedNames() {
+    static const unordered_map<string_view, TokenType> names = [] {
+        unordered_map<string_view, TokenType> m;
+        for (auto &c : constants) m.emplace(c.first, NUMBER);
+        for (auto &f : functions) m[f] = FUNCTION;
+        for (auto &f : matrixFunctionNames) m[f] = FUNCTION;
+        for (auto &f : integerFunctions) m[f.first] = FUNCTION;
+        m["xor"] = OPERATOR;
+        return m;
+    }();
+    return names;
+}
+
+ParseLimits parseLimits;
+
+bool isNumber(const string& s) {
+    static const regex numRx(R"(^[+-]?(\d+(\.\d*)?|\.\d+)([eE][+-]?\d+)?$)");
+    return regex_match(s, numRx);
+}
+
+Result<TokenList> tryTokenize(const string& expr, const vector<string>& vars) {
+    TokenList tokens(scratch());
+    size_t i = 0, n = expr.size();
+    int randoms = 0;
+    if (n > parseLimits.maxLength) return {CalcError::TooLong, to_string(parseLimits.maxLength)};
+    CharScanner scan(expr);
+    tokens.reserve(scan.maxTokens());   // no regrowth, which the arena could not reuse
+    // Tokens are built in place: the text is the larger part of the cost
+    auto emit = [&](const char* text, size_t len, TokenType type) {
+        Token& t = tokens.emplace_back();
+        t.text.assign(text, len);
+        t.type = type;
+    };
+
+    // Each pass starts at the next non-space byte (a ctz over the space mask)
+    // and dispatches once on its class
+    while ((i = scan.skip(i, CC_SPACE)) < n) {
+        const char    c   = expr[i];
+        const uint8_t cls = charClasses[(uint8_t)c];
+
+        // Hexadecimal and binary literals: 0xff, 0b1010
+        const char radix = c=='0' && i+2<n ? (char)(expr[i+1] | 0x20) : '\0';   // ASCII lower case
+        if ((radix=='x' || radix=='b') && isxdigit((unsigned char)expr[i+2])) {
+            const int base = radix=='x' ? 16 : 2;
+            size_t j = i + 2;
+            while (j<n && isxdigit((unsigned char)expr[j])) j++;
+            uint64_t v = 0;
+            auto [end, ec] = from_chars(expr.data() + i + 2, expr.data() + j, v, base);
+            if (ec == errc::result_out_of_range) return {CalcError::LiteralTooLarge, expr.substr(i, j-i)};
+            if (ec != errc() || end != expr.data() + j) return {CalcError::InvalidLiteral, expr.substr(i, j-i)};
+            tokens.push_back({to_string(v), NUMBER});
+            i = j;
+        }
+        // Number or scientific notation
+        else if (cls & (CC_DIGIT | CC_DOT)) {
+            size_t j = scan.skip(i, CC_DIGIT | CC_DOT);
+            if (j<n && (expr[j]=='e'||expr[j]=='E')) {
+                j++; 
+                if (j<n && (expr[j]=='+'||expr[j]=='-')) j++;
+                j = scan.skip(j, CC_DIGIT);
+            }
+            emit(expr.data() + i, j - i, NUMBER);
+            i = j;
+        }
+        // Brackets, separators and operators
+        else if (cls & (CC_OPERATOR | CC_PUNCT)) {
+            const char next = i+1<n ? expr[i+1] : '\0';
+            switch (c) {
+                case '(': emit(expr.data() + i, 1, LEFT_PAREN);    break;
+                case ')': emit(expr.data() + i, 1, RIGHT_PAREN);   break;
+                // Matrix literal punctuation: [1, 2; 3, 4]
+                case ',': emit(expr.data() + i, 1, COMMA);         break;
+                case ';': emit(expr.data() + i, 1, SEMICOLON);     break;
+                case '[': emit(expr.data() + i, 1, LEFT_BRACKET);  break;
+                case ']': emit(expr.data() + i, 1, RIGHT_BRACKET); break;
+                default:
+                    // Two-character operators: exponent and shifts
+                    if ((c=='*' || c=='<' || c=='>') && next==c) {
+                        emit(expr.data() + i, 2, OPERATOR);
+                        ++i;
+                    }
+                    // Comparisons: < <= > >= == !=
+                    else if ((next=='=' && isComparisonStart(c)) || c=='<' || c=='>') {
+                        const size_t len = next=='=' ? 2 : 1;
+                        emit(expr.data() + i, len, OPERATOR);
+                        i += len - 1;
+                    }
+                    // Unary sign: + or - where an operand is expected
+                    else if ((c=='-' || c=='+') &&
+                             (tokens.empty() || (tokens.back().type == OPERATOR && tokens.back().text != "!") ||
+                              tokens.back().type == LEFT_PAREN || tokens.back().type == COMMA ||
+                              tokens.back().type == SEMICOLON || tokens.back().type == LEFT_BRACKET)) {
+                        if (c=='-') tokens.push_back({"neg", OPERATOR});
+                    }
+                    // Single-character operators + - * / ^ % & | ~ and the postfix factorial !
+                    else if (cls == CC_OPERATOR) {
+                        emit(expr.data() + i, 1, OPERATOR);
+                    }
+                    else return {CalcError::InvalidCharacter, string(1, c)};   // a lone '='
+            }
+            ++i;
+        }
+        // Alphabetic names: either function or constant
+        else if (cls == CC_ALPHA) {
+            size_t j = scan.skip(i, CC_ALPHA);
+            const string_view name(expr.data() + i, j - i);
+            const auto known = reservedNames().find(name);
+            const TokenType kind = known == reservedNames().end() ? VARIABLE : known->second;
+
+            if (kind == OPERATOR || kind == FUNCTION) {   // xor, or a function
+                emit(name.data(), name.size(), kind);
+            }
+            else if (name == "rand" || name == "randn") {
+                size_t open = expr.find_first_not_of(' ', j);
+                size_t close = open == string::npos ? open : expr.find_first_not_of(' ', open + 1);
+                if (close == string::npos || expr[open] != '(' || expr[close] != ')')
+                    return {CalcError::UnknownName, string(name)};
+                // a fresh draw per occurrence, see randomVariables
+                tokens.push_back({string(name) + "#" + to_string(randoms++), VARIABLE});
+                j = close + 1;
+            }
+            else if (find(vars.begin(), vars.end(), name) != vars.end()) {
+                emit(name.data(), name.size(), VARIABLE);
+            }
+            else if (kind == NUMBER) {
+                // A number token that keeps the constant's name (see numberValue)
+                emit(name.data(), name.size(), NUMBER);
+            }
+            else if (findTable(name) >= 0) {
+                emit(name.data(), name.size(), FUNCTION);
+            }
+            else {
+                // Unknown identifier
+                return {CalcError::UnknownName, string(name)};
+            }
+            i = j;
+        }
+        // Anything else is invalid
+        else {
+            return {CalcError::InvalidCharacter, string(1, c)};
+        }
+    }
+
+    return tokens;
+}
+
+TokenList tokenize(const string& expr, const vector<string>& vars) {
+    return tryTokenize(expr, vars).get();
+}
+
+Result<bool> checkRealMode(const TokenList& tokens) {
+    for (auto &t : tokens)
+        if (t.type == OPERATOR && (t.text == "&" || t.text == "|" || t.text == "xor" ||
+                                   t.text == "<<" || t.text == ">>" || t.text == "~"))
+            return {CalcError::WholeNumbersOnly, t.text};
+    for (auto &t : tokens)
+        if ((t.type == OPERATOR && (t.text == "%" || t.text == "!")) ||
+            (t.type == FUNCTION && integerFunctions.count(t.text)))
+            return {CalcError::NeedsIntegerMode, t.text};
+    return true;
+}
+
+void requireRealMode(const TokenList& tokens) {
+    checkRealMode(tokens).get();
+}
+
+Result<TokenList> tryInfixToPostfix(const TokenList& in, bool integerOps) {
+    TokenList out(scratch());
+    out.reserve(count_if(in.begin(), in.end(), [](const Token& t) {
+        return t.type != LEFT_PAREN && t.type != RIGHT_PAREN;
+    }));
+    // Pending operators, functions and "(" point into in: the stack costs 8
+    // bytes per nesting level rather than a Token copy
+    stack<const Token*, pmr::vector<const Token*>> ops(pmr::vector<const Token*>{scratch()});
+    if (!integerOps) {
+        Result<bool> mode = checkRealMode(in);
+        if (!mode.ok()) return {mode.error, mode.detail};
+    }
+
+    for (auto &tok : in) {
+        switch (tok.type) {
+            case NUMBER:
+            case VARIABLE:
+                out.push_back(tok);
+                break;
+
+            case FUNCTION:
+                ops.push(&tok);
+                break;
+
+            case OPERATOR:
+                // A prefix operator has no left operand to finish first
+                // While top of ops stack has higher precedence, pop it first
+                while (tok.text != "neg" && tok.text != "~" && !ops.empty() &&
+                      (ops.top()->type == FUNCTION ||
+                       (ops.top()->type == OPERATOR &&
+                        (opPrec.at(ops.top()->text) > opPrec.at(tok.text) ||
+                        (opPrec.at(ops.top()->text) == opPrec.at(tok.text) &&
+                         !opRight.count(tok.text))))))
+                {
+                    out.push_back(*ops.top());
+                    ops.pop();
+                }
+                ops.push(&tok);
+                break;
+
+            case LEFT_PAREN:
+                ops.push(&tok);
+                break;
+
+            case RIGHT_PAREN:
+                // Pop until matching left parenthesis
+                while (!ops.empty() && ops.top()->type != LEFT_PAREN) {
+                    out.push_back(*ops.top());
+                    ops.pop();
+                }
+                if (!ops.empty()) ops.pop();  // remove "("
+                if (!ops.empty() && ops.top()->type == FUNCTION) {
+                    out.push_back(*ops.top());
+                    ops.pop();               // pop the function too
+                }
+                break;
+
+            case COMMA:
+                // Finish the argument so far: if(c, a, b), min(a, b)
+                while (!ops.empty() && ops.top()->type != LEFT_PAREN) {
+                    out.push_back(*ops.top());
+                    ops.pop();
+                }
+                if (ops.empty()) return {CalcError::Unexpected, tok.text};
+                break;
+
+            default:
+                // ; [ ] only appear in matrix expressions
+                return {CalcError::Unexpected, tok.text};
+        }
+        if (ops.size() > parseLimits.maxDepth) return {CalcError::TooDeep, to_string(parseLimits.maxDepth)};
+    }
+
+    // Pop any remaining operators
+    while (!ops.empty()) {
+        out.push_back(*ops.top());
+        ops.pop();
+    }
+
+    return out;
+}
+
+TokenList infixToPostfix(const TokenList& in, bool integerOps) {
+    return tryInfixToPostfix(in, integerOps).get();
+}
+
+int tokenArity(const Token& t) {
+    if (t.type == FUNCTION) {
+        auto it = functionArgs.find(t.text);
+        return it == functionArgs.end() ? 1 : it->second;
+    }
+    if (t.type == OPERATOR) return t.text == "neg" || t.text == "~" || t.text == "!" ? 1 : 2;
+    return 0;
+}
+
+static bool isIf(const Token& t) { return t.type == FUNCTION && t.text == "if"; }
+
+pmr::vector<Branch> findBranches(const TokenList& pf) {
+    pmr::vector<Branch> out(scratch());
+    if (none_of(pf.begin(), pf.end(), isIf)) return out;
+    pmr::vector<uint32_t> start(scratch());
+    for (uint32_t i = 0; i < pf.size(); ++i) {
+        const size_t k = tokenArity(pf[i]);
+        if (start.size() < k) break;
+        const uint32_t first = k ? start[start.size() - k] : i;
+        if (isIf(pf[i])) out.push_back({start[start.size() - 2], start[start.size() - 1], i});
+        start.resize(start.size() - k);
+        start.push_back(first);
+    }
+    return out;
+}
+
+pmr::vector<int32_t> branchStarts(const TokenList& pf, const pmr::vector<Branch>& branches) {
+    pmr::vector<int32_t> at(scratch());
+    if (branches.empty()) return at;
+    at.assign(pf.size(), 0);
+    for (size_t k = 0; k < branches.size(); ++k) {
+        at[branches[k].then]  =  (int32_t)(k + 1);
+        at[branches[k].other] = -(int32_t)(k + 1);
+    }
+    return at;
+}
+
+Result<double> tryEvalPostfix(const TokenList& pf) {
+    stack<double, pmr::vector<double>> st(pmr::vector<double>{scratch()});
+    const pmr::vector<Branch>   branches = findBranches(pf);
+    const pmr::vector<int32_t>  starts   = branchStarts(pf, branches);
+    pmr::vector<bool>           taken(branches.size(), false, scratch());
+
+    for (size_t i = 0; i < pf.size(); ++i) {
+        const Token& tok = pf[i];
+        if (!starts.empty() && starts[i] != 0) {
+            // Skip the operand that will not be returned; a 0 holds its place
+            const size_t k = abs(starts[i]) - 1;
+            if (starts[i] > 0) {
+                if (st.empty()) return CalcError::InvalidExpression;
+                taken[k] = st.top() != 0;
+                if (!taken[k]) { st.push(0); i = branches[k].other - 1; continue; }
+            }
+            else if (taken[k]) { st.push(0); i = branches[k].at - 1; continue; }
+        }
+        if (tok.type == NUMBER) {
+            st.push(numberValue(tok));  // convert text to double
+        }
+        else if (tok.type == VARIABLE) {
+            return {CalcError::UnknownName, tok.text};
+        }
+        else if (tok.type == FUNCTION && functionArgs.count(tok.text)) {
+            if (st.size() < (size_t)functionArgs.at(tok.text)) return CalcError::InvalidExpression;
+            double b = st.top(); st.pop();
+            double a = st.top(); st.pop();
+            if      (tok.text=="min") st.push(minOf(a, b));
+            else if (tok.text=="max") st.push(maxOf(a, b));
+            else {   // if: a is the then value, b the else value
+                double c = st.top(); st.pop();
+                st.push(c != 0 ? a : b);
+            }
+        }
+        else if (tok.type == FUNCTION) {
+            if (st.empty()) return CalcError::InvalidExpression;
+            double v = st.top(); st.pop();
+            if      (tok.text=="sin")  st.push(sin(v));
+            else if (tok.text=="cos")  st.push(cos(v));
+            else if (tok.text=="tan")  st.push(tan(v));
+            else if (tok.text=="sqrt") st.push(sqrt(v));
+            else if (tok.text=="log")  st.push(log10(v));
+            else if (tok.text=="ln")   st.push(log(v));
+            else if (tok.text=="exp")  st.push(exp(v));
+            else if (tok.text=="abs")  st.push(fabs(v));
+            else if (findTable(tok.text) >= 0) st.push(tabulated()[findTable(tok.text)].at(v));
+        }
+        else if (tok.type == OPERATOR && tok.text == "neg") {
+            if (st.empty()) return CalcError::InvalidExpression;
+            double v = st.top(); st.pop();
+            st.push(-v);
+        }
+        else if (tok.type == OPERATOR) {
+            if (st.size() < 2) return CalcError::InvalidExpression;
+            double b = st.top(); st.pop();
+            double a = st.top(); st.pop();
+            if      (tok.text=="+")  st.push(a + b);
+            else if (tok.text=="-")  st.push(a - b);
+            else if (tok.text=="*")  st.push(a * b);
+            else if (tok.text=="/")  {
+                if (b == 0) return CalcError::DivideByZero;
+                st.push(a / b);
+            }
+            else if (tok.text=="^"||tok.text=="**") {
+                st.push(pow(a, b));
+            }
+            else if (tok.text=="<")  st.push(a < b);
+            else if (tok.text=="<=") st.push(a <= b);
+            else if (tok.text==">")  st.push(a > b);
+            else if (tok.text==">=") st.push(a >= b);
+            else if (tok.text=="==") st.push(a == b);
+            else if (tok.text=="!=") st.push(a != b);
+        }
+    }
+
+    if (st.size() != 1) return CalcError::InvalidExpression;
+    return st.top();
+}
+
+double evalPostfix(const TokenList& pf) {
+    return tryEvalPostfix(pf).get();
+}
@@ -0,0 +1,173 @@
+// parser.h
+// Tokens, the tokenizer, infix to postfix and the postfix evaluator
+
+#pragma once
+
+#include "errors.h"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Token types for parsing expressions
+enum TokenType { NUMBER, VARIABLE, OPERATOR, FUNCTION, LEFT_PAREN, RIGHT_PAREN,
+                 COMMA, SEMICOLON, LEFT_BRACKET, RIGHT_BRACKET };
+struct Token {
+    std::string text;       // literal text of the token
+    TokenType   type;       // what kind of token it is
+};
+using TokenList = std::pmr::vector<Token>;
+
+// Operator precedence and associativity maps
+inline const std::map<std::string,int> opPrec = {
+    {"^", 11}, {"**", 11},
+    {"neg", 10}, {"~", 10},     // unary minus: -2^2 = -4, -2*3 = -6
+    {"*", 9}, {"/", 9}, {"%", 9},
+    {"+", 8}, {"-", 8},
+    {"<<", 7}, {">>", 7},       // bitwise operators bind as in C: 1 << 2 + 1 = 8
+    {"<", 6}, {"<=", 6}, {">", 6}, {">=", 6},
+    {"==", 5}, {"!=", 5},       // comparisons give 1 or 0: x > 0 == y > 0
+    {"&", 4}, {"xor", 3}, {"|", 2}
+};
+inline bool isComparison(const std::string& op) {
+    return op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=";
+}
+inline const std::map<std::string,bool> opRight = {
+    {"^", true}, {"**", true}, {"neg", true}, {"~", true}
+};
+
+// Recognized functions and constants
+inline const std::vector<std::string> functions = {
+    "sin","cos","tan","sqrt","log","ln","exp","abs","min","max","if"
+};
+// Functions taking more than one argument, and how many
+inline const std::map<std::string,int> functionArgs = {
+    {"min", 2}, {"max", 2}, {"if", 3}
+};
+inline const std::set<std::string> matrixFunctionNames = {
+    "dot", "matmul", "transpose", "solve", "det", "zeros", "ones", "eye",
+    "linspace", "fft", "ifft", "conv", "poly"
+};
+// Integer mode only, with their argument counts
+inline const std::map<std::string,int> integerFunctions = {
+    {"gcd", 2}, {"lcm", 2}, {"powmod", 3}, {"isprime", 1}, {"factor", 1}, {"primes", 2}
+};
+inline const std::map<std::string,double> constants = {
+    {"pi", M_PI},
+    {"e",  M_E}
+};
+
+// Value of a NUMBER token: a literal, or a constant by name so no digits
+// are lost to a decimal round trip
+double numberValue(const Token& t);
+
+// ---------------------------------------------------------------------------
+// Character scanning
+//
+// Machine-generated expressions can be hundreds of KB long, so the tokenizer
+// does not test characters one at a time.  A CharScanner classifies the
+// input 64 bytes at a time into digit, letter, space, '.' and
+// operator/punctuation bitmasks (AVX2 or SSE2 compares and movemask, or a
+// table lookup when neither is available), and "where does this run of
+// digits end" becomes a count of trailing zeros in the inverted mask.  Only
+// ASCII counts as a digit, letter or space, as in the C locale.
+//
+// Classification runs at GB/s; tokenizing as a whole does not.  Every token
+// is a Token holding its own std::string, about ten times the input bytes
+// it covers, so building them dominates (--bench reports ns per token).
+// The default build gets SSE2; AVX2 needs -march=native or -mavx2.
+// ---------------------------------------------------------------------------
+
+// CC_OPERATOR starts an operator token; CC_PUNCT is brackets, separators and
+// the comparison characters < > =
+enum CharClass : uint8_t {
+    CC_DIGIT = 1, CC_ALPHA = 2, CC_SPACE = 4, CC_DOT = 8, CC_OPERATOR = 16, CC_PUNCT = 32
+};
+
+inline const std::array<uint8_t,256> charClasses = [] {
+    std::array<uint8_t,256> t{};
+    for (int c = '0'; c <= '9'; ++c) t[c] = CC_DIGIT;
+    for (int c = 'a'; c <= 'z'; ++c) t[c] = t[c - 32] = CC_ALPHA;
+    for (char c : std::string(" \t\n\v\f\r")) t[(uint8_t)c] = CC_SPACE;
+    for (char c : std::string("+-*/^%!&|~")) t[(uint8_t)c] = CC_OPERATOR;
+    for (char c : std::string("(),;[]<>=")) t[(uint8_t)c] = CC_PUNCT;
+    t['.'] = CC_DOT;
+    return t;
+}();
+
+// The first character of <= >= == !=
+inline bool isComparisonStart(char c) { return c == '<' || c == '>' || c == '=' || c == '!'; }
+
+// One bit per byte of a 64-byte block, for each class; op covers both
+// CC_OPERATOR and CC_PUNCT
+struct BlockMasks { uint64_t digit = 0, alpha = 0, space = 0, dot = 0, op = 0; };
+
+BlockMasks classifyBlockScalar(const char* p);
+BlockMasks classifyBlock(const char* p);
+
+// Names the tokenizer knows without being told: xor is an OPERATOR, the
+// functions are FUNCTION and the constants NUMBER.  One hash lookup instead
+// of walking each list.
+const std::unordered_map<std::string_view, TokenType>& reservedNames();
+
+// How big one expression may get.  Parsing and evaluation never recurse:
+// every stack is a contiguous vector on the line arena whose size is the
+// nesting depth (open brackets and calls plus operators still waiting for
+// their right operand), so memory is O(length) for the tokens and
+// O(depth) for the rest, and these caps turn runaway input into an error
+// instead of gigabytes.  "limits" in the REPL shows and changes them.
+struct ParseLimits {
+    size_t maxLength = 64 << 20;   // characters in one expression
+    size_t maxDepth  = 4 << 20;    // pending brackets, calls and operators
+};
+extern ParseLimits parseLimits;
+
+// Check if a string matches a number (including scientific notation)
+bool isNumber(const std::string& s);
+
+// Break an input expression into tokens
+// (names listed in vars become VARIABLE tokens for compiled expressions)
+Result<TokenList> tryTokenize(const std::string& expr, const std::vector<std::string>& vars = {});
+TokenList tokenize(const std::string& expr, const std::vector<std::string>& vars = {});
+
+// %, ! and gcd() etc. only exist in integer mode, and bitwise operators only
+// on whole numbers; say so instead of failing later
+Result<bool> checkRealMode(const TokenList& tokens);
+void requireRealMode(const TokenList& tokens);
+
+// Convert infix tokens to postfix (Reverse Polish Notation); the integer
+// operators are only accepted for the fixed-width integer path
+Result<TokenList> tryInfixToPostfix(const TokenList& in, bool integerOps = false);
+TokenList infixToPostfix(const TokenList& in, bool integerOps = false);
+
+// How many operands a postfix token pops
+int tokenArity(const Token& t);
+
+// Where the operands of each if(c, t, e) lie in postfix: t is the tokens
+// [then, other), e is [other, at) and the if itself is at `at`.  One pass
+// with a stack holding the first token of every pending operand; a
+// malformed expression just yields fewer entries and fails later.
+struct Branch { uint32_t then, other, at; };
+
+std::pmr::vector<Branch> findBranches(const TokenList& pf);
+
+// For each postfix token: +k when it starts the then-operand of branch k-1,
+// -k when it starts the else-operand, else 0.  Empty without branches.
+std::pmr::vector<int32_t> branchStarts(const TokenList& pf, const std::pmr::vector<Branch>& branches);
+
+// min and max as written, plus NaN in either argument gives NaN (std::fmin
+// would drop it); both compile to a compare and a blend in batch loops
+inline double minOf(double a, double b) { return a < b || a != a ? a : b; }
+inline double maxOf(double a, double b) { return a > b || a != a ? a : b; }
+
+// Evaluate a postfix expression stack.  if(c, t, e) only evaluates the
+// operand it returns, so if(x != 0, 1/x, 0) does not fail at x = 0.
+Result<double> tryEvalPostfix(const TokenList& pf);
+double evalPostfix(const TokenList& pf);
@@ -0,0 +1,129 @@
+// perf.cpp
+// Hardware performance counters (see perf.h)
+
+#include "perf.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+PerfCounters::PerfCounters() {
+#if defined(__linux__)
+    static const uint64_t configs[PERF_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+    };
+    // The first event that opens (cycles, normally) leads a group the
+    // others join, so all of them count over the same intervals and one
+    // read returns them together.  An event the PMU cannot schedule
+    // alongside the group is counted on its own instead.
+    int firstError = 0;
+    for (int k = 0; k < PERF_EVENTS; ++k) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size           = sizeof attr;
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.config         = configs[k];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING |
+                              PERF_FORMAT_GROUP;
+        const int group = leader >= 0 ? fds[leader] : -1;
+        fds[k] = syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+        if (fds[k] >= 0) {
+            grouped[k] = true;
+            if (leader < 0) leader = k;
+            continue;
+        }
+        if (group >= 0) {
+            attr.read_format &= ~(uint64_t)PERF_FORMAT_GROUP;
+            fds[k] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+        if (fds[k] < 0 && !firstError) firstError = errno;
+    }
+    if (available()) return;
+    switch (firstError) {
+        case EACCES:
+        case EPERM: {
+            ifstream in("/proc/sys/kernel/perf_event_paranoid");
+            string level;
+            in >> level;
+            reason = "not permitted (perf_event_paranoid is " + (level.empty() ? "?" : level) +
+                     "; it must be 2 or lower, or run with CAP_PERFMON)";
+            break;
+        }
+        case ENOENT:
+        case ENODEV:
+        case EOPNOTSUPP: reason = "this CPU or virtual machine exposes no hardware counters"; break;
+        case ENOSYS:     reason = "perf_event_open is not available here"; break;
+        default:         reason = string("perf_event_open failed: ") + strerror(firstError);
+    }
+#else
+    reason = "hardware counters are only read on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds) if (fd >= 0) close(fd);
+}
+
+bool PerfCounters::available() const {
+    return any_of(begin(fds), end(fds), [](int fd) { return fd >= 0; });
+}
+
+PerfCounts PerfCounters::read() const {
+    PerfCounts c;
+    if (leader >= 0) {
+        uint64_t buf[3 + PERF_EVENTS];   // count, time enabled, time running, values
+        const uint64_t n = count(begin(grouped), end(grouped), true);
+        const ssize_t want = (3 + n) * sizeof(uint64_t);
+        if (::read(fds[leader], buf, sizeof buf) == want && buf[0] == n && buf[2] > 0) {
+            const double scale = (double)buf[1] / buf[2];
+            for (int k = 0, i = 3; k < PERF_EVENTS; ++k)
+                if (grouped[k]) c.v[k] = (double)buf[i++] * scale;
+        }
+    }
+    for (int k = 0; k < PERF_EVENTS; ++k) {
+        uint64_t buf[3];   // value, time enabled, time running
+        if (!grouped[k] && fds[k] >= 0 && ::read(fds[k], buf, sizeof buf) == (ssize_t)sizeof buf && buf[2] > 0)
+            c.v[k] = (double)buf[0] * ((double)buf[1] / buf[2]);
+    }
+    c.ns = chrono::duration<double, nano>(chrono::steady_clock::now().time_since_epoch()).count();
+    return c;
+}
+
+PerfCounters& perfCounters() {
+    static thread_local PerfCounters counters;
+    return counters;
+}
+
+void printPhases(const PerfPhases& p, ostream& os) {
+    auto cell = [&](double v, int width, int digits = 0) {
+        if (isnan(v)) os << setw(width) << "-";
+        else os << setw(width) << fixed << setprecision(digits) << v;
+    };
+    os << "  ⏱  " << left << setw(10) << "phase" << right << setw(10) << "ns"
+       << setw(10) << "cycles" << setw(14) << "instructions" << setw(6) << "IPC"
+       << setw(15) << "branch-misses" << setw(14) << "cache-misses" << "\n";
+    for (auto &[name, c] : p.phases) {
+        os << "     " << left << setw(10) << name << right;
+        cell(c.ns, 10, c.ns < 100 ? 1 : 0);
+        cell(c.v[PERF_CYCLES], 10);
+        cell(c.v[PERF_INSTRUCTIONS], 14);
+        cell(c.ipc(), 6, 2);
+        cell(c.v[PERF_BRANCH_MISSES], 15);
+        cell(c.v[PERF_CACHE_MISSES], 14);
+        os << "\n";
+    }
+    os << defaultfloat << setprecision(6);
+}
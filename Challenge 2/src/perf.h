@@ -0,0 +1,92 @@
+// perf.h
+// Hardware performance counters
+//
+// Wall-clock time shows that a phase got slower, not why.  The CPU's own
+// counters do: cycles and instructions (their ratio, IPC, falls when the
+// pipeline stalls), branch misses and last-level cache misses.  "profile
+// on" in the REPL and the counters benchmark read them around each phase
+// through perf_event_open, counting the calling thread in user space only.
+// Where that is refused (perf_event_paranoid above 2, a container's seccomp
+// filter, a VM without a PMU, a system other than Linux) every counter
+// reads as NaN, why() says what happened, and reports show time alone.
+
+#pragma once
+
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum PerfEvent { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_CACHE_MISSES, PERF_EVENTS };
+inline const char* const perfEventNames[PERF_EVENTS] = {
+    "cycles", "instructions", "branch-misses", "cache-misses"
+};
+
+// Wall-clock nanoseconds and counter values, NaN where not counted
+struct PerfCounts {
+    double ns = 0;
+    double v[PERF_EVENTS] = {NAN, NAN, NAN, NAN};
+
+    double ipc() const { return v[PERF_INSTRUCTIONS] / v[PERF_CYCLES]; }
+    PerfCounts operator-(const PerfCounts& o) const {
+        PerfCounts d;
+        d.ns = ns - o.ns;
+        for (int k = 0; k < PERF_EVENTS; ++k) d.v[k] = v[k] - o.v[k];
+        return d;
+    }
+    PerfCounts operator/(double n) const {
+        PerfCounts d = *this;
+        d.ns /= n;
+        for (double &x : d.v) x /= n;
+        return d;
+    }
+};
+
+// One counter per event for the thread that opens them, in one group so
+// that they are scheduled and read together
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    // Why no counter could be opened; empty when at least one was
+    const std::string& why() const { return reason; }
+
+    // Totals so far, scaled up when the kernel had to share the hardware
+    // counters between events (multiplexing)
+    PerfCounts read() const;
+
+private:
+    int         fds[PERF_EVENTS]     = {-1, -1, -1, -1};
+    bool        grouped[PERF_EVENTS] = {};   // read through fds[leader]
+    int         leader = -1;
+    std::string reason;
+};
+
+// The calling thread's counters, opened on first use
+PerfCounters& perfCounters();
+
+// Counts of the named phases of one piece of work, in the order they ran
+struct PerfPhases {
+    std::vector<std::pair<const char*, PerfCounts>> phases;
+
+    void clear() { phases.clear(); }
+    bool empty() const { return phases.empty(); }
+};
+
+// f(), with its counts added to p as phase `name` when p is set
+template<class F>
+auto measured(PerfPhases* p, const char* name, F&& f) -> decltype(f()) {
+    if (!p) return f();
+    const PerfCounts before = perfCounters().read();
+    auto r = f();
+    p->phases.push_back({name, perfCounters().read() - before});
+    return r;
+}
+
+// A table of phases; counters that were not read show as "-"
+void printPhases(const PerfPhases& p, std::ostream& os);
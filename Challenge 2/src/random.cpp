@@ -0,0 +1,108 @@
+// random.cpp
+// Random numbers and Monte Carlo (see random.h)
+
+#include "random.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace std;
+
+// One Philox4x32-10 block for counter (sample, stream) under a 64-bit key
+static inline void philox(uint64_t sample, uint32_t stream, uint64_t seed, uint32_t out[4]) {
+    uint32_t c0 = (uint32_t)sample, c1 = (uint32_t)(sample >> 32), c2 = stream, c3 = 0;
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    for (int round = 0; round < 10; ++round) {
+        uint64_t p0 = (uint64_t)0xD2511F53u * c0, p1 = (uint64_t)0xCD9E8D57u * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0, n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// 53 random bits -> [0, 1)
+static inline double unitDouble(uint32_t hi, uint32_t lo) {
+    return (double)((((uint64_t)hi << 32) | lo) >> 11) * 0x1p-53;
+}
+
+void fillRandom(double* out, size_t n, uint64_t first, uint32_t stream, bool normal, uint64_t seed) {
+    for (size_t j = 0; j < n; ++j) {
+        uint32_t w[4];
+        philox(first + j, stream, seed, w);
+        double u = unitDouble(w[0], w[1]);
+        out[j] = normal ? sqrt(-2 * log1p(-u)) * cos(2 * M_PI * unitDouble(w[2], w[3])) : u;
+    }
+}
+
+bool isRandomVariable(const string& name) { return name.find('#') != string::npos; }
+
+vector<string> randomVariables(const TokenList& tokens) {
+    vector<string> names;
+    for (const Token& t : tokens)
+        if (t.type == VARIABLE && isRandomVariable(t.text)) names.push_back(t.text);
+    sort(names.begin(), names.end(), [](const string& a, const string& b) {
+        return stoi(a.substr(a.find('#') + 1)) < stoi(b.substr(b.find('#') + 1));
+    });
+    return names;
+}
+
+uint64_t defaultSeed() {
+    static const uint64_t seed = [] {
+        const char* env = getenv("CALC_SEED");
+        if (env) return (uint64_t)strtoull(env, nullptr, 0);
+        return (uint64_t)chrono::steady_clock::now().time_since_epoch().count() ^ (uint64_t)getpid() << 32;
+    }();
+    return seed;
+}
+
+void drawRandom(const vector<string>& names, double* regs, uint64_t sample) {
+    for (size_t k = 0; k < names.size(); ++k)
+        fillRandom(&regs[k], 1, sample, k, names[k].rfind("randn", 0) == 0, defaultSeed());
+}
+
+double evalScalar(const TokenList& tokens, PerfPhases* prof) {
+    auto postfix = measured(prof, "postfix", [&] { return infixToPostfix(tokens); });
+    vector<string> randoms = randomVariables(tokens);
+    Program prog = measured(prof, "compile", [&] { return compile(postfix, randoms); });
+    auto regs = makeRegisters(prog.view());
+    static atomic<uint64_t> nextSample{0};
+    drawRandom(randoms, regs.data(), nextSample.fetch_add(1, memory_order_relaxed));
+    return measured(prof, "eval", [&] { return execute(prog.view(), regs.data()); });
+}
+
+Moments monteCarlo(const ProgramView& body, const vector<string>& names, uint64_t count, uint64_t seed) {
+    // 4096 samples per block, more for huge runs so at most 2^20 partials
+    const uint64_t block   = max<uint64_t>(4096, (count >> 20) + 1);
+    const uint64_t nblocks = (count + block - 1) / block;
+    vector<Moments> partial(nblocks);
+    atomic<uint64_t> next{0};
+
+    threadPool().parallel([&](unsigned) {
+        BatchMachine m(body);
+        vector<vector<double>> cols(names.size(), vector<double>(block));
+        vector<const double*> ptrs;
+        for (auto &c : cols) ptrs.push_back(c.data());
+        vector<double> out(block);
+        for (uint64_t b; (b = next++) < nblocks; ) {
+            const uint64_t first = b * block, cnt = min(block, count - first);
+            for (size_t k = 0; k < names.size(); ++k)
+                fillRandom(cols[k].data(), cnt, first, k, names[k].rfind("randn", 0) == 0, seed);
+            executeBatch(m, ptrs.data(), cnt, out.data());
+            for (uint64_t j = 0; j < cnt; ++j) partial[b].add(out[j]);
+        }
+    });
+    Moments total;   // merged in block order: reproducible for any thread count
+    for (const auto &p : partial) total.merge(p);
+    return total;
+}
+
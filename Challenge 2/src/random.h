@@ -0,0 +1,49 @@
+// random.h
+// Random numbers and Monte Carlo
+//
+// rand() (uniform on [0, 1)) and randn() (standard normal) compile into
+// variables named rand#k / randn#k, one per occurrence, which the caller
+// fills before running the program.  Values come from Philox4x32-10, a
+// counter-based generator: draw (seed, sample, k) is a pure function of its
+// coordinates, so any block of samples can be generated on any thread and
+// results do not depend on the thread count.
+//
+// mc(expr, N [, seed]) averages expr over N samples in executeBatch blocks
+// spread over the pool and reports the standard error.
+
+#pragma once
+
+#include "parser.h"
+#include "perf.h"
+#include "stats.h"
+#include "vm.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// out[j] = draw (seed, first + j, stream), uniform or normal (Box-Muller)
+void fillRandom(double* out, size_t n, uint64_t first, uint32_t stream, bool normal, uint64_t seed);
+
+bool isRandomVariable(const std::string& name);
+
+// The rand#k / randn#k variables of a token list, in order of k
+std::vector<std::string> randomVariables(const TokenList& tokens);
+
+// Seed for the REPL and mc(): $CALC_SEED, else a fresh one per session
+uint64_t defaultSeed();
+
+// Write the draws of one sample into regs[0..names.size()); a pure function
+// of (defaultSeed(), sample, k), so callers on any thread pass their own
+// sample index
+void drawRandom(const std::vector<std::string>& names, double* regs, uint64_t sample);
+
+// A plain real expression as the REPL runs it: compiled, with fresh draws
+// for any rand() / randn() (the next sample from a process-wide atomic
+// counter, so concurrent calls never share one); prof, when set, gets the
+// counts of each phase
+double evalScalar(const TokenList& tokens, PerfPhases* prof = nullptr);
+
+// Mean of a program over samples [0, count) of its random variables
+Moments monteCarlo(const ProgramView& body, const std::vector<std::string>& names,
+                   uint64_t count, uint64_t seed);
@@ -0,0 +1,120 @@
+// sampling.cpp
+// Adaptive sampling (see sampling.h)
+
+#include "sampling.h"
+#include "formulas.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+void evaluatePoints(const ProgramView& f, const vector<double>& xs, vector<double>& ys) {
+    const size_t n = xs.size(), chunk = 64 * batchLanes;
+    ys.resize(n);
+    atomic<size_t> next{0};
+    auto worker = [&](unsigned) {
+        BatchMachine m(f);
+        for (size_t s; (s = next.fetch_add(chunk)) < n; ) {
+            const double* cols[1] = {xs.data() + s};
+            executeBatch(m, cols, min(chunk, n - s), ys.data() + s);
+        }
+    };
+    if (n < 4 * chunk) worker(0);
+    else threadPool().parallel(worker);
+}
+
+SampleResult sampleAdaptive(const ProgramView& f, double a, double b, double tol,
+                            size_t maxPoints) {
+    if (!isfinite(a) || !isfinite(b) || !(a < b)) throw runtime_error("Need a < b, both finite");
+    const size_t n0 = 32;
+    SampleResult r;
+    // The grid, then one probe per interval at a jittered fraction of it, so
+    // a period that divides the spacing still shows up
+    vector<double> xs(2 * n0 + 1), ys;
+    for (size_t i = 0; i <= n0; ++i) xs[i] = i == n0 ? b : a + (b - a) * i / n0;
+    for (size_t i = 0; i < n0; ++i) {
+        const double t = 0.3 + 0.4 * fmod((i + 1) * 0.6180339887498949, 1.0);
+        xs[n0 + 1 + i] = xs[i] + t * (xs[i+1] - xs[i]);
+    }
+    evaluatePoints(f, xs, ys);
+
+    double lo = INFINITY, hi = -INFINITY;
+    for (size_t i = 0; i < xs.size(); ++i)
+        if (isfinite(ys[i])) { lo = min(lo, ys[i]); hi = max(hi, ys[i]); }
+    const double height = hi > lo ? hi - lo : lo == hi ? max(1.0, fabs(lo)) : 1.0;
+    const double limit  = tol * height;
+    const double top = isfinite(hi) ? hi + height : 0, bottom = isfinite(lo) ? lo - height : 0;
+    auto clip = [&](double y) { return min(top, max(bottom, y)); };
+    const double minWidth = ldexp((b - a) / n0, -40);
+
+    struct Span { double x0, y0, x1, y1; };
+    vector<Span> active, next;
+    // Keep (xm, ym) and split s there when it is off the chord
+    auto test = [&](const Span& s, double xm, double ym) {
+        r.points.push_back({xm, ym});
+        const int defined = isfinite(s.y0) + isfinite(ym) + isfinite(s.y1);
+        const double t = (xm - s.x0) / (s.x1 - s.x0);
+        const bool split = defined == 3 ? fabs(clip(ym) - (1 - t) * clip(s.y0) - t * clip(s.y1)) > limit
+                                        : defined > 0;
+        if (split && min(xm - s.x0, s.x1 - xm) > minWidth) {
+            next.push_back({s.x0, s.y0, xm, ym});
+            next.push_back({xm, ym, s.x1, s.y1});
+        }
+    };
+    for (size_t i = 0; i <= n0; ++i) r.points.push_back({xs[i], ys[i]});
+    for (size_t i = 0; i < n0; ++i) test({xs[i], ys[i], xs[i+1], ys[i+1]}, xs[n0 + 1 + i], ys[n0 + 1 + i]);
+    r.levels = 1;
+    active.swap(next);
+    while (!active.empty()) {
+        if (r.points.size() + active.size() > maxPoints) { r.truncated = true; break; }
+        xs.resize(active.size());
+        for (size_t k = 0; k < active.size(); ++k) xs[k] = 0.5 * (active[k].x0 + active[k].x1);
+        evaluatePoints(f, xs, ys);
+        ++r.levels;
+        next.clear();
+        for (size_t k = 0; k < active.size(); ++k) test(active[k], xs[k], ys[k]);
+        active.swap(next);
+    }
+    sort(r.points.begin(), r.points.end(), [](const SamplePoint& p, const SamplePoint& q) { return p.x < q.x; });
+    return r;
+}
+
+void writeSamples(const string& path, const vector<SamplePoint>& points) {
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out) throw runtime_error("Cannot write " + path);
+    const bool binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+    if (binary) {
+        SmpHeader h{};
+        memcpy(h.magic, smpMagic, sizeof h.magic);
+        h.version   = smpVersion;
+        h.byteOrder = cbcByteOrder;
+        h.count     = points.size();
+        out.write((const char*)&h, sizeof h);
+        out.write((const char*)points.data(), points.size() * sizeof(SamplePoint));
+    }
+    else {
+        vector<char> buf(1 << 20);
+        size_t used = 0;
+        out << "x,y\n";
+        for (const SamplePoint& p : points) {
+            if (buf.size() - used < 64) { out.write(buf.data(), used); used = 0; }
+            char* s = buf.data() + used;
+            char* e = buf.data() + buf.size();
+            s = to_chars(s, e, p.x).ptr;
+            *s++ = ',';
+            if (isnan(p.y)) s = copy_n("nan", 3, s);
+            else s = to_chars(s, e, p.y).ptr;
+            *s++ = '\n';
+            used = s - buf.data();
+        }
+        out.write(buf.data(), used);
+    }
+    if (!out) throw runtime_error("Cannot write " + path);
+}
@@ -0,0 +1,51 @@
+// sampling.h
+// Adaptive sampling
+//
+// sample(expr, x, a, b, tol) picks the points a plot needs.  It starts from
+// a coarse grid of 32 intervals, probed once each at a jittered interior
+// point, and then, level by level, evaluates the midpoint of every interval
+// still under suspicion; an interval is split again when its probe is
+// further than tol * (height of the curve) from the chord, or when the
+// function is defined at one end and not the other.  Values are clipped to
+// one height beyond the range seen on the grid, so a pole is followed only
+// where it crosses that window.  Flat regions stop after one test, while
+// bends and jumps are followed down to 2^-40 of the starting spacing.  Each level is one batch for executeBatch,
+// spread over the thread pool when it is large.
+
+#pragma once
+
+#include "vm.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SamplePoint { double x, y; };
+
+struct SampleResult {
+    std::vector<SamplePoint> points;   // sorted by x
+    size_t levels    = 0;
+    bool   truncated = false;          // stopped at the point budget
+};
+
+// ys[i] = f(xs[i])
+void evaluatePoints(const ProgramView& f, const std::vector<double>& xs, std::vector<double>& ys);
+
+SampleResult sampleAdaptive(const ProgramView& f, double a, double b, double tol,
+                            size_t maxPoints = 1 << 22);
+
+// Binary sample files: SmpHeader, then count (x, y) pairs of doubles
+inline const char         smpMagic[8] = {'C','A','L','C','S','M','P','\0'};
+inline constexpr uint32_t smpVersion  = 1;
+
+struct SmpHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;   // cbcByteOrder as written by the producer
+    uint64_t count;
+};
+static_assert(sizeof(SmpHeader) == 24 && sizeof(SamplePoint) == 16, "unexpected .bin padding");
+
+// Write points as "x,y" lines (shortest round-trip digits) or, for a .bin
+// path, as a SmpHeader and raw pairs; either way in 1 MB pieces
+void writeSamples(const std::string& path, const std::vector<SamplePoint>& points);
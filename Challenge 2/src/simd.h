@@ -0,0 +1,43 @@
+// simd.h
+// Four doubles in one SIMD value (SSE2 pairs by default, AVX with -march),
+// for the kernels in matrix.cpp and fft.cpp.  GCC and Clang use vector
+// extensions; other compilers get a plain struct with the same operators.
+
+#pragma once
+
+#include <cstring>
+
+// vec4 never crosses a library boundary, so GCC's note about the AVX
+// calling convention is silenced for these helpers only
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+typedef double vec4 __attribute__((vector_size(32)));
+inline vec4 splat4(double x) { return vec4{x, x, x, x}; }
+#else
+struct vec4 {
+    double v[4];
+    vec4& operator+=(const vec4& o) { for (int i = 0; i < 4; ++i) v[i] += o.v[i]; return *this; }
+    friend vec4 operator+(vec4 a, const vec4& b) { return a += b; }
+    friend vec4 operator-(const vec4& a, const vec4& b) {
+        vec4 r;
+        for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] - b.v[i];
+        return r;
+    }
+    friend vec4 operator*(const vec4& a, const vec4& b) {
+        vec4 r;
+        for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] * b.v[i];
+        return r;
+    }
+};
+inline vec4 splat4(double x) { return vec4{{x, x, x, x}}; }
+#endif
+inline vec4 load4(const double* p)          { vec4 v; std::memcpy(&v, p, sizeof v); return v; }
+inline void store4(double* p, const vec4& v) { std::memcpy(p, &v, sizeof v); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,129 @@
+// stats.cpp
+// Streaming statistics (see stats.h)
+
+#include "stats.h"
+#include "threadpool.h"
+
+#include <charconv>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+
+static bool isStatSeparator(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',' || c == ';';
+}
+
+// Parse every finite number in [p, end) into st; anything else (words, nan,
+// inf, overflow) is counted as skipped
+static void accumulateText(const char* p, const char* end, StreamStats& st) {
+    while (p < end) {
+        while (p < end && isStatSeparator(*p)) ++p;
+        if (p == end) break;
+        const char* tok = p;
+        while (p < end && !isStatSeparator(*p)) ++p;
+        double v;
+        auto [ptr, ec] = from_chars(tok + (*tok == '+'), p, v);
+        if (ec == errc() && ptr == p && isfinite(v)) st.add(v);
+        else ++st.skipped;
+    }
+}
+
+void streamStats(istream& in, vector<StreamStats>& partial) {
+    const size_t block = 1 << 20;
+    mutex readLock;
+    string carry;   // an unfinished number at the end of the last block
+    bool eof = false;
+    threadPool().parallel([&](unsigned t) {
+        string chunk;
+        for (;;) {
+            {
+                lock_guard<mutex> lk(readLock);
+                if (eof) return;
+                chunk.swap(carry);
+                carry.clear();
+                size_t have = chunk.size();
+                chunk.resize(have + block);
+                in.read(&chunk[have], block);
+                chunk.resize(have + in.gcount());
+                if (in.gcount() == 0) eof = true;
+                else {
+                    size_t cut = chunk.size();
+                    while (cut > 0 && !isStatSeparator(chunk[cut - 1])) --cut;
+                    carry.assign(chunk, cut, string::npos);
+                    chunk.resize(cut);
+                }
+            }
+            accumulateText(chunk.data(), chunk.data() + chunk.size(), partial[t]);
+        }
+    });
+}
+
+void printStats(const StreamStats& st, ostream& os) {
+    os << "📊 " << st.moments.count << " value(s)";
+    if (st.skipped) os << ", " << st.skipped << " non-numeric or non-finite token(s) skipped";
+    os << "\n";
+    if (!st.moments.count) return;
+    const double var = st.moments.variance();
+    os << setprecision(10) << defaultfloat
+       << "  sum       " << st.sum.value() << "\n"
+       << "  mean      " << st.moments.mean << "\n"
+       << "  variance  " << var << "   (sample)\n"
+       << "  std dev   " << sqrt(var) << "\n"
+       << "  min       " << st.lo << "\n"
+       << "  max       " << st.hi << "\n";
+
+    const auto cdf = st.sketch.cdf();
+    const uint64_t total = cdf.back().second;
+    auto quantile = [&](double q) {
+        uint64_t rank = (uint64_t)ceil(q * total);
+        auto it = lower_bound(cdf.begin(), cdf.end(), rank,
+                              [](const pair<double,uint64_t>& p, uint64_t r) { return p.second < r; });
+        return it == cdf.end() ? st.hi : it->first;
+    };
+    os << "  quantiles (approximate):\n";
+    for (double q : {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99})
+        os << "    p" << setw(2) << left << int(q * 100 + 0.5) << right << "     " << quantile(q) << "\n";
+
+    if (st.hi > st.lo) {
+        // Halved so that hi - lo stays finite across the whole double range
+        const double half = st.hi / 2 - st.lo / 2;
+        const int bins = 10, width = 40;
+        uint64_t counts[bins] = {}, prev = 0;   // sketch weight per bin
+        for (auto &p : cdf) {
+            int b = min(bins - 1, int((p.first / 2 - st.lo / 2) / half * bins));
+            counts[b] += p.second - prev;
+            prev = p.second;
+        }
+        const uint64_t peak = *max_element(counts, counts + bins);
+        os << "  histogram:\n" << setprecision(4);
+        for (int b = 0; b < bins; ++b) {
+            const double from = 2 * (st.lo / 2 + half / bins * b);
+            const double share = double(counts[b]) / total;
+            os << "    " << setw(11) << from << "  " << setw(6) << fixed << setprecision(2) << share * 100
+               << "%  " << string(size_t(double(counts[b]) / peak * width + 0.5), '#') << "\n"
+               << defaultfloat << setprecision(4);
+        }
+    }
+}
+
+int runStats(const vector<string>& files) {
+    vector<StreamStats> partial(threadPool().size());
+    if (files.empty()) streamStats(cin, partial);
+    for (const string& f : files) {
+        if (f == "-") {
+            streamStats(cin, partial);
+            continue;
+        }
+        ifstream in(f, ios::binary);
+        if (!in) throw runtime_error("Cannot open " + f);
+        streamStats(in, partial);
+    }
+    StreamStats total;
+    for (const auto &p : partial) total.merge(p);
+    printStats(total, cout);
+    return 0;
+}
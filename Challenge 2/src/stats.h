@@ -0,0 +1,136 @@
+// stats.h
+// Streaming statistics
+//
+// "calculator --stats [file ...]" reads numbers (separated by whitespace,
+// commas or semicolons) from the files, or stdin, and prints count, mean,
+// variance, extremes, quantiles and a histogram after a single pass.
+//
+// Reading is serialized in 1 MB blocks; parsing and accumulation run on the
+// pool, each thread into its own StreamStats, merged at the end.  Memory is
+// bounded by the block buffers plus a KLL quantile sketch per thread, which
+// keeps O(k log(n/k)) samples whatever the input size.
+
+#pragma once
+
+#include "numeric.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// KLL sketch: level h holds samples of weight 2^h.  A full level is sorted and
+// every other element (random offset) is promoted; lower levels get smaller
+// capacities, so nearly all samples sit in the top few levels.
+class KllSketch {
+public:
+    void add(double v) {
+        levels[0].push_back(v);
+        if (levels[0].size() >= capacity(0)) compress();
+    }
+
+    void merge(const KllSketch& other) {
+        if (other.levels.size() > levels.size()) levels.resize(other.levels.size());
+        for (size_t h = 0; h < other.levels.size(); ++h)
+            levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        compress();
+    }
+
+    // Weighted samples sorted by value, with cumulative weights
+    std::vector<std::pair<double,uint64_t>> cdf() const {
+        std::vector<std::pair<double,uint64_t>> s;
+        for (size_t h = 0; h < levels.size(); ++h)
+            for (double v : levels[h]) s.push_back({v, uint64_t(1) << h});
+        std::sort(s.begin(), s.end());
+        uint64_t total = 0;
+        for (auto &p : s) p.second = total += p.second;
+        return s;
+    }
+
+private:
+    static constexpr size_t k = 256;
+    std::vector<std::vector<double>> levels{1};
+    uint64_t coin = 0x9E3779B97F4A7C15ull;
+
+    size_t capacity(size_t h) const {
+        size_t cap = k;
+        for (size_t d = levels.size() - 1 - h; d > 0 && cap > 8; --d) cap = cap * 2 / 3;
+        return std::max<size_t>(cap, 8);
+    }
+
+    void compress() {
+        for (size_t h = 0; h < levels.size(); ++h) {
+            if (levels[h].size() < capacity(h)) continue;
+            if (h + 1 == levels.size()) levels.emplace_back();
+            std::vector<double>& lv = levels[h];
+            std::sort(lv.begin(), lv.end());
+            coin ^= coin << 13; coin ^= coin >> 7; coin ^= coin << 17;
+            const size_t even = lv.size() & ~size_t(1);   // an odd one out stays here
+            for (size_t i = coin & 1; i < even; i += 2) levels[h + 1].push_back(lv[i]);
+            lv.erase(lv.begin(), lv.begin() + even);
+        }
+    }
+};
+
+// Welford running mean and variance; partials combine with Chan's rule
+struct Moments {
+    uint64_t count = 0;
+    double   mean = 0, m2 = 0;
+
+    void add(double v) {
+        ++count;
+        double d = v - mean;
+        mean += d / count;
+        m2 += d * (v - mean);
+    }
+    void merge(const Moments& o) {
+        if (!o.count) return;
+        const double n = double(count + o.count), d = o.mean - mean;
+        mean += d * o.count / n;
+        m2 += o.m2 + d * d * double(count) * o.count / n;
+        count += o.count;
+    }
+    double variance() const { return count > 1 ? m2 / (count - 1) : 0; }   // sample variance
+};
+
+// One pass worth of aggregates
+struct StreamStats {
+    Moments     moments;
+    uint64_t    skipped = 0;
+    double      lo = INFINITY, hi = -INFINITY;
+    NeumaierSum sum;
+    KllSketch   sketch;
+
+    void add(double v) {
+        moments.add(v);
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+        sum.add(v);
+        sketch.add(v);
+    }
+
+    void merge(const StreamStats& o) {
+        if (o.moments.count) {
+            moments.merge(o.moments);
+            lo = std::min(lo, o.lo);
+            hi = std::max(hi, o.hi);
+            sum.add(o.sum.sum);
+            sum.add(o.sum.comp);
+            sketch.merge(o.sketch);
+        }
+        skipped += o.skipped;
+    }
+};
+
+// Read a whole stream in blocks, accumulating on every pool thread
+void streamStats(std::istream& in, std::vector<StreamStats>& partial);
+
+// Print the summary, quantiles from the sketch and a 10-bin histogram
+void printStats(const StreamStats& st, std::ostream& os);
+
+// --stats: every file in turn ("-" or no files: stdin)
+int runStats(const std::vector<std::string>& files);
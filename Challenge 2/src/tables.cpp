@@ -0,0 +1,112 @@
+// tables.cpp
+// Tabulated functions (see tables.h)
+
+#include "tables.h"
+
+#include "formulas.h"
+#include "parser.h"
+#include "vm.h"
+
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+vector<Table>& tabulated() {
+    static vector<Table> tables;
+    return tables;
+}
+
+long findTable(string_view name) {
+    auto& ts = tabulated();
+    for (size_t k = 0; k < ts.size(); ++k)
+        if (ts[k].name == name) return k;
+    return -1;
+}
+
+double evalArg(const string& arg) {
+    return execute(compile(infixToPostfix(tokenize(arg))));
+}
+
+const Table& defineTable(const FormulaLine& f) {
+    static const char* usage = "Tables look like table f(x) = expr, from : to [: step] [, linear | cubic]";
+    if (f.params.size() != 1) throw runtime_error("A table takes one variable: table f(x) = ...");
+    if (reservedNames().count(f.name) || f.name == "rand" || f.name == "randn")
+        throw runtime_error(f.name + " is a built-in name");
+    const vector<string> parts = splitTopLevel(f.body);
+    if (parts.size() < 2 || parts.size() > 3 ||
+        (parts.size() == 3 && parts[2] != "linear" && parts[2] != "cubic"))
+        throw runtime_error(usage);
+    vector<string> range;
+    for (size_t start = 0, colon; ; start = colon + 1) {
+        colon = parts[1].find(':', start);
+        range.push_back(parts[1].substr(start, colon - start));
+        if (colon == string::npos) break;
+    }
+    if (range.size() != 2 && range.size() != 3) throw runtime_error(usage);
+
+    Table t;
+    t.name   = f.name;
+    t.var    = f.params[0];
+    t.source = parts[0];
+    t.cubic  = parts.size() == 2 || parts[2] == "cubic";
+    t.lo = evalArg(range[0]);
+    const double to = evalArg(range[1]);
+    if (!(isfinite(t.lo) && isfinite(to) && t.lo < to)) throw runtime_error("Table range must be finite, from < to");
+    t.step = range.size() == 3 ? evalArg(range[2]) : (to - t.lo) / 1024;
+    if (!(t.step > 0)) throw runtime_error("Table step must be positive");
+    const double count = floor((to - t.lo) / t.step + 1e-9) + 1;
+    if (!(count >= 2 && count <= maxTablePoints))
+        throw runtime_error("A table has 2 to " + to_string(maxTablePoints) + " points");
+    const size_t n = count;
+    t.hi = t.lo + t.step * (n - 1);
+
+    // The grid points, then the interval midpoints, in one batch
+    Program prog = compile(infixToPostfix(tokenize(t.source, {t.var})), {t.var});
+    vector<double> xs(2*n - 1), ys(2*n - 1);
+    for (size_t k = 0; k < n; ++k)     xs[k]     = t.lo + t.step * k;
+    for (size_t k = 0; k + 1 < n; ++k) xs[n + k] = t.lo + t.step * (k + 0.5);
+    BatchMachine m(prog.view());
+    const double* cols[1] = {xs.data()};
+    executeBatch(m, cols, xs.size(), ys.data());
+
+    const double* y = ys.data();
+    auto slope = [&](size_t k) {   // dy per step
+        return k == 0 ? y[1] - y[0] : k == n - 1 ? y[n-1] - y[n-2] : (y[k+1] - y[k-1]) / 2;
+    };
+    t.coef.resize((n - 1) * (t.cubic ? 4 : 2));
+    for (size_t k = 0; k + 1 < n; ++k) {
+        if (!t.cubic) {
+            t.coef[2*k]     = y[k];
+            t.coef[2*k + 1] = y[k+1] - y[k];
+            continue;
+        }
+        const double m0 = slope(k), m1 = slope(k + 1);
+        double* c = &t.coef[4*k];
+        c[0] = y[k];
+        c[1] = m0;
+        c[2] = 3 * (y[k+1] - y[k]) - 2 * m0 - m1;
+        c[3] = 2 * (y[k] - y[k+1]) + m0 + m1;
+    }
+    for (size_t k = 0; k + 1 < n; ++k)
+        t.maxError = max(t.maxError, fabs(t.at(xs[n + k]) - ys[n + k]));
+
+    auto& ts = tabulated();
+    long k = findTable(t.name);
+    if (k < 0) {
+        k = ts.size();
+        ts.push_back(move(t));
+    }
+    else ts[k] = move(t);
+    return ts[k];
+}
+
+string describeTable(const Table& t) {
+    ostringstream s;
+    s << t.name << "(" << t.var << ") = " << t.source << " on [" << t.lo << ", " << t.hi << "], "
+      << t.intervals() + 1 << " points, " << (t.cubic ? "cubic" : "linear") << ", "
+      << (t.coef.size() * sizeof(double) + 1023) / 1024 << " KB, max error "
+      << setprecision(2) << t.maxError;
+    return s.str();
+}
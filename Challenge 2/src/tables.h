@@ -0,0 +1,61 @@
+// tables.h
+// Tabulated functions
+//
+// "table phi(x) = exp(-x^2/2) / sqrt(2*pi), -8 : 8 : 0.01" evaluates the
+// expression once at every grid point and from then on phi(x) is an
+// interpolation between neighbouring samples: a few multiply-adds in place
+// of the expression, whatever it costs.  Interpolation is cubic Hermite with
+// slopes from the neighbouring samples (add ", linear" for straight lines).
+// Building a table also measures its error against the expression at every
+// interval midpoint.  A table holds at most maxTablePoints samples, so its
+// memory is bounded too.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct FormulaLine;
+
+// A user-declared function of one variable, sampled once on an even grid
+// and interpolated between the samples (see defineTable).  Calls outside
+// the grid give NaN rather than an extrapolated guess.
+struct Table {
+    std::string         name, var, source;   // name(var) = source
+    double              lo = 0, hi = 0, step = 1;
+    bool                cubic = true;
+    std::vector<double> coef;      // per interval, in t = (x - x_k) / step: c0, c1[, c2, c3]
+    double              maxError = 0;   // against the exact value at interval midpoints
+
+    size_t intervals() const { return coef.size() / (cubic ? 4 : 2); }
+    double at(double x) const {
+        const double u = (x - lo) / step;
+        if (!(u >= 0 && x <= hi)) return NAN;
+        const size_t k = std::min((size_t)u, intervals() - 1);
+        const double t = u - k;
+        if (!cubic) return coef[2*k] + coef[2*k + 1] * t;
+        const double* c = &coef[4*k];
+        return ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+    }
+};
+
+// Tables declared so far; a call compiles to the table's index here
+std::vector<Table>& tabulated();
+
+long findTable(std::string_view name);
+
+inline constexpr size_t maxTablePoints = (1 << 20) + 1;
+
+// Evaluate a plain (variable-free) argument expression
+double evalArg(const std::string& arg);
+
+// Sample a "table" line's body, "expr, from : to [: step] [, linear | cubic]",
+// and add the table, or replace one with the same name.  The default step
+// cuts the range into 1024 intervals.
+const Table& defineTable(const FormulaLine& f);
+
+// "phi(x) = ... on [-8, 8], 1601 points, cubic, 50 KB, max error 1e-09"
+std::string describeTable(const Table& t);
@@ -0,0 +1,79 @@
+// threadpool.cpp
+// Thread pool (see threadpool.h)
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+thread_local bool ThreadPool::insidePool = false;
+
+ThreadPool::ThreadPool(unsigned threads) {
+    for (unsigned t = 1; t < threads; ++t)
+        workers.emplace_back([this, t] { workerLoop(t); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lk(m);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers) w.join();
+}
+
+void ThreadPool::parallel(const function<void(unsigned)>& fn) {
+    if (insidePool || workers.empty()) {
+        fn(0);
+        return;
+    }
+    unique_lock<mutex> lk(m);
+    job     = &fn;
+    pending = workers.size();
+    error   = nullptr;
+    generation++;
+    lk.unlock();
+    wake.notify_all();
+
+    runJob(fn, 0);
+    lk.lock();
+    done.wait(lk, [this] { return pending == 0; });
+    job = nullptr;
+    if (error) rethrow_exception(error);
+}
+
+void ThreadPool::runJob(const function<void(unsigned)>& fn, unsigned t) {
+    insidePool = true;
+    try { fn(t); }
+    catch (...) {
+        lock_guard<mutex> lk(m);
+        if (!error) error = current_exception();
+    }
+    insidePool = false;
+}
+
+void ThreadPool::workerLoop(unsigned t) {
+    uint64_t seen = 0;
+    unique_lock<mutex> lk(m);
+    for (;;) {
+        wake.wait(lk, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        const function<void(unsigned)>* fn = job;
+        lk.unlock();
+        runJob(*fn, t);
+        lk.lock();
+        if (--pending == 0) done.notify_one();
+    }
+}
+
+ThreadPool& threadPool() {
+    static ThreadPool pool([] {
+        const char* env = getenv("CALC_THREADS");
+        int n = env ? atoi(env) : 0;
+        return n > 0 ? (unsigned)n : max(1u, thread::hardware_concurrency());
+    }());
+    return pool;
+}
@@ -0,0 +1,43 @@
+// threadpool.h
+// Thread pool
+//
+// parallel(fn) runs fn on every pool thread and the caller, and returns when
+// all of them are done.  Callers share work through their own queues or
+// counters, so a nested parallel() call simply runs fn on the calling thread.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+
+    unsigned size() const { return workers.size() + 1; }
+
+    void parallel(const std::function<void(unsigned)>& fn);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex               m;
+    std::condition_variable  wake, done;
+    const std::function<void(unsigned)>* job = nullptr;
+    uint64_t                 generation = 0;
+    size_t                   pending    = 0;
+    bool                     stopping   = false;
+    std::exception_ptr       error;
+    static thread_local bool insidePool;
+
+    void runJob(const std::function<void(unsigned)>& fn, unsigned t);
+    void workerLoop(unsigned t);
+};
+
+// Shared pool, sized by $CALC_THREADS or the number of hardware threads
+ThreadPool& threadPool();
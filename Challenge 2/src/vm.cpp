@@ -0,0 +1,780 @@
+// vm.cpp
+// The expression compiler, the scalar VM and batch evaluation (see vm.h)
+
+#include "vm.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+// Calls worth a cache lookup; sqrt and the rest are cheaper than one
+static bool isMemoizable(uint8_t op) {
+    return op == OP_POW || op == OP_SIN || op == OP_COS || op == OP_TAN ||
+           op == OP_LOG || op == OP_LN || op == OP_EXP;
+}
+
+static const map<string,OpCode> funcOps = {
+    {"sin", OP_SIN}, {"cos", OP_COS}, {"tan", OP_TAN}, {"sqrt", OP_SQRT},
+    {"log", OP_LOG}, {"ln", OP_LN},   {"exp", OP_EXP}, {"abs", OP_ABS},
+    {"min", OP_MIN}, {"max", OP_MAX}, {"if", OP_SELECT}
+};
+static const map<string,OpCode> binOps = {
+    {"+", OP_ADD}, {"-", OP_SUB}, {"*", OP_MUL}, {"/", OP_DIV},
+    {"^", OP_POW}, {"**", OP_POW},
+    {"<", OP_LT}, {"<=", OP_LE}, {">", OP_LT}, {">=", OP_LE}, {"==", OP_EQ}, {"!=", OP_NE}
+};
+
+// Expression tree node built from postfix (children always precede parents)
+struct ExprNode {
+    int      op;     // OpCode, or -1 for a leaf that already lives in a register
+    int      a, b;   // child node indices, -1 when unused
+    uint32_t reg;    // register of a leaf, or of the emitted result
+    int      c = -1;      // third child (select's else value)
+    int      scope = 0;   // branch arm it is computed in (see compileAll), 0 for always
+};
+
+// Identity of a node for hash-consing: equal keys compute equal values
+struct ExprNodeHash {
+    size_t operator()(const ExprNode& n) const {
+        uint64_t h = (uint64_t)(uint32_t)n.op * 0x9E3779B97F4A7C15ULL;
+        h = (h ^ (uint32_t)n.a) * 0xBF58476D1CE4E5B9ULL;
+        h = (h ^ (uint32_t)n.b) * 0x94D049BB133111EBULL;
+        h = (h ^ (uint32_t)n.c ^ ((uint64_t)(uint32_t)n.scope << 32)) * 0x9E3779B97F4A7C15ULL;
+        return h ^ n.reg ^ (h >> 31);
+    }
+};
+struct ExprNodeEqual {
+    bool operator()(const ExprNode& x, const ExprNode& y) const {
+        return x.op == y.op && x.a == y.a && x.b == y.b && x.reg == y.reg &&
+               x.c == y.c && x.scope == y.scope;
+    }
+};
+
+// A subtree that is a polynomial in at most one variable
+struct PolyForm {
+    bool           ok = false;
+    int            var = -1;   // variable register, -1 for a constant
+    pmr::vector<double> c{scratch()};   // coefficients, lowest degree first
+    double         cost = 0;   // rough cost of the subtree as written
+};
+
+static const size_t maxPolyDegree = 32;
+
+static pmr::vector<double> polyProduct(const pmr::vector<double>& a, const pmr::vector<double>& b) {
+    pmr::vector<double> r(a.size() + b.size() - 1, 0.0, scratch());
+    for (size_t i = 0; i < a.size(); ++i)
+        for (size_t j = 0; j < b.size(); ++j) r[i + j] += a[i] * b[j];
+    return r;
+}
+
+static size_t nonzeros(const pmr::vector<double>& c) {
+    return count_if(c.begin(), c.end(), [](double v) { return v != 0; });
+}
+
+// c*x^k: a single term, safe to multiply out
+static bool monomial(const pmr::vector<double>& c) { return nonzeros(c) <= 1; }
+
+// Rewrite polynomial subtrees in one variable into Horner form when that
+// saves work: 3*x^5 + 2*x^4 - x^2 + 7 becomes a chain of multiply-adds with
+// no pow calls.  Only sums of monomials are multiplied out; factored forms
+// such as (x-1)^4 are left alone, since expanding them loses accuracy.
+// Nothing is folded away either: terms of the same degree are not added
+// ((x+1e16)-1e16 is 0 at x=1, not 1) and a zero factor is not dropped
+// (0*x + 5 is nan at x=inf), so the rewrite only reassociates.
+// constReg pools a constant and returns its register.  nodes may share
+// children (a DAG); a node is only dropped when every reader is rewritten.
+// roots (the expressions' values) are updated; nodes keep the
+// children-before-parents order.
+template<class ConstReg>
+static void hornerize(pmr::vector<ExprNode>& nodes, pmr::vector<int>& roots, uint32_t nv,
+                      const pmr::vector<double>& consts, const ConstReg& constReg) {
+    const size_t N = nodes.size();
+    pmr::vector<PolyForm> form(N, scratch());
+    for (size_t n = 0; n < N; ++n) {
+        const ExprNode& nd = nodes[n];
+        PolyForm& f = form[n];
+        if (nd.op < 0) {
+            f.ok = true;
+            if (nd.reg < nv) { f.var = nd.reg; f.c = {0, 1}; }
+            else             f.c = {consts[nd.reg - nv]};
+            continue;
+        }
+        const PolyForm& x = form[nd.a];
+        if (!x.ok) continue;
+        if (nd.op == OP_NEG) {
+            f = x;
+            for (double &v : f.c) v = -v;
+            f.cost += 1;
+            continue;
+        }
+        if (nd.b < 0 || !form[nd.b].ok) continue;
+        const PolyForm& y = form[nd.b];
+        if (x.var >= 0 && y.var >= 0 && x.var != y.var) continue;
+        f.var  = x.var >= 0 ? x.var : y.var;
+        f.cost = x.cost + y.cost + 1;
+        switch (nd.op) {
+            case OP_ADD:
+            case OP_SUB:   // terms of different degrees only, unless both are constants
+                if (f.var >= 0) {
+                    bool clash = false;
+                    for (size_t k = 0; k < min(x.c.size(), y.c.size()); ++k)
+                        clash = clash || (x.c[k] != 0 && y.c[k] != 0);
+                    if (clash) continue;
+                }
+                f.c.assign(max(x.c.size(), y.c.size()), 0.0);
+                for (size_t k = 0; k < x.c.size(); ++k) f.c[k] += x.c[k];
+                for (size_t k = 0; k < y.c.size(); ++k) f.c[k] += nd.op == OP_ADD ? y.c[k] : -y.c[k];
+                break;
+            case OP_MUL:   // expanding (x-1)*(x-1) would cancel badly near 1
+                if (x.c.size() + y.c.size() - 2 > maxPolyDegree ||
+                    (x.var >= 0 && y.var >= 0 && !(monomial(x.c) && monomial(y.c)))) continue;
+                f.c = polyProduct(x.c, y.c);
+                // 0*x stays as written, and so does a product that underflows
+                if (f.var >= 0 && (nonzeros(f.c) == 0 || nonzeros(f.c) != nonzeros(x.c) * nonzeros(y.c)))
+                    continue;
+                break;
+            case OP_DIV:   // by a nonzero constant only
+                if (y.var >= 0 || y.c[0] == 0) continue;
+                f.c = x.c;
+                for (double &v : f.c) v /= y.c[0];
+                if (f.var >= 0 && nonzeros(f.c) != nonzeros(x.c)) continue;
+                break;
+            case OP_POW: {   // to a small whole constant power
+                double e = y.var < 0 ? y.c[0] : -1;
+                if (!(e >= 0 && e <= maxPolyDegree && e == floor(e)) || !monomial(x.c) ||
+                    (x.c.size() - 1) * e > maxPolyDegree) continue;
+                f.c = {1};
+                for (int k = 0; k < (int)e; ++k) f.c = polyProduct(f.c, x.c);
+                if (f.var >= 0 && nonzeros(f.c) != 1) continue;
+                f.cost += e == 2 ? 0 : 3;   // pow is several times a multiply
+                break;
+            }
+            default:
+                continue;
+        }
+        while (f.c.size() > 1 && f.c.back() == 0) f.c.pop_back();
+        f.ok = all_of(f.c.begin(), f.c.end(), [](double v) { return isfinite(v); });
+    }
+
+    // Top-down: the highest polynomial subtree that gets cheaper wins
+    auto hornerCost = [](const PolyForm& f) {
+        size_t d = f.c.size() - 1;
+        return double(d) - (f.c[d] == 1 && d >= 1 && f.c[d - 1] == 0 ? 1 : 0);
+    };
+    // A node is covered when it has readers and all of them are covered or
+    // rewritten; parents come later in nodes, so they are decided first.
+    // Roots are read by the caller.
+    pmr::vector<bool> rewrite(N, false, scratch()), covered(N, false, scratch());
+    pmr::vector<bool> read(N, false, scratch()), liveReader(N, false, scratch());
+    for (int r : roots) read[r] = liveReader[r] = true;
+    bool any = false;
+    for (size_t n = N; n-- > 0; ) {
+        covered[n] = read[n] && !liveReader[n];
+        rewrite[n] = !covered[n] && nodes[n].op >= 0 && form[n].ok && form[n].var >= 0 &&
+                     hornerCost(form[n]) + 1 < form[n].cost;
+        any = any || rewrite[n];
+        for (int child : {nodes[n].a, nodes[n].b, nodes[n].c}) {
+            if (child < 0) continue;
+            read[child] = true;
+            if (!covered[n] && !rewrite[n]) liveReader[child] = true;
+        }
+    }
+    if (!any) return;
+
+    pmr::vector<ExprNode> out(scratch());
+    pmr::vector<int>      where(N, -1, scratch());
+    auto push = [&](ExprNode nd) { out.push_back(nd); return (int)out.size() - 1; };
+    for (size_t n = 0; n < N; ++n) {
+        if (covered[n]) continue;
+        if (!rewrite[n]) {
+            ExprNode nd = nodes[n];
+            if (nd.a >= 0) nd.a = where[nd.a];
+            if (nd.b >= 0) nd.b = where[nd.b];
+            if (nd.c >= 0) nd.c = where[nd.c];
+            where[n] = push(nd);
+            continue;
+        }
+        // r = c_d, then r = r*x + c_k for k = d-1 .. 0; a leading 1 starts from
+        // x.  The new nodes run where the old root did (same branch arm).
+        const pmr::vector<double>& c = form[n].c;
+        const uint32_t x = form[n].var;
+        const int scope = nodes[n].scope;
+        auto leaf = [&](uint32_t reg) { return push({-1, -1, -1, reg}); };
+        auto op   = [&](int code, int a, int b) { return push({code, a, b, 0, -1, scope}); };
+        size_t k = c.size() - 1;
+        int r;
+        if (c[k] == 1 && k >= 1) {
+            r = leaf(x);
+            if (c[--k] != 0) r = op(OP_ADD, r, leaf(constReg(c[k])));
+        }
+        else r = leaf(constReg(c[k]));
+        while (k-- > 0) {
+            r = op(OP_MUL, r, leaf(x));
+            if (c[k] != 0) r = op(OP_ADD, r, leaf(constReg(c[k])));
+        }
+        where[n] = r;
+    }
+    nodes.swap(out);
+    for (int &r : roots) r = where[r];
+}
+
+Program compileAll(const TokenList* const* pfs, size_t count, const vector<string>& vars,
+                   bool shareRepeats, uint32_t memoEntries) {
+    if (count == 0) throw runtime_error("Nothing to compile");
+    if (memoEntries & (memoEntries - 1)) throw runtime_error("Memo size must be a power of two");
+    Program prog;
+    prog.vars.assign(vars.begin(), vars.end());
+    const uint32_t nv = vars.size();
+    size_t tokenCount = 0;
+    for (size_t e = 0; e < count; ++e) tokenCount += pfs[e]->size();
+
+    // 1) Build the DAG; constants are pooled by bit pattern and a node equal
+    //    to an earlier one (same op, same children) is that node.  + and *
+    //    put their operands in a fixed order so x*y and y*x match.
+    pmr::vector<ExprNode> nodes(scratch());
+    pmr::vector<int>      st(scratch());
+    pmr::map<uint64_t,uint32_t> constIndex(scratch());
+    pmr::unordered_map<ExprNode, int, ExprNodeHash, ExprNodeEqual> seen(scratch());
+    pmr::vector<int>      roots(scratch());
+    // Arm k is scope k+1; conds[k] is the node its jump tests
+    struct Arm { int parent; bool otherwise; };
+    pmr::vector<Arm>      arms(scratch());
+    pmr::vector<int>      conds(scratch());
+    pmr::vector<pair<uint32_t,int>> openArms(scratch());   // (token the arm ends at, enclosing scope)
+    int scope = 0;
+    nodes.reserve(tokenCount);
+    seen.reserve(tokenCount);
+    prog.code.reserve(tokenCount + 1);
+    auto node = [&](ExprNode nd) {
+        nd.scope = nd.op < 0 ? 0 : scope;
+        if (!shareRepeats && nd.op >= 0) {
+            nodes.push_back(nd);
+            st.push_back(nodes.size() - 1);
+            return;
+        }
+        if ((nd.op == OP_ADD || nd.op == OP_MUL) && nd.a > nd.b) swap(nd.a, nd.b);
+        // Inside an arm, an equal node of this or a few enclosing arms
+        for (int s = nd.scope, hops = 0; s != 0 && hops < 8; ++hops) {
+            s = arms[s - 1].parent;
+            ExprNode outer = nd;
+            outer.scope = s;
+            auto it = seen.find(outer);
+            if (it != seen.end()) {
+                prog.shared++;
+                st.push_back(it->second);
+                return;
+            }
+        }
+        auto [it, fresh] = seen.emplace(nd, (int)nodes.size());
+        if (fresh) nodes.push_back(nd);
+        else if (nd.op >= 0) prog.shared++;
+        st.push_back(it->second);
+    };
+    auto leaf = [&](uint32_t reg) { node({-1, -1, -1, reg}); };
+    auto constReg = [&](double v) -> uint32_t {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof bits);
+        auto it = constIndex.find(bits);
+        if (it == constIndex.end()) {
+            it = constIndex.emplace(bits, prog.consts.size()).first;
+            prog.consts.push_back(v);
+        }
+        return nv + it->second;
+    };
+    for (size_t e = 0; e < count; ++e) {
+        const TokenList& pf = *pfs[e];
+        const pmr::vector<Branch>  branches = findBranches(pf);
+        const pmr::vector<int32_t> starts   = branchStarts(pf, branches);
+        for (uint32_t i = 0; i < pf.size(); ++i) {
+            const Token& tok = pf[i];
+            while (!openArms.empty() && openArms.back().first == i) {
+                scope = openArms.back().second;
+                openArms.pop_back();
+            }
+            if (!starts.empty() && starts[i] != 0) {
+                const Branch& br = branches[abs(starts[i]) - 1];
+                const bool otherwise = starts[i] < 0;
+                if (st.size() < (otherwise ? 2u : 1u)) throw runtime_error("Invalid expression");
+                conds.push_back(st[st.size() - (otherwise ? 2 : 1)]);
+                arms.push_back({scope, otherwise});
+                openArms.push_back({otherwise ? br.at : br.other, scope});
+                scope = arms.size();
+            }
+            if (tok.type == NUMBER) {
+                leaf(constReg(numberValue(tok)));
+            }
+            else if (tok.type == VARIABLE) {
+                auto it = find(vars.begin(), vars.end(), tok.text);
+                if (it == vars.end()) {
+                    if (tok.text.find('#') == string::npos) throw runtime_error("Unknown name: " + tok.text);
+                    throw runtime_error("rand() and randn() only work in plain expressions and mc()");
+                }
+                leaf(it - vars.begin());
+            }
+            else if (tok.type == FUNCTION) {
+                const size_t k = tokenArity(tok);
+                if (st.size() < k) throw runtime_error("Invalid expression");
+                int arg[3] = {-1, -1, -1};
+                for (size_t j = k; j-- > 0; ) { arg[j] = st.back(); st.pop_back(); }
+                auto fn = funcOps.find(tok.text);
+                if (fn != funcOps.end()) node({fn->second, arg[0], arg[1], 0, arg[2]});
+                else if (findTable(tok.text) >= 0)   // reg names the table
+                    node({OP_TABLE, arg[0], -1, (uint32_t)findTable(tok.text)});
+                else throw runtime_error("Unknown function: " + tok.text);
+            }
+            else if (tok.type == OPERATOR && tok.text == "neg") {
+                if (st.empty()) throw runtime_error("Invalid expression");
+                int a = st.back(); st.pop_back();
+                node({OP_NEG, a, -1, 0});
+            }
+            else if (tok.type == OPERATOR) {
+                if (st.size() < 2) throw runtime_error("Invalid expression");
+                int b = st.back(); st.pop_back();
+                int a = st.back(); st.pop_back();
+                if (tok.text == ">" || tok.text == ">=") swap(a, b);   // a > b is b < a
+                node({binOps.at(tok.text), a, b, 0});
+            }
+            else {
+                throw runtime_error("Mismatched parentheses");
+            }
+        }
+        if (st.size() != 1) throw runtime_error("Invalid expression");
+        roots.push_back(st.back());
+        st.clear();
+        openArms.clear();
+        scope = 0;
+    }
+
+    // 2) Polynomials to Horner form, then drop constants nothing reads any
+    //    more.  Branch conditions ride along with the roots to be remapped.
+    roots.insert(roots.end(), conds.begin(), conds.end());
+    hornerize(nodes, roots, nv, prog.consts, constReg);
+    for (size_t k = 0; k < conds.size(); ++k) conds[k] = roots[count + k];
+    roots.resize(count);
+    {
+        pmr::vector<uint32_t> remap(prog.consts.size(), UINT32_MAX, scratch());
+        pmr::vector<double>   kept(prog.consts.get_allocator());
+        for (auto &nd : nodes) {
+            if (nd.op >= 0 || nd.reg < nv) continue;
+            uint32_t &slot = remap[nd.reg - nv];
+            if (slot == UINT32_MAX) {
+                slot = kept.size();
+                kept.push_back(prog.consts[nd.reg - nv]);
+            }
+            nd.reg = nv + slot;
+        }
+        prog.consts.swap(kept);
+    }
+
+    // 3) Pick superinstructions; a fused child is never emitted on its own,
+    //    so only a child with no other reader can be fused
+    pmr::vector<Instr>    plan(nodes.size(), scratch());
+    pmr::vector<bool>     fused(nodes.size(), false, scratch());
+    pmr::vector<uint32_t> readers(nodes.size(), 0, scratch());
+    for (auto &nd : nodes) {
+        if (nd.a >= 0) readers[nd.a]++;
+        if (nd.b >= 0) readers[nd.b]++;
+        if (nd.c >= 0) readers[nd.c]++;
+    }
+    auto isOp = [&](int n, int op) { return nodes[n].op >= 0 && plan[n].op == op && readers[n] == 1; };
+    auto isConst = [&](int n, double v) {
+        return nodes[n].op < 0 && nodes[n].reg >= nv &&
+               prog.consts[nodes[n].reg - nv] == v;
+    };
+    auto sameLeaf = [&](int x, int y) {
+        return nodes[x].op < 0 && nodes[y].op < 0 && nodes[x].reg == nodes[y].reg;
+    };
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        ExprNode &nd = nodes[n];
+        if (nd.op < 0) continue;
+        Instr in{(uint8_t)nd.op, 0, (uint32_t)nd.a, (uint32_t)nd.b, (uint32_t)max(nd.c, 0)};
+        if (nd.op == OP_TABLE) in.c = nd.reg;
+        int x = nd.a, y = nd.b;
+        if ((nd.op == OP_ADD || nd.op == OP_SUB) && isOp(x, OP_MUL)) {
+            in = {nd.op == OP_ADD ? OP_MULADD : OP_MULSUB, 0,
+                  (uint32_t)nodes[x].a, (uint32_t)nodes[x].b, (uint32_t)y};
+            fused[x] = true;
+        }
+        else if (nd.op == OP_ADD && isOp(y, OP_MUL)) {
+            in = {OP_MULADD, 0, (uint32_t)nodes[y].a, (uint32_t)nodes[y].b, (uint32_t)x};
+            fused[y] = true;
+        }
+        else if ((nd.op == OP_MUL && (x == y || sameLeaf(x, y))) ||
+                 (nd.op == OP_POW && isConst(y, 2.0))) {
+            in = {OP_SQR, 0, (uint32_t)x, 0, 0};
+        }
+        else if (!memoEntries && nd.op == OP_MUL && (isOp(y, OP_SIN) || isOp(y, OP_COS))) {
+            in = {nodes[y].op == OP_SIN ? OP_MULSIN : OP_MULCOS, 0,
+                  (uint32_t)x, (uint32_t)nodes[y].a, 0};
+            fused[y] = true;
+        }
+        else if (!memoEntries && nd.op == OP_MUL && (isOp(x, OP_SIN) || isOp(x, OP_COS))) {
+            in = {nodes[x].op == OP_SIN ? OP_MULSIN : OP_MULCOS, 0,
+                  (uint32_t)y, (uint32_t)nodes[x].a, 0};
+            fused[x] = true;
+        }
+        plan[n] = in;
+    }
+
+    // 4) Emit in order, recycling a temporary once its last reader has run
+    pmr::vector<uint32_t> reads(nodes.size(), 0, scratch());   // operand slots still to run
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        if (nodes[n].op < 0 || fused[n]) continue;
+        const Instr& in = plan[n];
+        const uint32_t src[3] = {in.a, in.b, in.c};
+        for (int k = 0; k < opArity[in.op]; ++k) reads[src[k]]++;
+    }
+    for (int r : roots) reads[r]++;   // by ret, or read after it: never freed
+    const uint32_t firstTemp = nv + prog.consts.size();
+    uint32_t       nextTemp  = firstTemp;
+    pmr::vector<uint32_t> freeRegs(scratch());
+
+    // Each arm's nodes are contiguous.  Entering one emits the jump that
+    // skips it; leaving it points that jump at the next instruction.
+    pmr::vector<pair<int,size_t>> entered(scratch());   // (scope, its jump), innermost last
+    pmr::vector<bool> isEntered(arms.size() + 1, false, scratch());
+    pmr::vector<int>  path(scratch());
+    auto enter = [&](int s) {
+        path.clear();
+        for (; s != 0 && !isEntered[s]; s = arms[s - 1].parent) path.push_back(s);
+        while (!entered.empty() && entered.back().first != s) {
+            prog.code[entered.back().second].dst = prog.code.size();
+            isEntered[entered.back().first] = false;
+            entered.pop_back();
+        }
+        for (size_t k = path.size(); k-- > 0; ) {
+            const int arm = path[k];
+            entered.push_back({arm, prog.code.size()});
+            isEntered[arm] = true;
+            prog.code.push_back({arms[arm - 1].otherwise ? OP_JNZ : OP_JZ, 0,
+                                 nodes[conds[arm - 1]].reg, 0, 0});
+        }
+    };
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        if (nodes[n].op < 0 || fused[n]) continue;
+        if (!arms.empty()) enter(nodes[n].scope);
+        Instr in = plan[n];
+        uint32_t* src[3] = {&in.a, &in.b, &in.c};
+        for (int k = 0; k < 3; ++k) {
+            if (k >= opArity[in.op]) { if (in.op != OP_TABLE) *src[k] = 0; continue; }
+            const uint32_t child = *src[k];
+            *src[k] = nodes[child].reg;
+            if (--reads[child] == 0 && *src[k] >= firstTemp) freeRegs.push_back(*src[k]);
+        }
+        if (freeRegs.empty()) in.dst = nextTemp++;
+        else { in.dst = freeRegs.back(); freeRegs.pop_back(); }
+        nodes[n].reg = in.dst;
+        if (memoEntries && isMemoizable(in.op)) {   // one argument is passed twice
+            prog.memoOps.push_back(in.op);
+            in = {OP_MEMO, in.dst, in.a, in.op == OP_POW ? in.b : in.a, (uint32_t)prog.memoOps.size() - 1};
+        }
+        prog.code.push_back(in);
+    }
+    if (!arms.empty()) enter(0);
+    for (int r : roots) prog.outputs.push_back(nodes[r].reg);
+    prog.code.push_back({OP_RET, 0, prog.outputs[0], 0, 0});
+    prog.nregs = nextTemp;
+    prog.memoEntries = prog.memoOps.empty() ? 0 : memoEntries;
+    return prog;
+}
+
+Program compile(const TokenList& pf, const vector<string>& vars, bool shareRepeats,
+                uint32_t memoEntries) {
+    const TokenList* one = &pf;
+    return compileAll(&one, 1, vars, shareRepeats, memoEntries);
+}
+
+size_t memoStateSize(const ProgramView& p) {
+    return p.nmemo ? 2 * (size_t)p.nmemo + 3 * (size_t)p.nmemo * p.memoEntries : 0;
+}
+
+// Empty slots hold a NaN no input has, so they never match (and if one did,
+// f(NaN, NaN) is NaN for every memoizable f)
+static const uint64_t memoEmpty = 0x7ff8dead0000beefULL;
+
+void initMemo(const ProgramView& p, double* M) {
+    fill_n(M, 2 * (size_t)p.nmemo, 0.0);
+    double empty;
+    memcpy(&empty, &memoEmpty, sizeof empty);
+    fill(M + 2 * (size_t)p.nmemo, M + memoStateSize(p), empty);
+}
+
+static inline double memoApply(uint8_t op, double a, double b) {
+    switch (op) {
+        case OP_POW: return pow(a, b);
+        case OP_SIN: return sin(a);
+        case OP_COS: return cos(a);
+        case OP_TAN: return tan(a);
+        case OP_LOG: return log10(a);
+        case OP_LN:  return log(a);
+        default:     return exp(a);
+    }
+}
+
+// Call site `site` at (a, b) through its cache; counted is false for batch
+// lanes whose result is thrown away
+static inline double memoCall(const ProgramView& p, double* M, uint32_t site,
+                              double a, double b, bool counted) {
+    uint64_t ka, kb, ea, eb;
+    memcpy(&ka, &a, sizeof ka);
+    memcpy(&kb, &b, sizeof kb);
+    // splitmix64's finalizer: whole numbers differ only in their top bits,
+    // and every bit has to reach the slot index.  (b is a again for one
+    // argument; a ^ rotl(a) keeps distinct a apart, a ^ a*k does not.)
+    uint64_t h = ka ^ (kb << 29 | kb >> 35);
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    double* e = M + 2 * (size_t)p.nmemo + ((size_t)site * p.memoEntries + (h & (p.memoEntries - 1))) * 3;
+    memcpy(&ea, &e[0], sizeof ea);
+    memcpy(&eb, &e[1], sizeof eb);
+    if (ea == ka && eb == kb) {
+        M[site] += counted;
+        return e[2];
+    }
+    M[p.nmemo + site] += counted;
+    e[0] = a;
+    e[1] = b;
+    return e[2] = memoApply(p.memoOps[site], a, b);
+}
+
+void MemoStats::add(const ProgramView& p, const double* M) {
+    if (ops.empty()) {
+        ops.assign(p.memoOps, p.memoOps + p.nmemo);
+        hits.assign(p.nmemo, 0);
+        calls.assign(p.nmemo, 0);
+    }
+    for (uint32_t k = 0; k < p.nmemo; ++k) {
+        hits[k]  += M[k];
+        calls[k] += M[k] + M[p.nmemo + k];
+    }
+}
+
+void MemoStats::print(ostream& os) const {
+    for (size_t k = 0; k < ops.size(); ++k)
+        os << "  memo " << k << " (" << opNames[ops[k]] << "): " << fixed << setprecision(1)
+           << (calls[k] ? 100 * hits[k] / calls[k] : 0.0) << "% of " << setprecision(0)
+           << calls[k] << " call(s) hit\n" << defaultfloat << setprecision(6);
+}
+
+pmr::vector<double> makeRegisters(const ProgramView& prog) {
+    pmr::vector<double> regs(prog.nregs + memoStateSize(prog), 0.0, scratch());
+    copy(prog.consts, prog.consts + prog.nconsts, regs.begin() + prog.nvars);
+    initMemo(prog, regs.data() + prog.nregs);
+    return regs;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CALC_THREADED_DISPATCH 1   // computed goto: one indirect jump per instruction
+#endif
+
+double execute(const ProgramView& prog, double* R, CalcError& error) {
+    const Instr* ip = prog.code;
+    const Instr* in;
+#ifdef CALC_THREADED_DISPATCH
+    static void* const labels[OP_COUNT] = {
+        &&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV, &&L_POW,
+        &&L_SIN, &&L_COS, &&L_TAN, &&L_SQRT, &&L_LOG, &&L_LN, &&L_EXP, &&L_NEG,
+        &&L_ABS, &&L_MIN, &&L_MAX, &&L_LT, &&L_LE, &&L_EQ, &&L_NE, &&L_SELECT,
+        &&L_MULADD, &&L_MULSUB, &&L_SQR, &&L_MULSIN, &&L_MULCOS, &&L_JZ, &&L_JNZ, &&L_RET,
+        &&L_MEMO, &&L_TABLE
+    };
+#   define VM_CASE(op) L_##op:
+#   define VM_NEXT     in = ip++; goto *labels[in->op]
+    VM_NEXT;
+#else
+#   define VM_CASE(op) case OP_##op:
+#   define VM_NEXT     continue
+    for (;;) { in = ip++; switch (in->op) {
+#endif
+    VM_CASE(ADD)    R[in->dst] = R[in->a] + R[in->b];            VM_NEXT;
+    VM_CASE(SUB)    R[in->dst] = R[in->a] - R[in->b];            VM_NEXT;
+    VM_CASE(MUL)    R[in->dst] = R[in->a] * R[in->b];            VM_NEXT;
+    VM_CASE(DIV)    if (R[in->b] == 0) error = CalcError::DivideByZero;
+                    R[in->dst] = R[in->a] / R[in->b];            VM_NEXT;
+    VM_CASE(POW)    R[in->dst] = pow(R[in->a], R[in->b]);        VM_NEXT;
+    VM_CASE(SIN)    R[in->dst] = sin(R[in->a]);                  VM_NEXT;
+    VM_CASE(COS)    R[in->dst] = cos(R[in->a]);                  VM_NEXT;
+    VM_CASE(TAN)    R[in->dst] = tan(R[in->a]);                  VM_NEXT;
+    VM_CASE(SQRT)   R[in->dst] = sqrt(R[in->a]);                 VM_NEXT;
+    VM_CASE(LOG)    R[in->dst] = log10(R[in->a]);                VM_NEXT;
+    VM_CASE(LN)     R[in->dst] = log(R[in->a]);                  VM_NEXT;
+    VM_CASE(EXP)    R[in->dst] = exp(R[in->a]);                  VM_NEXT;
+    VM_CASE(NEG)    R[in->dst] = -R[in->a];                      VM_NEXT;
+    VM_CASE(ABS)    R[in->dst] = fabs(R[in->a]);                 VM_NEXT;
+    VM_CASE(MIN)    R[in->dst] = minOf(R[in->a], R[in->b]);      VM_NEXT;
+    VM_CASE(MAX)    R[in->dst] = maxOf(R[in->a], R[in->b]);      VM_NEXT;
+    VM_CASE(LT)     R[in->dst] = R[in->a] <  R[in->b];           VM_NEXT;
+    VM_CASE(LE)     R[in->dst] = R[in->a] <= R[in->b];           VM_NEXT;
+    VM_CASE(EQ)     R[in->dst] = R[in->a] == R[in->b];           VM_NEXT;
+    VM_CASE(NE)     R[in->dst] = R[in->a] != R[in->b];           VM_NEXT;
+    VM_CASE(SELECT) R[in->dst] = R[in->a] != 0 ? R[in->b] : R[in->c]; VM_NEXT;
+    VM_CASE(MULADD) R[in->dst] = fmadd(R[in->a], R[in->b], R[in->c]);  VM_NEXT;
+    VM_CASE(MULSUB) R[in->dst] = fmadd(R[in->a], R[in->b], -R[in->c]); VM_NEXT;
+    VM_CASE(SQR)    R[in->dst] = R[in->a] * R[in->a];            VM_NEXT;
+    VM_CASE(MULSIN) R[in->dst] = R[in->a] * sin(R[in->b]);       VM_NEXT;
+    VM_CASE(MULCOS) R[in->dst] = R[in->a] * cos(R[in->b]);       VM_NEXT;
+    VM_CASE(JZ)     if (R[in->a] == 0) ip = prog.code + in->dst;  VM_NEXT;
+    VM_CASE(JNZ)    if (R[in->a] != 0) ip = prog.code + in->dst;  VM_NEXT;
+    VM_CASE(RET)    return R[in->a];
+    VM_CASE(MEMO)   R[in->dst] = memoCall(prog, R + prog.nregs, in->c, R[in->a], R[in->b], true); VM_NEXT;
+    VM_CASE(TABLE)  R[in->dst] = prog.tables[in->c].at(R[in->a]); VM_NEXT;
+#ifndef CALC_THREADED_DISPATCH
+    } }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+}
+
+double execute(const ProgramView& prog, double* R) {
+    CalcError error = CalcError::None;
+    double v = execute(prog, R, error);
+    if (error != CalcError::None) throw runtime_error(errorMessage(error));
+    return v;
+}
+
+double execute(const Program& prog) {
+    auto regs = makeRegisters(prog.view());
+    return execute(prog.view(), regs.data());
+}
+
+void dumpProgram(const Program& prog, ostream& os) {
+    const uint32_t nv = prog.vars.size();
+    auto reg = [&](uint32_t r) {
+        if (r < nv) return prog.vars[r];
+        if (r < nv + prog.consts.size()) {
+            ostringstream s;
+            s << "#" << prog.consts[r - nv];
+            return s.str();
+        }
+        return "r" + to_string(r);
+    };
+    for (size_t i = 0; i < prog.code.size(); ++i) {
+        const Instr &in = prog.code[i];
+        os << "  " << setw(3) << i << "  " << left << setw(7) << opNames[in.op] << right;
+        if (isJump(in.op)) {
+            os << reg(in.a) << " -> " << in.dst << "\n";
+            continue;
+        }
+        if (in.op == OP_MEMO) {
+            const uint8_t fn = prog.memoOps[in.c];
+            os << reg(in.dst) << " <- " << opNames[fn] << " " << reg(in.a)
+               << (fn == OP_POW ? ", " + reg(in.b) : "") << "   (cache " << in.c << ")\n";
+            continue;
+        }
+        if (in.op == OP_TABLE) {
+            os << reg(in.dst) << " <- " << tabulated()[in.c].name << "(" << reg(in.a) << ")\n";
+            continue;
+        }
+        if (in.op != OP_RET) os << reg(in.dst) << " <- ";
+        const uint32_t src[3] = {in.a, in.b, in.c};
+        for (int k = 0; k < opArity[in.op]; ++k) os << (k ? ", " : "") << reg(src[k]);
+        os << "\n";
+    }
+    os << "  (" << prog.code.size() << " instructions, " << prog.nregs << " registers";
+    if (prog.shared) os << ", " << prog.shared << " repeated operation" << (prog.shared == 1 ? "" : "s") << " reused";
+    if (!prog.memoOps.empty())
+        os << ", " << prog.memoOps.size() << " cached call" << (prog.memoOps.size() == 1 ? "" : "s") << " of "
+           << prog.memoEntries << " entries";
+    os << ")\n";
+}
+
+BatchMachine::BatchMachine(const ProgramView& p)
+    : prog(p), regs((size_t)p.nregs * batchLanes), memo(memoStateSize(p)) {
+    for (uint32_t k = 0; k < p.nconsts; ++k)
+        fill_n(&regs[(size_t)(p.nvars + k) * batchLanes], batchLanes, p.consts[k]);
+    arms.resize(count_if(p.code, p.code + p.ncode, [](const Instr& in) { return isJump(in.op); }));
+    initMemo(p, memo.data());
+}
+
+void executeBatch(BatchMachine& m, const double* const* vars, size_t n, double* out,
+                  uint64_t* errorMask, const BatchColumns* more) {
+    static_assert(batchLanes == 64, "one mask word per block");
+    const size_t W = batchLanes;
+    double* R = m.regs.data();
+    for (size_t base = 0; base < n; base += W) {
+        const size_t cnt = min(W, n - base);
+        uint64_t bad = 0;
+        for (uint32_t v = 0; v < m.prog.nvars; ++v) {
+            double* row = R + (size_t)v * W;
+            copy(vars[v] + base, vars[v] + base + cnt, row);
+            fill(row + cnt, row + W, row[cnt - 1]);   // keep idle lanes harmless
+        }
+        uint64_t live  = ~uint64_t(0);   // lanes the current arm computes
+        size_t   depth = 0;
+        for (const Instr* in = m.prog.code; ; ++in) {
+            while (depth && in >= m.arms[depth - 1].first) live = m.arms[--depth].second;
+            if (isJump(in->op)) {
+                const double* c = R + (size_t)in->a * W;
+                uint64_t take = 0;
+                for (size_t l = 0; l < W; ++l) take |= (uint64_t)((c[l] != 0) == (in->op == OP_JZ)) << l;
+                take &= live;
+                if (!take) { in = m.prog.code + in->dst - 1; continue; }
+                m.arms[depth++] = {m.prog.code + in->dst, live};
+                live = take;
+                continue;
+            }
+            double*       d = R + (size_t)in->dst * W;
+            const double* a = R + (size_t)in->a * W;
+            const double* b = R + (size_t)in->b * W;
+            const double* c = R + (size_t)in->c * W;
+#define LANES(expr) for (size_t l = 0; l < W; ++l) d[l] = (expr); break
+            switch (in->op) {
+                case OP_ADD:    LANES(a[l] + b[l]);
+                case OP_SUB:    LANES(a[l] - b[l]);
+                case OP_MUL:    LANES(a[l] * b[l]);
+                case OP_DIV:
+                    if (errorMask) {
+                        uint64_t zero = 0;
+                        for (size_t l = 0; l < W; ++l) zero |= (uint64_t)(b[l] == 0) << l;
+                        bad |= zero & live;
+                    }
+                    LANES(a[l] / b[l]);
+                case OP_POW:    LANES(pow(a[l], b[l]));
+                case OP_SIN:    LANES(sin(a[l]));
+                case OP_COS:    LANES(cos(a[l]));
+                case OP_TAN:    LANES(tan(a[l]));
+                case OP_SQRT:   LANES(sqrt(a[l]));
+                case OP_LOG:    LANES(log10(a[l]));
+                case OP_LN:     LANES(log(a[l]));
+                case OP_EXP:    LANES(exp(a[l]));
+                case OP_NEG:    LANES(-a[l]);
+                case OP_ABS:    LANES(fabs(a[l]));
+                case OP_MIN:    LANES(minOf(a[l], b[l]));
+                case OP_MAX:    LANES(maxOf(a[l], b[l]));
+                case OP_LT:     LANES(a[l] <  b[l]);
+                case OP_LE:     LANES(a[l] <= b[l]);
+                case OP_EQ:     LANES(a[l] == b[l]);
+                case OP_NE:     LANES(a[l] != b[l]);
+                case OP_SELECT: LANES(a[l] != 0 ? b[l] : c[l]);
+                case OP_MULADD: LANES(fmadd(a[l], b[l], c[l]));
+                case OP_MULSUB: LANES(fmadd(a[l], b[l], -c[l]));
+                case OP_SQR:    LANES(a[l] * a[l]);
+                case OP_MULSIN: LANES(a[l] * sin(b[l]));
+                case OP_MULCOS: LANES(a[l] * cos(b[l]));
+                case OP_MEMO: {
+                    const uint64_t counted = live & (cnt == W ? ~uint64_t(0) : (uint64_t(1) << cnt) - 1);
+                    LANES(memoCall(m.prog, m.memo.data(), in->c, a[l], b[l], counted >> l & 1));
+                }
+                case OP_TABLE:  LANES(m.prog.tables[in->c].at(a[l]));
+                case OP_RET:
+                    copy(a, a + cnt, out + base);
+                    if (more)
+                        for (size_t k = 0; k < more->count; ++k) {
+                            const double* r = R + (size_t)more->regs[k] * W;
+                            copy(r, r + cnt, more->columns[k] + base);
+                        }
+                    if (errorMask) errorMask[base / W] = cnt == W ? bad : bad & ((uint64_t(1) << cnt) - 1);
+                    goto nextBlock;
+            }
+#undef LANES
+        }
+    nextBlock:;
+    }
+}
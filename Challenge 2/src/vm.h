@@ -0,0 +1,226 @@
+// vm.h
+// Compiled expressions: a register VM
+//
+// The postfix evaluator pushes and pops every intermediate through a
+// std::stack.  compile() instead turns postfix into three-address code over
+// a flat register file laid out as [variables][constants][temporaries].
+// Constants are loaded once when the registers are set up, temporaries are
+// recycled as soon as their last reader runs, and a few common shapes are
+// fused into superinstructions (a*b+c, x*x, a*sin(b), ...).  The tree is
+// hash-consed into a DAG, so a subexpression written several times
+// (sqrt(x^2+y^2) in every term) is computed once and its register reused.
+
+#pragma once
+
+#include "arena.h"
+#include "errors.h"
+#include "parser.h"
+#include "tables.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum OpCode : uint8_t {
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW,
+    OP_SIN, OP_COS, OP_TAN, OP_SQRT, OP_LOG, OP_LN, OP_EXP, OP_NEG,
+    OP_ABS, OP_MIN, OP_MAX,
+    OP_LT, OP_LE, OP_EQ, OP_NE,   // 1 or 0; a > b is b < a
+    OP_SELECT,   // dst = a != 0 ? b : c
+    // superinstructions
+    OP_MULADD,   // dst = a*b + c
+    OP_MULSUB,   // dst = a*b - c
+    OP_SQR,      // dst = a*a
+    OP_MULSIN,   // dst = a*sin(b)
+    OP_MULCOS,   // dst = a*cos(b)
+    // branches of if(): dst is the instruction to continue at
+    OP_JZ,       // skip to dst if a == 0
+    OP_JNZ,      // skip to dst if a != 0
+    OP_RET,      // return a
+    // calls that keep state beside the registers; never in .cbc files
+    OP_MEMO,     // dst = memoOps[c](a, b) through call site c's cache
+    OP_TABLE,    // dst = tabulated()[c] at a
+    OP_COUNT
+};
+
+inline const char* const opNames[OP_COUNT] = {
+    "add", "sub", "mul", "div", "pow",
+    "sin", "cos", "tan", "sqrt", "log", "ln", "exp", "neg",
+    "abs", "min", "max", "lt", "le", "eq", "ne", "select",
+    "muladd", "mulsub", "sqr", "mulsin", "mulcos", "jz", "jnz", "ret", "memo", "table"
+};
+
+// Source operands read by each opcode
+inline const int opArity[OP_COUNT] = {
+    2, 2, 2, 2, 2,
+    1, 1, 1, 1, 1, 1, 1, 1,
+    1, 2, 2, 2, 2, 2, 2, 3,
+    3, 3, 1, 2, 2, 1, 1, 1, 2, 1
+};
+
+inline bool isJump(uint8_t op) { return op == OP_JZ || op == OP_JNZ; }
+
+// One three-address instruction: dst = op(a, b, c)
+struct Instr {
+    uint8_t  op;
+    uint32_t dst, a, b, c;
+};
+
+// Non-owning view of compiled code; this is all the VM needs, so programs
+// can run straight out of a memory-mapped file as well as from a Program
+struct ProgramView {
+    const Instr*  code;
+    const double* consts;
+    uint32_t      ncode, nconsts, nvars, nregs;
+    const uint8_t* memoOps = nullptr;   // function of each memoized call site
+    uint32_t      nmemo = 0, memoEntries = 0;
+    const Table*  tables = nullptr;
+};
+
+// A compiled expression
+struct Program {
+    std::pmr::vector<Instr>       code{scratch()};     // always ends with OP_RET
+    std::pmr::vector<double>      consts{scratch()};   // live in registers [vars.size(), vars.size()+consts.size())
+    std::pmr::vector<std::string> vars{scratch()};     // live in registers [0, vars.size())
+    uint32_t       nregs = 0; // total register file size
+    uint32_t       shared = 0;   // repeated operations computed once (for dump)
+    std::pmr::vector<uint32_t> outputs{scratch()};   // result register of each expression (see compileAll)
+    std::pmr::vector<uint8_t>  memoOps{scratch()};   // see "Memoized calls"
+    uint32_t       memoEntries = 0;
+
+    ProgramView view() const {
+        return {code.data(), consts.data(), (uint32_t)code.size(),
+                (uint32_t)consts.size(), (uint32_t)vars.size(), nregs,
+                memoOps.data(), (uint32_t)memoOps.size(), memoEntries, tabulated().data()};
+    }
+};
+
+// a*b + c, fused into one rounding where the target has FMA (-march=native)
+inline double fmadd(double a, double b, double c) {
+#ifdef __FMA__
+    return std::fma(a, b, c);
+#else
+    return a * b + c;
+#endif
+}
+
+// Compile count postfix expressions over the same variables into one
+// program.  They share one DAG, so work common to several expressions is
+// done once per run; outputs[k] is the register that holds expression k's
+// value when the program returns (it returns expression 0).
+// shareRepeats = false keeps every written copy of a repeated
+// subexpression, for comparison.
+//
+// if(c, t, e) becomes  c; jz c -> E; t; E: jnz c -> S; e; S: select c, t, e
+// with each jump left out when its arm has no code.  The scalar VM follows
+// the jumps, so only the chosen operand is computed (and can fail); the
+// batch VM runs both arms under lane masks and blends.  The nodes of each
+// operand form an arm: they may reuse nodes of an enclosing arm, which have
+// already run, but nothing outside an arm may reuse its nodes.
+//
+// memoEntries > 0 (a power of two) gives every pow, exp, ln, log and trig
+// call its own cache of that many results; see "Memoized calls".
+Program compileAll(const TokenList* const* pfs, size_t count, const std::vector<std::string>& vars,
+                   bool shareRepeats = true, uint32_t memoEntries = 0);
+
+// Compile postfix tokens into register code
+Program compile(const TokenList& pf, const std::vector<std::string>& vars = {}, bool shareRepeats = true,
+                uint32_t memoEntries = 0);
+
+// ---------------------------------------------------------------------------
+// Memoized calls
+//
+// Inputs that repeat (integer ages, a handful of rates) make pow and exp
+// recompute the same values.  A program compiled with memoEntries turns each
+// such call into OP_MEMO with its own direct-mapped cache: the arguments'
+// bits pick a slot, a slot holding the same bits returns its value, anything
+// else is computed and replaces it.  Memory is bounded by memoEntries * 24
+// bytes per call site.  The caches live right after the registers (or in
+// the BatchMachine), so every thread has its own and no locks are needed;
+// counters of hits and misses come first:
+//
+//   hits[nmemo]  misses[nmemo]  entries[nmemo][memoEntries] of {a, b, value}
+// ---------------------------------------------------------------------------
+
+inline constexpr uint32_t maxMemoEntries = 1 << 20;
+
+size_t memoStateSize(const ProgramView& p);
+void initMemo(const ProgramView& p, double* M);
+
+// Hits and calls of each call site, summed over any number of runs
+struct MemoStats {
+    std::vector<uint8_t> ops;
+    std::vector<double>  hits, calls;
+
+    void add(const ProgramView& p, const double* M);
+    void print(std::ostream& os) const;
+};
+
+// Register file for a program: variables zeroed, constants loaded, and
+// after the registers any memo caches, empty
+std::pmr::vector<double> makeRegisters(const ProgramView& prog);
+
+// Run a compiled program; the caller writes variables into regs[0..nvars).
+// A division by zero sets error and carries on with the IEEE result, so the
+// loop never throws.
+double execute(const ProgramView& prog, double* R, CalcError& error);
+
+// The throwing wrapper for the REPL and one-off evaluations: a division by
+// zero becomes runtime_error("Cannot divide by zero").  Loops over many
+// rows use the CalcError overload above or executeBatch.
+double execute(const ProgramView& prog, double* R);
+
+// Convenience: compile-once, run-once (used by the REPL)
+double execute(const Program& prog);
+
+// Print a compiled program in a readable form
+void dumpProgram(const Program& prog, std::ostream& os);
+
+// ---------------------------------------------------------------------------
+// Batch evaluation
+//
+// executeBatch() runs one program over many inputs.  Every register becomes
+// a row of batchLanes values, so each instruction is a short loop the
+// compiler can vectorize and dispatch is paid once per block of inputs
+// instead of once per value.  Division by zero follows IEEE rules here
+// (inf/nan) rather than stopping the whole batch.
+//
+// if() runs both arms for the whole block and select blends the results,
+// so a condition that flips from row to row costs no mispredicted
+// branches.  Each jump narrows a mask of the lanes its arm is for (a
+// division by zero only counts in those lanes), and an arm no lane in the
+// block needs is skipped as in the scalar VM.
+//
+// Memoized calls look up lane by lane in caches the machine owns; a block
+// of repeated inputs then costs 64 loads instead of 64 exp calls.
+// ---------------------------------------------------------------------------
+
+constexpr size_t batchLanes = 64;
+
+// Register rows for one thread running one program
+struct BatchMachine {
+    ProgramView         prog;
+    std::vector<double> regs;   // prog.nregs rows of batchLanes
+    std::vector<std::pair<const Instr*, uint64_t>> arms;   // open branch arms: (end, enclosing mask)
+    std::vector<double> memo;   // caches of memoized calls, see memoCall
+
+    explicit BatchMachine(const ProgramView& p);
+};
+
+// More results to copy out when a block finishes: row i of register
+// regs[k] goes to columns[k][i] (the other outputs of a compileAll program)
+struct BatchColumns {
+    const uint32_t* regs;
+    double* const*  columns;
+    size_t          count;
+};
+
+// out[i] = program(vars[0][i], vars[1][i], ...) for i < n.  With errorMask,
+// bit i % 64 of errorMask[i / 64] is set when row i divided by zero; the
+// row's value is still the IEEE inf/nan.
+void executeBatch(BatchMachine& m, const double* const* vars, size_t n, double* out,
+                  uint64_t* errorMask = nullptr, const BatchColumns* more = nullptr);
@@ -0,0 +1,52 @@
+// check.h
+// Minimal checks for the test programs in tests/: each test_*.cpp is its
+// own executable, counts failed CHECKs and returns nonzero if any failed.
+
+#pragma once
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+inline int checkFailures = 0;
+
+#define CHECK(cond)                                                             \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            ++checkFailures;                                                    \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                          \
+    do {                                                                        \
+        const auto& checkA_ = (a);                                              \
+        const auto& checkB_ = (b);                                              \
+        if (!(checkA_ == checkB_)) {                                            \
+            ++checkFailures;                                                    \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #a " == " #b       \
+                      << " failed: " << checkA_ << " vs " << checkB_ << "\n";   \
+        }                                                                       \
+    } while (0)
+
+// Same value, or both NaN (-0 and +0 count as equal)
+inline bool sameDouble(double a, double b) {
+    return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+#define CHECK_SAME(a, b)                                                        \
+    do {                                                                        \
+        const double checkA_ = (a), checkB_ = (b);                              \
+        if (!sameDouble(checkA_, checkB_)) {                                    \
+            ++checkFailures;                                                    \
+            std::cerr.precision(17);                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #a " == " #b       \
+                      << " failed: " << checkA_ << " vs " << checkB_ << "\n";   \
+        }                                                                       \
+    } while (0)
+
+inline int checkResult(const char* name) {
+    if (checkFailures) std::cerr << name << ": " << checkFailures << " check(s) failed\n";
+    else               std::cout << name << ": ok\n";
+    return checkFailures != 0;
+}
@@ -0,0 +1,101 @@
+// test_alloc.cpp
+// Once the line arena has warmed up, a REPL line allocates nothing: this
+// program replaces the global operator new with a counting one (only here,
+// never in the calculator itself) and runs each line as the REPL does.
+
+#include "arena.h"
+#include "check.h"
+#include "fixedint.h"
+#include "parser.h"
+#include "random.h"
+#include "vm.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static thread_local uint64_t heapAllocations = 0;
+
+void* operator new(size_t n) {
+    ++heapAllocations;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+void* operator new(size_t n, align_val_t align) {   // pmr::new_delete_resource
+    ++heapAllocations;
+    const size_t a = (size_t)align;
+    if (void* p = aligned_alloc(a, (n + a - 1) / a * a)) return p;
+    throw bad_alloc();
+}
+void* operator new[](size_t n)                  { return operator new(n); }
+void* operator new[](size_t n, align_val_t a)   { return operator new(n, a); }
+void operator delete(void* p) noexcept                           { free(p); }
+void operator delete(void* p, size_t) noexcept                   { free(p); }
+void operator delete(void* p, align_val_t) noexcept              { free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept      { free(p); }
+void operator delete[](void* p) noexcept                         { free(p); }
+void operator delete[](void* p, size_t) noexcept                 { free(p); }
+void operator delete[](void* p, align_val_t) noexcept            { free(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept    { free(p); }
+
+// One line the way main() handles a plain real expression
+static double runLine(const string& line, const vector<string>& vars) {
+    auto tokens = tokenize(line, vars);
+    uint64_t exact;
+    bool     wrap;
+    if (isIntegerExpression(tokens) && evalFixedWidth(tokens, exact, wrap)) return (double)exact;
+    requireRealMode(tokens);
+    if (vars.empty()) return evalScalar(tokens);
+    Program prog = compile(infixToPostfix(tokens), vars);
+    auto regs = makeRegisters(prog.view());
+    regs[0] = 1.5;
+    return execute(prog.view(), regs.data());
+}
+
+int main() {
+    // every token fits std::string's small buffer and no line uses rand(),
+    // whose variable list is a plain vector (see arena.h); error lines are
+    // left out, as building the message allocates
+    static const vector<string> lines = {
+        "1 + 2 * 3", "sqrt(3^2 + 4^2)", "2 * sin(0.5) + 3 * cos(0.25)",
+        "2^62 + 1", "0xff & 12", "(1.5 + 2.5) / (3 - 0.5) ^ 2 * pi",
+        "if(2 > 1, ln(10), exp(1)) + min(3, 4) * max(1, 2)",
+    };
+    static const vector<string> withX = {
+        "3*x^5 + 2*x^4 - x^2 + 7", "sqrt(x) * x + sqrt(x) / 2", "if(x < 0, -x, x^2)",
+    };
+    const vector<string> noVars, vars = {"x"};
+    LineArena arena;
+    volatile double sink = 0;
+
+    auto allocationsOf = [&](const string& line, const vector<string>& v) {
+        uint64_t before = 0;
+        for (int pass = 0; pass < 3; ++pass) {   // the first passes may grow the arena
+            if (pass == 2) before = heapAllocations;
+            LineScope scope(arena);
+            try { sink = sink + runLine(line, v); }
+            catch (const exception&) {}
+        }
+        return heapAllocations - before;
+    };
+    for (const string& line : lines) {
+        const uint64_t n = allocationsOf(line, noVars);
+        if (n) cerr << "\"" << line << "\" allocated " << n << " time(s)\n";
+        CHECK_EQ(n, (uint64_t)0);
+    }
+    for (const string& line : withX) {
+        const uint64_t n = allocationsOf(line, vars);
+        if (n) cerr << "\"" << line << "\" allocated " << n << " time(s)\n";
+        CHECK_EQ(n, (uint64_t)0);
+    }
+
+    // the counter itself works: outside a LineScope the same line allocates
+    const uint64_t before = heapAllocations;
+    sink = sink + runLine(lines[1], noVars);
+    CHECK(heapAllocations > before);
+    return checkResult("test_alloc");
+}
@@ -0,0 +1,82 @@
+// test_bigint.cpp
+// Integer mode arithmetic against known values
+
+#include "bigint.h"
+#include "check.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static ostream& operator<<(ostream& os, const BigInt& v) { return os << v.toString(); }
+
+static BigInt big(const string& s) {
+    return s[0] == '-' ? -BigInt::parse(s.substr(1)) : BigInt::parse(s);
+}
+
+int main() {
+    setenv("CALC_THREADS", "2", 0);   // primes(): windows of 128 segments, 2^26 numbers
+    // conversions
+    CHECK_EQ(BigInt(0).toString(), "0");
+    CHECK_EQ(BigInt(-42).toString(), "-42");
+    CHECK_EQ(BigInt::fromU64(18446744073709551615ull).toString(), "18446744073709551615");
+    const string long1 = "123456789012345678901234567890123456789012345678901234567890";
+    CHECK_EQ(big(long1).toString(), long1);
+
+    // products, powers and factorials
+    BigInt p(1);
+    for (int k = 0; k < 200; ++k) p = p * BigInt(2);
+    CHECK_EQ(p.toString(), "1606938044258990275541962092341162602522202993782792835301376");
+    CHECK_EQ(factorial(30).toString(), "265252859812191058636308480000000");
+    CHECK_EQ(factorial(1000).toString().size(), (size_t)2568);
+    CHECK_EQ(factorial(1000) / factorial(998), BigInt(999000));
+
+    // floor division: the remainder has the divisor's sign
+    CHECK_EQ(BigInt(-7) / BigInt(2), BigInt(-4));
+    CHECK_EQ(BigInt(-7) % BigInt(2), BigInt(1));
+    CHECK_EQ(BigInt(7) % BigInt(-2), BigInt(-1));
+    {
+        const BigInt a = big(long1), b = big("98765432109876543210987"), c = big("12345");
+        CHECK_EQ((a * b + c) / b, a);
+        CHECK_EQ((a * b + c) % b, c);
+        CHECK_EQ(a - a, BigInt(0));
+    }
+    bool threw = false;
+    try { BigInt(1) / BigInt(0); }
+    catch (const exception&) { threw = true; }
+    CHECK(threw);
+
+    // number theory
+    CHECK_EQ(gcd(p, big("3656158440062976")), big("1048576"));   // 2^200, 6^20
+    CHECK_EQ(powmod(BigInt(3), BigInt(1000), BigInt(7)), BigInt(4));
+    CHECK_EQ(powmod(BigInt(2), big("1000000"), big("1000000007")), big("235042059"));
+    CHECK(isPrimeU64(1000000007));
+    CHECK(!isPrimeU64(561));   // Carmichael number
+    CHECK(isPrimeU64(18446744073709551557ull));   // largest 64-bit prime
+    CHECK(primality(big("170141183460469231731687303715884105727")) != Primality::Composite);   // 2^127 - 1
+    CHECK(primality(big("170141183460469231731687303715884105729")) == Primality::Composite);
+
+    auto f = factorize(BigInt::fromU64(600851475143ull));
+    vector<string> got;
+    for (auto &[q, m] : f) got.push_back(q.toString() + "^" + to_string(m));
+    CHECK(got == vector<string>({"71^1", "839^1", "1471^1", "6857^1"}));
+    f = factorize(big("1000000007") * big("998244353") * big("1000000009"));   // past 64 bits
+    CHECK_EQ(f.size(), (size_t)3);
+    if (f.size() == 3) {
+        CHECK_EQ(f[0].first, big("998244353"));
+        CHECK_EQ(f[2].first, big("1000000009"));
+    }
+
+    vector<uint64_t> list;
+    CHECK_EQ(countPrimes(1, 100000, list, 5), (uint64_t)9592);
+    CHECK(list == vector<uint64_t>({2, 3, 5, 7, 11}));
+    // ... and across several sieve windows
+    CHECK_EQ(countPrimes(0, 100000000, list, 3), (uint64_t)5761455);
+    CHECK(list == vector<uint64_t>({2, 3, 5}));
+    CHECK_EQ(countPrimes(50000001, 150000000, list, 2), (uint64_t)(8444396 - 3001134));
+    CHECK(list == vector<uint64_t>({50000017, 50000021}));
+
+    return checkResult("test_bigint");
+}
@@ -0,0 +1,75 @@
+// test_complex.cpp
+// Complex mode: principal branches, Smith division at the edge of the
+// range, exact whole powers, and the SoA batch against single lanes
+
+#include "check.h"
+#include "complex.h"
+#include "parser.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static bool near(Cx z, double re, double im, double tol = 1e-15) {
+    return fabs(z.re - re) <= tol * max(1.0, fabs(re)) && fabs(z.im - im) <= tol * max(1.0, fabs(im));
+}
+
+int main() {
+    // Principal values: the upper side of the cut along the negative axis
+    CHECK(near(evalComplex("sqrt(-1)"), 0, 1));
+    CHECK(near(evalComplex("sqrt(-4)"), 0, 2));
+    CHECK(near(evalComplex("sqrt(-i)"), M_SQRT1_2, -M_SQRT1_2));
+    CHECK(near(evalComplex("ln(-2)"), M_LN2, M_PI));
+    CHECK(near(evalComplex("exp(i*pi)"), -1, 0));
+
+    // Smith's division: |b|^2 would overflow, the quotient does not
+    CHECK(near(evalComplex("(1e300 + 1e300*i) / (1e300 + 1e300*i)"), 1, 0));
+    CHECK(near(evalComplex("(3e307 + 4e307*i) / (4e307 - 3e307*i)"), 0, 1));
+    CHECK(near(evalComplex("1e-300 / (1e-300*i)"), 0, -1));
+    bool threw = false;
+    try { evalComplex("1 / (0*i)"); } catch (const exception&) { threw = true; }
+    CHECK(threw);
+
+    // Whole exponents by repeated squaring: exact, including negative ones
+    const Cx sq = evalComplex("i^2");
+    CHECK_SAME(sq.re, -1.0);
+    CHECK_SAME(sq.im, 0.0);
+    const Cx eighth = evalComplex("(1 + i)^8");
+    CHECK_SAME(eighth.re, 16.0);
+    CHECK_SAME(eighth.im, 0.0);
+    const Cx inverse = evalComplex("(1 + i)^-2");
+    CHECK_SAME(inverse.re, 0.0);
+    CHECK_SAME(inverse.im, -0.5);
+    CHECK(near(evalComplex("i^0.5"), M_SQRT1_2, M_SQRT1_2));
+
+    // One batch of 200 lanes (three blocks, the last partial) against the
+    // same program run one lane at a time
+    {
+        const vector<string> vars = {"z", "i"};
+        Program prog = compile(infixToPostfix(tokenize("z^3 - 2*z + sqrt(z) / (z + i) + ln(z)*cos(z)", vars)), vars);
+        const size_t n = 200;
+        vector<double> zre(n), zim(n), ire(n, 0), iim(n, 1), outRe(n), outIm(n);
+        for (size_t k = 0; k < n; ++k) {
+            zre[k] = cos(0.1 * k) * (1 + 0.02 * k);
+            zim[k] = sin(0.37 * k) - 0.5;
+        }
+        const double* re[2] = {zre.data(), ire.data()};
+        const double* im[2] = {zim.data(), iim.data()};
+        ComplexMachine batch(prog.view());
+        executeComplexBatch(batch, re, im, n, outRe.data(), outIm.data());
+        CHECK(!batch.divByZero);
+        for (size_t k = 0; k < n; ++k) {
+            ComplexMachine single(prog.view());
+            const double* re1[2] = {&zre[k], &ire[k]};
+            const double* im1[2] = {&zim[k], &iim[k]};
+            Cx z;
+            executeComplexBatch(single, re1, im1, 1, &z.re, &z.im);
+            CHECK_SAME(outRe[k], z.re);
+            CHECK_SAME(outIm[k], z.im);
+        }
+    }
+    return checkResult("test_complex");
+}
@@ -0,0 +1,110 @@
+// test_fft.cpp
+// fft, ifft and conv against direct sums, over every kind of plan
+
+#include "check.h"
+#include "fft.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Largest difference between the plan's output and a direct DFT, relative
+// to the largest bin, at every bin or at about `bins` of them spread evenly
+static double dftError(size_t n, size_t bins = 0) {
+    vector<double> re(n), im(n), scratch;
+    for (size_t k = 0; k < n; ++k) {
+        re[k] = sin(0.3 * k) + (double)(k % 5);
+        im[k] = cos(0.7 * k);
+    }
+    const vector<double> r0 = re, i0 = im;
+    fftForward(fftPlan(n), re.data(), im.data(), scratch);
+
+    const size_t step = bins && bins < n ? n / bins : 1;
+    double err = 0, scale = 0;
+    for (size_t j = 0; j < n; j += step) {
+        long double sr = 0, si = 0;
+        for (size_t k = 0; k < n; ++k) {
+            const long double a = -2 * M_PIl * (long double)((uint64_t)j * k % n) / n;
+            sr += r0[k] * cosl(a) - i0[k] * sinl(a);
+            si += r0[k] * sinl(a) + i0[k] * cosl(a);
+        }
+        err   = fmax(err, fmax(fabs((double)sr - re[j]), fabs((double)si - im[j])));
+        scale = fmax(scale, fabs((double)sr));
+    }
+    return err / fmax(scale, 1.0);
+}
+
+static double roundTripError(size_t n) {
+    Matrix x(1, n);
+    for (size_t k = 0; k < n; ++k) x.data[k] = cos(0.37 * k) + (double)(k % 7);
+    const Matrix back = fftMatrix(fftMatrix(x, false), true);
+    double err = 0;
+    for (size_t k = 0; k < n; ++k) {
+        err = fmax(err, fabs(back.data[k] - x.data[k]));
+        err = fmax(err, fabs(back.data[n + k]));   // imaginary row
+    }
+    return err;
+}
+
+static bool throws(const Matrix& a, const Matrix* b = nullptr) {
+    try {
+        if (b) convolve(a, *b);
+        else   fftMatrix(a, false);
+    }
+    catch (const exception&) { return true; }
+    return false;
+}
+
+int main() {
+    struct Size { size_t n; const char* kind; };
+    const Size sizes[] = {
+        {1, "trivial"}, {2, "radix 2"}, {8, "radix 4 + 2"}, {1024, "radix 4"}, {4096, "radix 4"},
+        {12, "mixed"}, {60, "mixed"}, {360, "mixed"}, {1000, "mixed"}, {2310, "mixed"},
+        {7, "generic"}, {61, "generic"}, {77, "generic"}, {118, "generic"}, {3 * 59 * 4, "generic"},
+        {67, "Bluestein"}, {131, "Bluestein"}, {2 * 101, "Bluestein"},
+    };
+    for (const Size& s : sizes) {
+        const double err = dftError(s.n, 128);
+        if (!(err < 1e-12)) cerr << "n = " << s.n << " (" << s.kind << "): " << err << "\n";
+        CHECK(err < 1e-12);
+    }
+    // a large prime: Bluestein on a 2^18 inner plan, checked at 64 bins
+    CHECK(dftError(131071, 64) < 1e-11);
+
+    // (from 2 up: a one-point [re; im] is 2x1, which reads as a real column)
+    for (size_t n : {2, 3, 16, 60, 77, 67, 1000}) {
+        const double err = roundTripError(n);
+        if (!(err < 1e-12)) cerr << "round trip n = " << n << ": " << err << "\n";
+        CHECK(err < 1e-12);
+    }
+
+    // conv, both the direct loop and the FFT path, against the direct sum
+    for (size_t na : {1, 3, 50, 700}) {
+        for (size_t nb : {1, 8, 100}) {
+            Matrix a(1, na), b(nb, 1);
+            for (size_t k = 0; k < na; ++k) a.data[k] = sin(1.0 + k);
+            for (size_t k = 0; k < nb; ++k) b.data[k] = 1.0 / (1 + k);
+            const Matrix c = convolve(a, b);
+            CHECK_EQ(c.data.size(), na + nb - 1);
+            double err = 0;
+            for (size_t i = 0; i < c.data.size(); ++i) {
+                double want = 0;
+                for (size_t j = 0; j < na; ++j)
+                    if (i >= j && i - j < nb) want += a.data[j] * b.data[i - j];
+                err = fmax(err, fabs(c.data[i] - want));
+            }
+            CHECK(err < 1e-12);
+        }
+    }
+
+    // empty input is an error, not an endless factorization
+    const Matrix empty(1, 0), one(1, 1, 2.0);
+    CHECK(throws(empty));
+    CHECK(throws(empty, &empty));
+    CHECK(throws(one, &empty));
+    CHECK(throws(empty, &one));
+    return checkResult("test_fft");
+}
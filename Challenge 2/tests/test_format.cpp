@@ -0,0 +1,52 @@
+// test_format.cpp
+// Result formats, eng N above all: N decimals on every row, including when
+// rounding carries the mantissa into the next power of ten
+
+#include "check.h"
+#include "format.h"
+
+#include <cmath>
+#include <string>
+
+using namespace std;
+
+static string fmt(double v, NumberFormat::Mode mode, int digits) {
+    return string(formatNumber(v, NumberFormat{mode, digits}));
+}
+
+static string eng(double v, int digits) { return fmt(v, NumberFormat::Engineering, digits); }
+
+int main() {
+    struct Case { double v; int digits; const char* want; };
+    const Case cases[] = {
+        {12345, 0, "12e+03"},       {12345, 1, "12.3e+03"},      {12345, 3, "12.345e+03"},
+        {1.5, 0, "2e+00"},          {1.5, 1, "1.5e+00"},         {1.5, 2, "1.50e+00"},
+        {0.001234, 2, "1.23e-03"},  {0.0001234, 2, "123.40e-06"}, {-4.5e7, 0, "-45e+06"},
+        {999.96, 1, "1.0e+03"},     {99.96, 1, "100.0e+00"},     {9.996, 2, "10.00e+00"},
+        {999.5, 0, "1e+03"},        {0.0999999, 3, "100.000e-03"}, {1e-300, 1, "1.0e-300"},
+        {0, 2, "0.00e+00"},         {-0.0, 0, "-0e+00"},         {6.02214076e23, 4, "602.2141e+21"},
+    };
+    for (const Case& c : cases) CHECK_EQ(eng(c.v, c.digits), string(c.want));
+    CHECK_EQ(eng(INFINITY, 2), string("inf"));
+    CHECK_EQ(eng(-INFINITY, 0), string("-inf"));
+    CHECK_EQ(eng(NAN, 1), string("nan"));
+
+    // A column of values keeps one number of decimals
+    for (int digits = 0; digits <= 4; ++digits) {
+        for (double v = 3e-7; v < 1e9; v *= 7.3) {
+            const string s = eng(v, digits);
+            const size_t dot = s.find('.'), e = s.find('e');
+            CHECK_EQ(dot == string::npos ? 0 : e - dot - 1, (size_t)digits);
+            CHECK(stoi(s.substr(e + 1)) % 3 == 0);
+            CHECK(fabs(stod(s) - v) <= 0.5 * pow(10.0, stoi(s.substr(e + 1)) - digits) * 1.0000001);
+        }
+    }
+
+    // The other modes, for reference
+    CHECK_EQ(fmt(3.14159, NumberFormat::Fixed, 2), string("3.14"));
+    CHECK_EQ(fmt(1e20, NumberFormat::Fixed, 2), string("1.00e+20"));
+    CHECK_EQ(fmt(1e-9, NumberFormat::Fixed, 6), string("1.000000e-09"));
+    CHECK_EQ(fmt(0.1, NumberFormat::Shortest, 0), string("0.1"));
+    CHECK_EQ(fmt(12345, NumberFormat::Scientific, 1), string("1.2e+04"));
+    return checkResult("test_format");
+}
@@ -0,0 +1,88 @@
+// test_formulas.cpp
+// Formula files compiled to .cbc, written, mapped back and evaluated
+
+#include "check.h"
+#include "formulas.h"
+#include "parser.h"
+#include "vm.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+int main() {
+    const auto dir  = filesystem::temp_directory_path();
+    const string id = to_string(getpid());
+    const string src = (dir / ("calc_test_" + id + ".txt")).string();
+    const string cbc = (dir / ("calc_test_" + id + ".cbc")).string();
+    {
+        ofstream out(src);
+        out << "# test formulas\n"
+            << "area(w, h) = w * h\n"
+            << "\n"
+            << "golden = (1 + sqrt(5)) / 2\n"
+            << "hyp(a, b) = sqrt(a^2 + b^2)\n"
+            << "poly3(x) = 3*x^3 - 2*x + 1\n";
+    }
+
+    auto progs = compileFormulaFile(src);
+    CHECK_EQ(progs.size(), (size_t)4);
+    writeCompiledFile(cbc, progs);
+
+    {
+        CompiledFile file(cbc);
+        CHECK_EQ(file.size(), progs.size());
+        for (size_t i = 0; i < file.size(); ++i) {
+            // same names, parameters and code as before writing
+            CHECK_EQ(string(file.name(i)), progs[i].name);
+            CHECK_EQ(file.paramCount(i), (uint32_t)progs[i].prog.vars.size());
+            for (uint32_t k = 0; k < file.paramCount(i); ++k)
+                CHECK_EQ(string(file.param(i, k)), progs[i].prog.vars[k]);
+            const ProgramView a = file.program(i), b = progs[i].prog.view();
+            CHECK_EQ(a.ncode, b.ncode);
+            CHECK_EQ(a.nconsts, b.nconsts);
+            CHECK_EQ(a.nregs, b.nregs);
+            for (uint32_t k = 0; k < a.ncode && k < b.ncode; ++k)
+                CHECK(a.code[k].op == b.code[k].op && a.code[k].dst == b.code[k].dst &&
+                      a.code[k].a == b.code[k].a && a.code[k].b == b.code[k].b &&
+                      a.code[k].c == b.code[k].c);
+        }
+
+        CHECK_EQ(file.find("missing"), -1L);
+        const long area = file.find("area");
+        CHECK(area >= 0);
+        if (area >= 0) {
+            auto regs = makeRegisters(file.program(area));
+            regs[0] = 3;
+            regs[1] = 4.5;
+            CHECK_SAME(execute(file.program(area), regs.data()), 13.5);
+        }
+
+        double r = 0;
+        CHECK(callFormula(file, "hyp(3, 4)", r));
+        CHECK_SAME(r, 5);
+        CHECK(callFormula(file, "golden", r));
+        CHECK_SAME(r, (1 + sqrt(5.0)) / 2);
+        CHECK(callFormula(file, "poly3(2)", r));
+        CHECK_SAME(r, 21);
+        CHECK(!callFormula(file, "2 + 2", r));
+    }
+
+    // A damaged file is refused rather than mapped
+    {
+        ofstream out(cbc, ios::binary | ios::trunc);
+        out << "CALCBC";
+    }
+    bool refused = false;
+    try { CompiledFile bad(cbc); }
+    catch (const exception&) { refused = true; }
+    CHECK(refused);
+
+    remove(src.c_str());
+    remove(cbc.c_str());
+    return checkResult("test_formulas");
+}
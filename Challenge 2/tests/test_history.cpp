@@ -0,0 +1,132 @@
+// test_history.cpp
+// The mapped history log and its trigram index, across a close and reopen,
+// and what survives a damaged index or trigram file
+
+#include "check.h"
+#include "history.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// Bytes in use in a closed history file, by its header
+static uint64_t usedBytes(const string& path) {
+    HistHeader h{};
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return 0;
+    if (fread(&h, sizeof h, 1, f) != 1) h.used = 0;
+    fclose(f);
+    return h.used;
+}
+
+// Overwrite bytes of a closed history file
+static void patch(const string& path, long at, const void* bytes, size_t n) {
+    FILE* f = fopen(path.c_str(), "r+b");
+    fseek(f, at, SEEK_SET);
+    fwrite(bytes, 1, n, f);
+    fclose(f);
+}
+
+static string hits(const History& h, const string& text, bool prefix, size_t limit = 10) {
+    string s;
+    for (size_t i : h.search(text, prefix, limit)) s += (s.empty() ? "" : ",") + to_string(i);
+    return s;
+}
+
+int main() {
+    char dir[] = "/tmp/calc_history_XXXXXX";
+    CHECK(mkdtemp(dir) != nullptr);
+    const string path = string(dir) + "/history";
+    const vector<pair<string, double>> lines = {
+        {"1 + 2", 3}, {"sin(pi/2)", 1}, {"sqrt(2) * sqrt(2)", 2.0000000000000004},
+        {"1/0", NAN}, {"", 0}, {"sinh(1) - sin(1)", 0.33}, {string(70000, 'x'), -1},
+    };
+
+    {
+        History h(path);
+        CHECK(h.note.empty());
+        for (auto& [text, result] : lines) h.append(text, result);
+        CHECK_EQ(hits(h, "sin", false), string("5,1"));   // builds the trigram index
+        h.append("asin(1)", 1.57);                          // ... which then catches up
+        CHECK_EQ(hits(h, "sin", false), string("7,5,1"));
+    }
+    CHECK(usedBytes(path + ".tri") > sizeof(HistHeader) + 24);   // postings for the next session
+    {
+        History h(path);
+        CHECK(h.note.empty());
+        CHECK_EQ(h.size(), lines.size() + 1);
+        for (size_t i = 0; i < lines.size(); ++i) {
+            CHECK(h.input(i) == lines[i].first);
+            CHECK_SAME(h.result(i), lines[i].second);
+        }
+        CHECK(h.input(lines.size()) == "asin(1)");
+        CHECK_EQ(hits(h, "sin", false), string("7,5,1"));
+        CHECK_EQ(hits(h, "sin", true), string("5,1"));
+        CHECK_EQ(hits(h, "sin(", true), string("1"));
+        CHECK_EQ(hits(h, "qrt(2) ", false), string("2"));
+        CHECK_EQ(hits(h, "1", false, 2), string("7,5"));   // short: a plain walk, newest first
+        CHECK_EQ(hits(h, "xxxxx", true), string("6"));
+        CHECK_EQ(hits(h, "cos", false), string(""));
+
+        History busy(path);   // the files are locked while h has them
+        CHECK(!busy.note.empty());
+
+        h.clear();
+        CHECK_EQ(h.size(), size_t(0));
+        CHECK_EQ(hits(h, "sin", false), string(""));
+        h.append("cos(0)", 1);
+        CHECK_EQ(hits(h, "cos", true), string("0"));
+    }
+    {
+        History h(path);
+        CHECK_EQ(h.size(), size_t(1));
+        CHECK(h.input(0) == "cos(0)");
+        CHECK_EQ(hits(h, "sin", false), string(""));   // clear() emptied the saved postings too
+        h.append("tan(1)", 1.56);
+        h.append("cos(1)", 0.54);
+        CHECK_EQ(hits(h, "cos", false), string("2,0"));
+    }
+    {
+        History h(path);
+        h.append("acos(1)", 0);   // saved postings, then caught up
+        CHECK_EQ(hits(h, "cos", false), string("3,2,0"));
+        CHECK_EQ(hits(h, "tan", true), string("1"));
+    }
+    {
+        // Postings that run past their file are ignored and rebuilt
+        const uint32_t count = UINT32_MAX;
+        patch(path + ".tri", sizeof(HistHeader) + 24 + 4, &count, sizeof count);
+        History h(path);
+        CHECK(h.note.empty());
+        CHECK_EQ(hits(h, "cos", false), string("3,2,0"));
+    }
+    {
+        // An offset past the end of the log cuts the index there
+        const uint64_t bad = uint64_t(1) << 40;
+        patch(path + ".idx", sizeof(HistHeader) + 8 * 2, &bad, sizeof bad);
+        History h(path);
+        CHECK(!h.note.empty());
+        CHECK_EQ(h.size(), size_t(2));
+        CHECK(h.input(1) == "tan(1)");
+        CHECK_EQ(hits(h, "cos", false), string("0"));
+        h.append("cos(2)", -0.42);
+    }
+    {
+        History h(path);
+        CHECK(h.note.empty());
+        CHECK_EQ(h.size(), size_t(3));
+        CHECK(h.input(2) == "cos(2)");
+        CHECK_EQ(hits(h, "cos", false), string("2,0"));
+    }
+
+    remove(path.c_str());
+    remove((path + ".idx").c_str());
+    remove((path + ".tri").c_str());
+    rmdir(dir);
+    return checkResult("test_history");
+}
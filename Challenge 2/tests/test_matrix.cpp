@@ -0,0 +1,160 @@
+// test_matrix.cpp
+// Elementwise array expressions: division by zero reports the scalar error.
+// The kernels: matmul on ragged tiles against the triple loop, solve and
+// det by their residuals, transpose, and polyBulk's Horner and Estrin paths.
+
+#include "check.h"
+#include "errors.h"
+#include "matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static string run(const string& expr) {
+    try {
+        const Matrix m = evalArray(arrayPostfix(tokenize(expr)));
+        string s;
+        for (double v : m.data) s += (s.empty() ? "" : " ") + to_string((int)v);
+        return s;
+    }
+    catch (const exception& e) { return e.what(); }
+}
+
+static Matrix randomMatrix(size_t r, size_t c, mt19937_64& rng) {
+    uniform_real_distribution<double> u(-1, 1);
+    Matrix m(r, c);
+    for (double& v : m.data) v = u(rng);
+    return m;
+}
+
+// Largest |A B - C| relative to the largest |A||B| sum, the triple loop
+// taken in long double
+static double productError(const Matrix& A, const Matrix& B, const Matrix& C) {
+    double err = 0, scale = 0;
+    for (size_t i = 0; i < A.rows; ++i)
+        for (size_t j = 0; j < B.cols; ++j) {
+            long double s = 0, m = 0;
+            for (size_t k = 0; k < A.cols; ++k) {
+                s += (long double)A.at(i, k) * B.at(k, j);
+                m += fabsl((long double)A.at(i, k) * B.at(k, j));
+            }
+            err   = max(err, (double)fabsl(s - C.at(i, j)));
+            scale = max(scale, (double)m);
+        }
+    return err / scale;
+}
+
+int main() {
+    mt19937_64 rng(7);
+
+    // Sizes that leave partial micro-tiles and cache blocks in every
+    // dimension; the last also goes over the pool
+    const size_t shapes[][3] = {{1, 1, 1}, {5, 7, 3}, {4, 8, 8}, {9, 1, 17}, {130, 257, 259}};
+    for (auto& s : shapes) {
+        const Matrix A = randomMatrix(s[0], s[1], rng), B = randomMatrix(s[1], s[2], rng);
+        const Matrix C = matmul(A, B);
+        CHECK_EQ(C.rows, s[0]);
+        CHECK_EQ(C.cols, s[2]);
+        CHECK(productError(A, B, C) < 1e-14);
+    }
+    bool threw = false;
+    try { matmul(Matrix(2, 3), Matrix(2, 3)); } catch (const exception&) { threw = true; }
+    CHECK(threw);
+
+    const Matrix T = transpose(randomMatrix(3, 70, rng));
+    const Matrix TT = transpose(T);
+    CHECK_EQ(T.rows, size_t(70));
+    CHECK_EQ(TT.rows, size_t(3));
+    for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 70; ++j) CHECK_SAME(TT.at(i, j), T.at(j, i));
+
+    // solve: A X - B small next to |A| |X|; a row vector B comes back as a row
+    for (size_t n : {1, 2, 7, 64, 150}) {
+        const Matrix A = randomMatrix(n, n, rng), B = randomMatrix(n, 3, rng);
+        const Matrix X = solveLinear(A, B);
+        const Matrix R = matmul(A, X);
+        double err = 0, scale = 0;
+        for (size_t i = 0; i < n; ++i)
+            for (size_t c = 0; c < 3; ++c) {
+                err = max(err, fabs(R.at(i, c) - B.at(i, c)));
+                double m = 0;
+                for (size_t k = 0; k < n; ++k) m += fabs(A.at(i, k) * X.at(k, c));
+                scale = max(scale, m);
+            }
+        CHECK(err < 1e-13 * scale);
+    }
+    {
+        Matrix A(2, 2);
+        A.data = {2, 1, 1, 3};
+        Matrix b(1, 2);
+        b.data = {3, 5};
+        const Matrix x = solveLinear(A, b);
+        CHECK_EQ(x.rows, size_t(1));
+        CHECK(fabs(x.data[0] - 0.8) < 1e-15 && fabs(x.data[1] - 1.4) < 1e-15);
+    }
+    threw = false;
+    try { solveLinear(Matrix(3, 3, 1), Matrix(3, 1, 1)); } catch (const exception&) { threw = true; }
+    CHECK(threw);
+
+    // det: a triangular product whose determinant is known, through a row
+    // swap, and det(A B) = det(A) det(B)
+    {
+        const size_t n = 40;
+        Matrix L(n, n), U(n, n);
+        double want = 1;
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j) {
+                if (j < i) L.at(i, j) = 0.25 * sin(i + 2.0 * j);
+                if (j > i) U.at(i, j) = cos(3.0 * i + j);
+                if (i == j) { L.at(i, i) = 1; U.at(i, i) = 1 + 0.01 * i; want *= U.at(i, i); }
+            }
+        Matrix A = matmul(L, U);
+        CHECK(fabs(det(A) - want) < 1e-12 * want);
+        swap_ranges(A.data.begin(), A.data.begin() + n, A.data.begin() + n);
+        CHECK(fabs(det(A) + want) < 1e-12 * want);
+
+        const Matrix P = randomMatrix(9, 9, rng), Q = randomMatrix(9, 9, rng);
+        const double dp = det(P), dq = det(Q);
+        CHECK(fabs(det(matmul(P, Q)) - dp * dq) < 1e-12 * fabs(dp * dq) + 1e-15);
+        CHECK_SAME(det(Matrix(3, 3, 2)), 0.0);
+    }
+
+    // polyBulk against a long double Horner, on both sides of degree 8 and
+    // on lengths that leave a partial block of 64
+    for (size_t degree : {0, 1, 5, 7, 8, 9, 12, 20}) {
+        vector<double> coeffs(degree + 1);
+        for (size_t k = 0; k <= degree; ++k) coeffs[k] = ((k * 37) % 11) / 5.0 - 1;
+        const size_t n = 200;
+        vector<double> xs(n), ys(n);
+        for (size_t i = 0; i < n; ++i) xs[i] = -1.2 + 2.4 * i / (n - 1);
+        polyBulk(coeffs, xs.data(), ys.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            long double h = 0, m = 0;
+            for (double c : coeffs) {
+                h = h * xs[i] + c;
+                m = m * fabs(xs[i]) + fabs(c);
+            }
+            CHECK(fabsl(ys[i] - h) <= 1e-15L * m * (degree + 1));
+        }
+    }
+
+    const string zero = errorMessage(CalcError::DivideByZero);
+    CHECK_EQ(run("[1, 2] / [1, 0]"), zero);
+    CHECK_EQ(run("[1, 2] / 0"), zero);
+    CHECK_EQ(run("1 / [0, 1]"), zero);
+    CHECK_EQ(run("[1/0, 2]"), zero);
+    CHECK_EQ(run("min([1, 2] / [1, 0], 3)"), zero);
+    CHECK_EQ(run("dot([1, 2], [1, 0] / [1, 0])"), zero);
+    CHECK_EQ(run("[0, 6] / [1, 2]"), string("0 3"));
+    // if() keeps only the chosen side's errors, as the scalar VM skips the other
+    CHECK_EQ(run("if([1, 0, 2] != 0, 4 / [1, 0, 2], 7)"), string("4 7 2"));
+    CHECK_EQ(run("if([1, 0] != 0, 5, [1, 0] / [1, 0])"), zero);
+    CHECK_EQ(run("if(1 / [0, 1] > 0, 1, 2)"), zero);
+    return checkResult("test_matrix");
+}
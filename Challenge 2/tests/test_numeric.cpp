@@ -0,0 +1,151 @@
+// test_numeric.cpp
+// integrate() over the thread pool: accurate, and the same bits on every run.
+// solve() and minimize() on both their Newton and derivative-free paths,
+// alone and in the batch form.  Range reductions: the same bits from one
+// thread as from many, and the identities of an empty range.
+
+#include "check.h"
+#include "drivers.h"
+#include "numeric.h"
+#include "parser.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The same objective with its derivatives dropped: Brent's methods only
+static Objective withoutDerivatives(const string& expr, const vector<string>& vars) {
+    Objective o = compileObjective(expr, vars);
+    o.hasDf = o.hasD2f = false;
+    return o;
+}
+
+static string driverError(const string& line) {
+    double result;
+    string note;
+    ostringstream os;
+    try { callDriver(line, result, note, os); } catch (const exception& e) { return e.what(); }
+    return "";
+}
+
+int main() {
+    setenv("CALC_THREADS", "4", 0);   // before the pool is first used
+
+    Program f = compile(infixToPostfix(tokenize("sin(x)*exp(-x/7) + sqrt(abs(x-3))", {"x"})), {"x"});
+    // sin(x) e^(-x/7) integrates to -(7/50) e^(-x/7) (sin x + 7 cos x)
+    const double exact = 0.98 + (2 * pow(3, 1.5) + 2 * pow(37, 1.5)) / 3 -
+                         0.14 * exp(-40.0 / 7) * (sin(40.0) + 7 * cos(40.0));
+    const Integral first = integrate(f.view(), 0, 40, 1e-12);
+    CHECK(first.converged);
+    CHECK(fabs(first.value - exact) < 1e-9 * exact);
+
+    for (int run = 0; run < 20; ++run) {
+        const Integral again = integrate(f.view(), 0, 40, 1e-12);
+        CHECK(memcmp(&again.value, &first.value, sizeof(double)) == 0);
+        CHECK(memcmp(&again.error, &first.error, sizeof(double)) == 0);
+        CHECK_EQ(again.intervals, first.intervals);
+    }
+
+    // x^3 - 2x - 5 has its one real root at 2.0945514815423265...
+    {
+        const double root = 2.0945514815423265;
+        const Objective newton = compileObjective("x^3 - 2*x - 5", {"x"});
+        const Objective brent = withoutDerivatives("x^3 - 2*x - 5", {"x"});
+        CHECK(newton.hasDf);
+        for (const Objective* o : {&newton, &brent}) {
+            ObjectiveRunner r(*o);
+            const Result<double> x = findRoot(r, 2, 3);
+            CHECK(x.ok());
+            CHECK(fabs(x.value - root) < 4e-16 * root);
+            const Result<double> y = findRoot(r, 3, 2);   // either orientation
+            CHECK(y.ok() && fabs(y.value - root) < 4e-16 * root);
+        }
+        ObjectiveRunner r(newton);
+        const Result<double> none = findRoot(r, -1, 1);   // f < 0 at both ends
+        CHECK(!none.ok());
+        CHECK(none.error == CalcError::NoBracketedRoot);
+        CHECK_EQ(driverError("solve(x^2 + 1, x, -1, 1)"), errorMessage(CalcError::NoBracketedRoot));
+        CHECK_EQ(driverError("solve(x^2 - 2, x, 0, 2)"), string(""));
+    }
+    // x^4 - 3x^3 + 2 has f' = x^2 (4x - 9): a minimum at 9/4.  Brent alone
+    // stops near sqrt(eps); the Newton polish gets the rest.
+    {
+        const Objective quartic = compileObjective("x^4 - 3*x^3 + 2", {"x"});
+        const Objective quarticBrent = withoutDerivatives("x^4 - 3*x^3 + 2", {"x"});
+        const Objective cosine = compileObjective("cos(x)", {"x"});
+        ObjectiveRunner polished(quartic), plain(quarticBrent), wave(cosine);
+        CHECK(fabs(findMinimum(polished, 1, 4) - 2.25) < 1e-14);
+        CHECK(fabs(findMinimum(plain, 1, 4) - 2.25) < 1e-7);
+        CHECK(fabs(findMinimum(wave, 5, 2) - M_PI) < 1e-14);
+    }
+    // The batch form: each instance equal to solving it alone, failures as nan
+    {
+        const Objective o = compileObjective("x^2 - p", {"x", "p"});
+        const vector<double> ps = {-1, 0.5, 2, 3, 10, 99, 150};
+        for (bool minimize : {false, true}) {
+            const vector<double> batch = solveBatch(o, minimize, 0, 10, ps);
+            CHECK_EQ(batch.size(), ps.size());
+            for (size_t i = 0; i < ps.size(); ++i) {
+                ObjectiveRunner r(o);
+                r.setParams(&ps[i], 1);
+                const Result<double> one = minimize ? Result<double>(findMinimum(r, 0, 10)) : findRoot(r, 0, 10);
+                CHECK_SAME(batch[i], one.ok() ? one.value : NAN);
+            }
+        }
+        CHECK(isnan(solveBatch(o, false, 0, 10, ps)[0]));    // no root for p < 0
+        CHECK(isnan(solveBatch(o, false, 0, 10, ps)[6]));    // nor past 10^2
+
+        // ... and through the REPL's p = from : to form
+        double result;
+        string note;
+        ostringstream os;
+        CHECK(callDriver("solve(x^2 - p, x, 0, 10, p = 1 : 120 : 7)", result, note, os));
+        istringstream table(os.str());
+        string line;
+        getline(table, line);   // "  p, x"
+        size_t rows = 0;
+        for (; getline(table, line); ++rows) {
+            const double p = stod(line.substr(0, line.find(','))), x = stod(line.substr(line.find(',') + 1));
+            ObjectiveRunner r(o);
+            r.setParams(&p, 1);
+            const Result<double> one = findRoot(r, 0, 10);
+            CHECK_SAME(x, one.ok() ? one.value : NAN);
+        }
+        CHECK_EQ(rows, size_t(18));
+        CHECK_EQ(note, string("3 of 18 instances failed"));   // p = 106, 113, 120
+    }
+    // Range reductions, long enough for many blocks and a ragged last one
+    {
+        ThreadPool one(1), many(8);
+        Program body = compile(infixToPostfix(tokenize("sin(k) / k + (-1)^k / sqrt(k)", {"k"})), {"k"});
+        Program factor = compile(infixToPostfix(tokenize("1 + sin(k) / k^2", {"k"})), {"k"});
+        const uint64_t count = 3000017;
+        for (Reduction op : {Reduction::Sum, Reduction::Prod, Reduction::Min, Reduction::Max}) {
+            const ProgramView f = op == Reduction::Prod ? factor.view() : body.view();
+            const double serial = reduceRange(f, 1, count, op, one);
+            const double parallel = reduceRange(f, 1, count, op, many);
+            CHECK(isfinite(serial));
+            CHECK(memcmp(&parallel, &serial, sizeof(double)) == 0);
+            CHECK_SAME(reduceRange(f, 1, count, op), serial);
+        }
+        CHECK_SAME(reduceRange(body.view(), 1, 0, Reduction::Sum, one), 0.0);
+        CHECK_SAME(reduceRange(body.view(), 1, 0, Reduction::Prod, many), 1.0);
+
+        double result = -1;
+        string note;
+        ostringstream os;
+        CHECK(callDriver("sum(k, 1, 0, k)", result, note, os));
+        CHECK_SAME(result, 0.0);
+        CHECK(callDriver("prod(k, 5, 4.5, k)", result, note, os));
+        CHECK_SAME(result, 1.0);
+        CHECK(callDriver("sum(k, 1, 100, k)", result, note, os));
+        CHECK_SAME(result, 5050.0);
+    }
+    return checkResult("test_numeric");
+}
@@ -0,0 +1,55 @@
+// test_parser.cpp
+// The SIMD character classifier against the scalar table, and the tokenizer
+// on operators and punctuation
+
+#include "check.h"
+#include "parser.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static string joinTexts(const TokenList& tokens) {
+    string s;
+    for (const Token& t : tokens) s += (s.empty() ? "" : " ") + t.text;
+    return s;
+}
+
+int main() {
+    // Every byte value, in every lane position
+    for (int start = 0; start < 256; start += 64) {
+        for (int shift = 0; shift < 64; shift += 13) {
+            char block[64];
+            for (int k = 0; k < 64; ++k) block[k] = (char)(uint8_t)(start + (k + shift) % 64);
+            const BlockMasks simd = classifyBlock(block), table = classifyBlockScalar(block);
+            CHECK_EQ(simd.digit, table.digit);
+            CHECK_EQ(simd.alpha, table.alpha);
+            CHECK_EQ(simd.space, table.space);
+            CHECK_EQ(simd.dot, table.dot);
+            CHECK_EQ(simd.op, table.op);
+        }
+    }
+
+    struct Case { const char* expr; const char* tokens; };
+    const Case cases[] = {
+        {"2**10 + 1<<4 - 256>>2", "2 ** 10 + 1 << 4 - 256 >> 2"},
+        {"3<=4 == 3>=4 != 3<4", "3 <= 4 == 3 >= 4 != 3 < 4"},
+        {"-3 + -(2) * -x", "neg 3 + neg ( 2 ) * neg x"},
+        {"[1, 2; 3, +4]", "[ 1 , 2 ; 3 , 4 ]"},
+        {"5! - 1", "5 ! - 1"},
+        {"~0xff & 0b101 | 7 xor 2", "~ 255 & 5 | 7 xor 2"},
+        {"1.5e-3/.5%2^x", "1.5e-3 / .5 % 2 ^ x"},
+        {"0XFF + 0B11 - 0x", "255 + 3 - 0 x"},
+        {"5! != -2", "5 ! != neg 2"},
+    };
+    for (const Case& c : cases) CHECK_EQ(joinTexts(tokenize(c.expr, {"x"})), string(c.tokens));
+
+    CHECK(tryTokenize("1 = 2").error == CalcError::InvalidCharacter);
+    CHECK(tryTokenize("2 # 3").error == CalcError::InvalidCharacter);
+    CHECK(tryTokenize("1 + é").error == CalcError::InvalidCharacter);
+    CHECK(tryTokenize("0\xff").error == CalcError::InvalidCharacter);   // high bytes are not letters
+    CHECK(tryTokenize("0x\xe9").error == CalcError::UnknownName);       // ... nor hex digits
+    return checkResult("test_parser");
+}
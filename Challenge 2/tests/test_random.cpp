@@ -0,0 +1,61 @@
+// test_random.cpp
+// rand() from several threads at once: every evaluation gets its own sample.
+// mc() seeds: whole numbers repeat their run, anything else is refused.
+
+#include "check.h"
+#include "drivers.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+int main() {
+    setenv("CALC_SEED", "42", 1);
+    const TokenList tokens = tokenize("rand()");
+    const int threads = 4, perThread = 2000;
+    vector<vector<double>> got(threads);
+    vector<thread> pool;
+    for (int t = 0; t < threads; ++t)
+        pool.emplace_back([&, t] {
+            LineArena arena;
+            for (int k = 0; k < perThread; ++k) {
+                LineScope scope(arena);
+                got[t].push_back(evalScalar(tokens));
+            }
+        });
+    for (thread& th : pool) th.join();
+
+    // The draws are samples 0 .. threads * perThread - 1, each exactly once
+    vector<double> all, want(threads * perThread);
+    for (auto& g : got) all.insert(all.end(), g.begin(), g.end());
+    fillRandom(want.data(), want.size(), 0, 0, false, defaultSeed());
+    sort(all.begin(), all.end());
+    sort(want.begin(), want.end());
+    CHECK(all == want);
+
+    auto mc = [](const string& seed, double& result) {
+        string note;
+        ostringstream os;
+        try { callDriver("mc(rand() + randn(), 1000, " + seed + ")", result, note, os); }
+        catch (const exception& e) { return string(e.what()); }
+        return string();
+    };
+    double first = 0, again = 1, other = 2;
+    CHECK_EQ(mc("12345", first), string());
+    CHECK_EQ(mc("12345", again), string());
+    CHECK_EQ(mc("0", other), string());
+    CHECK_SAME(first, again);
+    CHECK(first != other);
+    CHECK_EQ(mc("2^64 - 2^11", other), string());   // the largest double below 2^64
+    const string refused = "Seed must be a whole number from 0 to 2^64 - 1";
+    for (const char* seed : {"-1", "0.5", "2^64", "1e300", "sqrt(-1)", "-0.5"})
+        CHECK_EQ(mc(seed, other), refused);
+    return checkResult("test_random");
+}
@@ -0,0 +1,47 @@
+// test_sampling.cpp
+// sample(): few points where the curve is flat, many at a kink or a jump,
+// and no aliasing on a period that divides the grid
+
+#include "check.h"
+#include "parser.h"
+#include "sampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+static SampleResult run(const char* expr, double a, double b) {
+    Program f = compile(infixToPostfix(tokenize(expr, {"x"})), {"x"});
+    return sampleAdaptive(f.view(), a, b, 1e-4);
+}
+
+static size_t countIn(const SampleResult& r, double lo, double hi) {
+    return count_if(r.points.begin(), r.points.end(),
+                    [&](const SamplePoint& p) { return p.x >= lo && p.x <= hi; });
+}
+
+int main() {
+    const SampleResult flat = run("3 + 0*x", -5, 5);
+    CHECK(flat.points.size() < 100);
+    CHECK_EQ(flat.levels, size_t(1));
+    CHECK(is_sorted(flat.points.begin(), flat.points.end(),
+                    [](const SamplePoint& p, const SamplePoint& q) { return p.x < q.x; }));
+
+    const SampleResult kink = run("abs(x - 0.3)", -1, 1);
+    CHECK(countIn(kink, 0.29, 0.31) > 3 * countIn(kink, -0.81, -0.79) + 5);
+    CHECK(kink.points.size() < 200);
+
+    const SampleResult jump = run("x > 0.5", 0, 1);
+    CHECK(countIn(jump, 0.5 - 1e-6, 0.5 + 1e-6) >= 20);
+    CHECK(countIn(jump, 0.1, 0.4) < 20);
+    CHECK(!jump.truncated);
+
+    // Zero at every grid node; the probes must still find the waves
+    const SampleResult wave = run("sin(64*pi*x)", 0, 1);
+    double peak = 0;
+    for (const SamplePoint& p : wave.points) peak = max(peak, fabs(p.y));
+    CHECK(peak > 0.99);
+    CHECK(wave.points.size() > 1000);
+    return checkResult("test_sampling");
+}
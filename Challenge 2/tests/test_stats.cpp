@@ -0,0 +1,98 @@
+// test_stats.cpp
+// The KLL sketch's rank error, alone and merged; Moments::merge against one
+// pass; numbers cut by the 1 MB read blocks; and what counts as skipped
+
+#include "check.h"
+#include "stats.h"
+#include "threadpool.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Rank of the sketch's q-quantile, as printStats picks it, over 0 .. n-1
+static double sketchRank(const KllSketch& s, double q) {
+    const auto cdf = s.cdf();
+    const uint64_t rank = (uint64_t)ceil(q * cdf.back().second);
+    auto it = lower_bound(cdf.begin(), cdf.end(), rank,
+                          [](const pair<double,uint64_t>& p, uint64_t r) { return p.second < r; });
+    return it == cdf.end() ? cdf.back().first : it->first;
+}
+
+int main() {
+    setenv("CALC_THREADS", "4", 0);   // before the pool is first used
+
+    // 0 .. n-1 in a scrambled order: the q-quantile is q n, within 1% of n
+    {
+        const uint64_t n = 1000003;
+        KllSketch whole, parts[4];
+        for (uint64_t i = 0; i < n; ++i) {
+            const double v = double(i * 7919 % n);
+            whole.add(v);
+            parts[i % 4].add(v);
+        }
+        for (int k = 1; k < 4; ++k) parts[0].merge(parts[k]);
+        for (const KllSketch* s : {&whole, &parts[0]}) {
+            CHECK_EQ(s->cdf().back().second, n);   // compaction keeps the total weight
+            for (double q : {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99})
+                CHECK(fabs(sketchRank(*s, q) - q * n) < 0.01 * n);
+        }
+    }
+
+    // Moments merged from uneven pieces against one pass over all of them
+    {
+        vector<double> xs;
+        for (int i = 0; i < 10000; ++i) xs.push_back(1e6 + sin(i) * (i % 7));
+        Moments all;
+        for (double x : xs) all.add(x);
+        for (size_t cut : {size_t(0), size_t(1), size_t(333), size_t(5000), size_t(9999)}) {
+            Moments a, b;
+            for (size_t i = 0; i < xs.size(); ++i) (i < cut ? a : b).add(xs[i]);
+            a.merge(b);
+            CHECK_EQ(a.count, all.count);
+            CHECK(fabs(a.mean - all.mean) < 1e-13 * all.mean);
+            CHECK(fabs(a.variance() - all.variance()) < 1e-9 * all.variance());
+        }
+    }
+
+    // 1 .. n over several read blocks, a number cut at the first boundary
+    {
+        const uint64_t n = 400000;
+        string text;
+        for (uint64_t i = 1; i <= n; ++i) text += to_string(i) + (i % 10 ? " " : ",\n");
+        const size_t boundary = 1 << 20;
+        while (isdigit((unsigned char)text[boundary - 1]) + isdigit((unsigned char)text[boundary]) < 2)
+            text.insert(0, " ");
+        text += " nan inf -infinity 1e999 x12 ;";
+
+        istringstream in(text);
+        vector<StreamStats> partial(threadPool().size());
+        streamStats(in, partial);
+        StreamStats total;
+        for (const StreamStats& p : partial) total.merge(p);
+        CHECK_EQ(total.moments.count, n);
+        CHECK_EQ(total.skipped, uint64_t(5));
+        CHECK_SAME(total.sum.value(), double(n) * (n + 1) / 2);
+        CHECK_SAME(total.lo, 1.0);
+        CHECK_SAME(total.hi, double(n));
+    }
+
+    // The histogram over the whole double range: half the weight at each end
+    {
+        StreamStats st;
+        st.add(-1e308);
+        st.add(1e308);
+        ostringstream os;
+        printStats(st, os);
+        const string histogram = os.str().substr(os.str().find("histogram:"));
+        CHECK(histogram.find(" 50.00%") != histogram.rfind(" 50.00%"));
+        CHECK(histogram.find("inf") == string::npos);
+        CHECK(histogram.find("nan") == string::npos);
+    }
+    return checkResult("test_stats");
+}
@@ -0,0 +1,160 @@
+// test_vm.cpp
+// The register VM against the postfix evaluator on random expressions
+
+#include "check.h"
+#include "fixedint.h"
+#include "parser.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+// A random constant expression up to the given depth
+static string randomExpr(mt19937_64& rng, int depth) {
+    static const char* const binOps[] = {"+", "-", "*", "/", "^", "<", ">=", "=="};
+    static const char* const fns[]    = {"sin", "cos", "sqrt", "exp", "abs", "ln"};
+    const int pick = depth == 0 ? 0 : (int)(rng() % 6);
+    switch (pick) {
+        case 0: {
+            static const char* const leaves[] = {"0", "1", "2", "0.5", "3.25", "1e-3", "7", "pi", "e", "10"};
+            return leaves[rng() % 10];
+        }
+        case 1:
+            return "-(" + randomExpr(rng, depth - 1) + ")";
+        case 2:
+            return string(fns[rng() % 6]) + "(" + randomExpr(rng, depth - 1) + ")";
+        case 3:
+            return string(rng() % 2 ? "min(" : "max(") + randomExpr(rng, depth - 1) + ", " +
+                   randomExpr(rng, depth - 1) + ")";
+        default:
+            return "(" + randomExpr(rng, depth - 1) + " " + binOps[rng() % 8] + " " +
+                   randomExpr(rng, depth - 1) + ")";
+    }
+}
+
+int main() {
+    mt19937_64 rng(12345);
+    int compared = 0;
+    for (int i = 0; i < 5000; ++i) {
+        const string expr = randomExpr(rng, 1 + i % 6);
+        const TokenList pf = infixToPostfix(tokenize(expr));
+        const Result<double> want = tryEvalPostfix(pf);
+
+        for (bool share : {false, true}) {
+            Program prog = compile(pf, {}, share);
+            auto regs = makeRegisters(prog.view());
+            CalcError error = CalcError::None;
+            const double got = execute(prog.view(), regs.data(), error);
+            if (!want.ok()) {
+                CHECK(want.error == CalcError::DivideByZero);
+                CHECK(error == CalcError::DivideByZero);
+                continue;
+            }
+            CHECK(error == CalcError::None);
+            if (!sameDouble(got, want.value))
+                cerr << "expression: " << expr << (share ? " (shared)" : "") << "\n";
+            CHECK_SAME(got, want.value);
+            ++compared;
+        }
+    }
+    CHECK(compared > 5000);
+
+    // The batch kernels agree with the scalar VM lane by lane
+    {
+        const TokenList pf = infixToPostfix(tokenize("x^2 - 3*x + if(x > 1, sqrt(x), 1/x)", {"x"}));
+        Program prog = compile(pf, {"x"});
+        vector<double> xs(1000), out(1000);
+        for (size_t k = 0; k < xs.size(); ++k) xs[k] = -5 + 0.01 * k;
+        BatchMachine m(prog.view());
+        const double* cols[1] = {xs.data()};
+        executeBatch(m, cols, xs.size(), out.data());
+        auto regs = makeRegisters(prog.view());
+        for (size_t k = 0; k < xs.size(); ++k) {
+            regs[0] = xs[k];
+            CalcError error = CalcError::None;
+            CHECK_SAME(out[k], execute(prog.view(), regs.data(), error));
+        }
+    }
+    // The Horner rewrite only reassociates true polynomials: it must not
+    // cancel constants or drop a zero factor
+    {
+        struct Case { const char* expr; double x, want; };
+        const Case cases[] = {
+            {"(x+1e16)-1e16", 1, 0},
+            {"x+1e16-1e16", 1, 0},
+            {"0*x+5", INFINITY, NAN},
+            {"0*x+5", NAN, NAN},
+            {"x*0 + 5", -INFINITY, NAN},
+            {"x^2*0 + 1", INFINITY, NAN},
+            {"x - x + 2", INFINITY, NAN},
+            {"1e-200*x*1e-200*x + 1", 1e300, ((1e-200 * 1e300) * 1e-200) * 1e300},   // 1e-400 underflows
+            {"3*x^5 + 2*x^4 - x^2 + 7", 2, 131},
+        };
+        for (const Case& c : cases) {
+            Program prog = compile(infixToPostfix(tokenize(c.expr, {"x"})), {"x"});
+            auto regs = makeRegisters(prog.view());
+            regs[0] = c.x;
+            if (!sameDouble(execute(prog.view(), regs.data()), c.want)) cerr << "expression: " << c.expr << "\n";
+            CHECK_SAME(execute(prog.view(), regs.data()), c.want);
+            CHECK(prog.code.size() > 1);   // something left to compute
+        }
+        // ... while a typed polynomial still loses its pow calls
+        Program poly = compile(infixToPostfix(tokenize("3*x^5 + 2*x^4 - x^2 + 7", {"x"})), {"x"});
+        CHECK(none_of(poly.code.begin(), poly.code.end(), [](const Instr& i) { return i.op == OP_POW; }));
+    }
+    // A zero divisor in the integer batch flags its row and spares the rest
+    {
+        IntProgram prog = compileInteger(infixToPostfix(tokenize("120 / (x - 3) + x % (x - 5)", {"x"}), true), {"x"});
+        vector<uint64_t> xs(200), out(200), mask(4, ~uint64_t(0));
+        for (size_t k = 0; k < xs.size(); ++k) xs[k] = k % 10;
+        const uint64_t* cols[1] = {xs.data()};
+        executeIntegerBatch(prog, cols, xs.size(), out.data(), mask.data());
+        for (size_t k = 0; k < xs.size(); ++k) {
+            const bool zero = xs[k] == 3 || xs[k] == 5;
+            CHECK_EQ((mask[k / 64] >> (k % 64)) & 1, (uint64_t)zero);
+            if (zero) continue;
+            auto regs = makeIntegerRegisters(prog);
+            regs[0] = xs[k];
+            bool bad = false;
+            CalcError error = CalcError::None;
+            CHECK_EQ(out[k], executeInteger(prog, regs.data(), bad, error));
+            CHECK(!bad && error == CalcError::None);
+        }
+        CHECK_EQ(mask[3] >> 8, uint64_t(0));   // rows past n stay clear
+    }
+    // Literals of 2^63 and up wrap like masks; anything else that leaves
+    // int64 is an error rather than a rounded double
+    {
+        auto fixed = [](const char* expr, uint64_t& value, bool& wrap) {
+            return evalFixedWidth(tokenize(expr), value, wrap);
+        };
+        auto throws = [](const char* expr) {
+            uint64_t value;
+            bool wrap;
+            try { evalFixedWidth(tokenize(expr), value, wrap); } catch (const exception&) { return true; }
+            return false;
+        };
+        uint64_t value = 0;
+        bool wrap = false;
+        CHECK(fixed("0xFFFFFFFFFFFFFFFF", value, wrap) && wrap);
+        CHECK_EQ(value, ~uint64_t(0));
+        CHECK(fixed("0xFFFF0000FFFF0000 + 1", value, wrap) && wrap);
+        CHECK_EQ(value, uint64_t(0xFFFF0000FFFF0001));
+        CHECK(fixed("9223372036854775808 + 1", value, wrap) && wrap);
+        CHECK_EQ(value, (uint64_t(1) << 63) + 1);
+        CHECK(fixed("2^62 + 1", value, wrap) && !wrap);
+        CHECK_EQ(value, (uint64_t(1) << 62) + 1);
+        CHECK(!fixed("7 / 2", value, wrap));   // inexact: the caller uses doubles
+        CHECK(throws("2^70"));
+        CHECK(throws("9223372036854775807 + 1"));
+        CHECK(throws("-9223372036854775807 - 2"));
+        CHECK(throws("18446744073709551616"));
+    }
+    return checkResult("test_vm");
+}